@@ -19,7 +19,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>     /* strtok() */
+#include <string.h>     /* strtok_r() */
 #include <sys/types.h>  /* open() */
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -31,6 +31,28 @@ extern int errno;
 
 #define MAX_CHAR_PER_LINE 128
 
+/* allocator of the objects of file_read() */
+static void* (*obj_alloc)(size_t) = malloc;
+static void  (*obj_free)(void*)   = free;
+
+/*---< file_set_allocator() >------------------------------------------------*/
+/* e.g. kmeans_arena_alloc()/kmeans_arena_free() to read onto huge pages;    */
+/* objects read before must still be released with file_free_objects()       */
+/* under the allocator they came from                                        */
+void file_set_allocator(void* (*alloc)(size_t), void (*release)(void*))
+{
+    obj_alloc = alloc;
+    obj_free  = release;
+}
+
+/*---< file_free_objects() >-------------------------------------------------*/
+void file_free_objects(float **objects)
+{
+    if (objects == NULL) return;
+    obj_free(objects[0]);
+    obj_free(objects);
+}
+
 
 /*---< file_read() >---------------------------------------------------------*/
 float** file_read(int   isBinaryFile,  /* flag: 0 or 1 */
@@ -59,9 +81,9 @@ float** file_read(int   isBinaryFile,  /* flag: 0 or 1 */
 
         /* allocate space for objects[][] and read all objects */
         len = (*numObjs) * (*numCoords);
-        objects    = (float**)malloc((*numObjs) * sizeof(float*));
+        objects    = (float**)obj_alloc((*numObjs) * sizeof(float*));
         assert(objects != NULL);
-        objects[0] = (float*) malloc(len * sizeof(float));
+        objects[0] = (float*) obj_alloc(len * sizeof(float));
         assert(objects[0] != NULL);
         for (i=1; i<(*numObjs); i++)
             objects[i] = objects[i-1] + (*numCoords);
@@ -73,7 +95,7 @@ float** file_read(int   isBinaryFile,  /* flag: 0 or 1 */
     }
     else {  /* input file is in ASCII format -------------------------------*/
         FILE *infile;
-        char *line, *ret;
+        char *line, *ret, *save;
         int   lineLen;
 
         if ((infile = fopen(filename, "r")) == NULL) {
@@ -103,7 +125,7 @@ float** file_read(int   isBinaryFile,  /* flag: 0 or 1 */
                 assert(ret != NULL);
             }
 
-            if (strtok(line, " \t\n") != 0)
+            if (strtok_r(line, " \t\n", &save) != 0)
                 (*numObjs)++;
         }
         rewind(infile);
@@ -112,9 +134,9 @@ float** file_read(int   isBinaryFile,  /* flag: 0 or 1 */
         /* find the no. coordinates of each object */
         (*numCoords) = 0;
         while (fgets(line, lineLen, infile) != NULL) {
-            if (strtok(line, " \t\n") != 0) {
+            if (strtok_r(line, " \t\n", &save) != 0) {
                 /* ignore the id (first coordiinate): numCoords = 1; */
-                while (strtok(NULL, " ,\t\n") != NULL) (*numCoords)++;
+                while (strtok_r(NULL, " ,\t\n", &save) != NULL) (*numCoords)++;
                 break; /* this makes read from 1st object */
             }
         }
@@ -126,9 +148,9 @@ float** file_read(int   isBinaryFile,  /* flag: 0 or 1 */
 
         /* allocate space for objects[][] and read all objects */
         len = (*numObjs) * (*numCoords);
-        objects    = (float**)malloc((*numObjs) * sizeof(float*));
+        objects    = (float**)obj_alloc((*numObjs) * sizeof(float*));
         assert(objects != NULL);
-        objects[0] = (float*) malloc(len * sizeof(float));
+        objects[0] = (float*) obj_alloc(len * sizeof(float));
         assert(objects[0] != NULL);
         for (i=1; i<(*numObjs); i++)
             objects[i] = objects[i-1] + (*numCoords);
@@ -136,9 +158,9 @@ float** file_read(int   isBinaryFile,  /* flag: 0 or 1 */
         i = 0;
         /* read all objects */
         while (fgets(line, lineLen, infile) != NULL) {
-            if (strtok(line, " \t\n") == NULL) continue;
+            if (strtok_r(line, " \t\n", &save) == NULL) continue;
             for (j=0; j<(*numCoords); j++) {
-                objects[i][j] = atof(strtok(NULL, " ,\t\n"));
+                objects[i][j] = atof(strtok_r(NULL, " ,\t\n", &save));
                 if (_debug && i == 0) /* print the first object */
                     printf("object[i=%d][j=%d]=%f\n",i,j,objects[i][j]);
             }
@@ -179,7 +201,7 @@ int read_n_objects(int     isBinaryFile,  /* flag: 0 or 1 */
     }
     else {  /* input file is in ASCII format -------------------------------*/
         FILE *infile;
-        char *line, *ret;
+        char *line, *ret, *save;
         int   lineLen;
 
         if ((infile = fopen(filename, "r")) == NULL) {
@@ -213,9 +235,9 @@ int read_n_objects(int     isBinaryFile,  /* flag: 0 or 1 */
         /* read numObjs objects */
         for (i=0; i<numObjs; i++) {
             fgets(line, lineLen, infile);
-            if (strtok(line, " \t\n") == NULL) continue;
+            if (strtok_r(line, " \t\n", &save) == NULL) continue;
             for (j=0; j<numCoords; j++)
-                objects[i][j] = atof(strtok(NULL, " ,\t\n"));
+                objects[i][j] = atof(strtok_r(NULL, " ,\t\n", &save));
         }
         fclose(infile);
         free(line);
@@ -244,7 +266,7 @@ int file_write(char      *filename,     /* input file name */
     for (i=0; i<numClusters; i++) {
         fprintf(fptr, "%d ", i);
         for (j=0; j<numCoords; j++)
-            fprintf(fptr, "%f ", clusters[j][i]);
+            fprintf(fptr, "%f ", clusters[i][j]);
         fprintf(fptr, "\n");
     }
     fclose(fptr);
@@ -260,3 +282,187 @@ int file_write(char      *filename,     /* input file name */
 
     return 1;
 }
+
+/*---< membership_read() >----------------------------------------------------*/
+/* read a membership file written by file_write(): one "index id" per line   */
+int* membership_read(char *filename,     /* membership file name */
+                     int  *numObjs)      /* out: no. data objects */
+{
+    FILE *fptr;
+    int   i, id, len, *membership;
+
+    if ((fptr = fopen(filename, "r")) == NULL) {
+        fprintf(stderr, "Error: no such file (%s)\n", filename);
+        return NULL;
+    }
+    len        = 1024;
+    membership = (int*) malloc(len * sizeof(int));
+    assert(membership != NULL);
+
+    *numObjs = 0;
+    while (fscanf(fptr, "%d %d", &i, &id) == 2) {
+        if (i != *numObjs) {
+            fprintf(stderr, "Error: %s: line %d has index %d\n", filename,
+                    *numObjs + 1, i);
+            free(membership);
+            fclose(fptr);
+            return NULL;
+        }
+        if (*numObjs == len) {
+            len *= 2;
+            membership = (int*) realloc(membership, len * sizeof(int));
+            assert(membership != NULL);
+        }
+        membership[(*numObjs)++] = id;
+    }
+    fclose(fptr);
+    return membership;
+}
+
+/*---< index_write() >--------------------------------------------------------*/
+/* the objects of each cluster: one "id size obj1 obj2 ..." line per cluster */
+int index_write(char      *filename,     /* input file name */
+                int        numClusters,  /* no. clusters */
+                const int *offsets,      /* [numClusters+1] */
+                const int *order,        /* [numObjs] object ids by cluster */
+                int        verbose)
+{
+    FILE *fptr;
+    int   i, k;
+    char  outFileName[1024];
+
+    sprintf(outFileName, "%s.cluster_index", filename);
+    if (verbose) printf("Writing objects of K=%d clusters to file \"%s\"\n",
+                        numClusters, outFileName);
+    if ((fptr = fopen(outFileName, "w")) == NULL) return 0;
+    for (k=0; k<numClusters; k++) {
+        fprintf(fptr, "%d %d", k, offsets[k+1] - offsets[k]);
+        for (i=offsets[k]; i<offsets[k+1]; i++)
+            fprintf(fptr, " %d", order[i]);
+        fprintf(fptr, "\n");
+    }
+    fclose(fptr);
+    return 1;
+}
+
+/*---< stream_open() >--------------------------------------------------------*/
+/* open a data file for reading objects in chunks with stream_read().        */
+/* *numObjs is set from the header of a binary file and to -1 for an ASCII   */
+/* file, whose number of objects is only known once it has been read.        */
+obj_stream* stream_open(int   isBinaryFile,  /* flag: 0 or 1 */
+                        char *filename,      /* input file name */
+                        int  *numObjs,       /* out: no. objects or -1 */
+                        int  *numCoords)     /* out: no. coordinates */
+{
+    obj_stream *s;
+    ssize_t     numBytesRead;
+
+    s = (obj_stream*) calloc(1, sizeof(obj_stream));
+    assert(s != NULL);
+    s->isBinaryFile = isBinaryFile;
+
+    if (isBinaryFile) {
+        if ((s->fd = open(filename, O_RDONLY)) == -1) {
+            fprintf(stderr, "Error: no such file (%s)\n", filename);
+            free(s);
+            return NULL;
+        }
+        numBytesRead = read(s->fd, numObjs,   sizeof(int));
+        assert(numBytesRead == sizeof(int));
+        numBytesRead = read(s->fd, numCoords, sizeof(int));
+        assert(numBytesRead == sizeof(int));
+        s->numObjs   = *numObjs;
+        s->numCoords = *numCoords;
+    }
+    else {
+        long  pos;
+        char *save;
+        if ((s->fp = fopen(filename, "r")) == NULL) {
+            fprintf(stderr, "Error: no such file (%s)\n", filename);
+            free(s);
+            return NULL;
+        }
+        s->lineLen = MAX_CHAR_PER_LINE;
+        s->line    = (char*) malloc(s->lineLen);
+        assert(s->line != NULL);
+
+        /* the no. coordinates comes from the first non-empty line */
+        s->numCoords = 0;
+        pos = ftell(s->fp);
+        while (stream_getline(s) != NULL) {
+            if (strtok_r(s->line, " \t\n", &save) != 0) {
+                while (strtok_r(NULL, " ,\t\n", &save) != NULL) s->numCoords++;
+                break;
+            }
+            pos = ftell(s->fp);
+        }
+        fseek(s->fp, pos, SEEK_SET);
+        s->numObjs = -1;
+        *numObjs   = -1;
+        *numCoords = s->numCoords;
+    }
+    if (_debug) printf("File %s numCoords = %d\n",filename,s->numCoords);
+    return s;
+}
+
+/*---< stream_getline() >-----------------------------------------------------*/
+/* read one full line of an ASCII stream, growing the line buffer as needed  */
+char* stream_getline(obj_stream *s)
+{
+    int len = 0;
+
+    while (fgets(s->line + len, s->lineLen - len, s->fp) != NULL) {
+        len += strlen(s->line + len);
+        if (len < s->lineLen-1 || s->line[len-1] == '\n') return s->line;
+
+        /* this line read is not complete, increase lineLen */
+        s->lineLen += MAX_CHAR_PER_LINE;
+        s->line = (char*) realloc(s->line, s->lineLen);
+        assert(s->line != NULL);
+    }
+    return (len > 0) ? s->line : NULL;
+}
+
+/*---< stream_read() >--------------------------------------------------------*/
+/* read up to maxObjs objects into objects[maxObjs][numCoords], whose rows   */
+/* must be contiguous. Returns the no. objects read, 0 at end of file.       */
+int stream_read(obj_stream *s,
+                int         maxObjs,
+                float     **objects)  /* out: [maxObjs][numCoords] */
+{
+    int   i = 0, j;
+    char *save;
+
+    if (s->isBinaryFile) {
+        size_t  want = (size_t)maxObjs * s->numCoords * sizeof(float);
+        size_t  got  = 0;
+        ssize_t n;
+        while (got < want) {
+            n = read(s->fd, (char*)objects[0] + got, want - got);
+            if (n <= 0) break;
+            got += n;
+        }
+        return (int)(got / (s->numCoords * sizeof(float)));
+    }
+
+    while (i < maxObjs && stream_getline(s) != NULL) {
+        if (strtok_r(s->line, " \t\n", &save) == NULL) continue;
+        for (j=0; j<s->numCoords; j++) {
+            char *tok = strtok_r(NULL, " ,\t\n", &save);
+            objects[i][j] = (tok != NULL) ? atof(tok) : 0.0;
+        }
+        i++;
+    }
+    return i;
+}
+
+/*---< stream_close() >-------------------------------------------------------*/
+void stream_close(obj_stream *s)
+{
+    if (s->isBinaryFile) close(s->fd);
+    else {
+        fclose(s->fp);
+        free(s->line);
+    }
+    free(s);
+}
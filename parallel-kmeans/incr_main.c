@@ -0,0 +1,331 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         incr_main.c                                               */
+/*   Description:  re-clusters a data set after new objects were appended  */
+/*                 to it, starting from the centers and membership of the  */
+/*                 previous run (kmeans_fit_incremental). The first rows of */
+/*                 the input are the objects of the previous run, in the   */
+/*                 same order. Besides the usual output files, the distance */
+/*                 bounds of every object are written to filename.bounds,  */
+/*                 so the next increment can skip the old objects at once. */
+/*                 The old state is already close to a fixed point, so the  */
+/*                 fit runs a handful of passes (-l, default 10) instead of */
+/*                 the long tail of a fit to the threshold.                 */
+/*   Bounds file format:                                                     */
+/*                 4-byte integer no. objects N, then N floats upper bounds */
+/*                 and N floats lower bounds                                 */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>     /* getopt() */
+
+#include <omp.h>
+int      _debug;
+#include "kmeans.h"
+#include "kmeans_lib.h"
+
+/*---< usage() >------------------------------------------------------------*/
+static void usage(char *argv0, float threshold, int max_loops) {
+    char *help =
+        "Usage: %s [switches] -i filename -m centers -r membership\n"
+        "       -i filename    : file containing data to be clustered, the\n"
+        "                        objects of the previous run first\n"
+        "       -b             : input file is in binary format (default no)\n"
+        "       -m centers     : cluster centers of the previous run\n"
+        "       -M             : centers file is in binary format (default no)\n"
+        "       -r membership  : membership file of the previous run\n"
+        "       -B bounds      : bounds file of the previous run (default: none,\n"
+        "                        the old objects get one full scan)\n"
+        "       -t threshold   : threshold value (default %.4f)\n"
+        "       -l loops       : at most this no. passes after the first\n"
+        "                        (default %d, 0 = until the threshold)\n"
+        "       -p nproc       : number of threads (default system allocated)\n"
+        "       -C             : also run a cold fit from the first K objects\n"
+        "                        to the threshold and report both, with the\n"
+        "                        SSE of each at its final centers (output is\n"
+        "                        the incremental fit)\n"
+        "       -o             : output timing results (default no)\n"
+        "       -q             : quiet mode\n"
+        "       -d             : enable debug mode\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0, threshold, max_loops);
+    exit(-1);
+}
+
+/*---< bounds_read() >--------------------------------------------------------*/
+static int bounds_read(char *name, int numObjs, float *upper, float *lower) {
+    FILE *fp;
+    int   n;
+
+    if ((fp = fopen(name, "rb")) == NULL) {
+        fprintf(stderr, "Error: no such file (%s)\n", name);
+        return 0;
+    }
+    if (fread(&n, sizeof(int), 1, fp) != 1 || n != numObjs ||
+        fread(upper, sizeof(float), n, fp) != (size_t)n ||
+        fread(lower, sizeof(float), n, fp) != (size_t)n) {
+        fprintf(stderr, "Error: %s does not hold bounds of %d objects\n",
+                name, numObjs);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+    return 1;
+}
+
+/*---< bounds_write() >-------------------------------------------------------*/
+static int bounds_write(char *filename, int numObjs, float *upper,
+                        float *lower, int verbose) {
+    FILE *fp;
+    char  outFileName[1024];
+
+    sprintf(outFileName, "%s.bounds", filename);
+    if (verbose) printf("Writing distance bounds of N=%d data objects to file \"%s\"\n",
+                        numObjs, outFileName);
+    if ((fp = fopen(outFileName, "wb")) == NULL) return 0;
+    fwrite(&numObjs, sizeof(int),   1,       fp);
+    fwrite(upper,    sizeof(float), numObjs, fp);
+    fwrite(lower,    sizeof(float), numObjs, fp);
+    fclose(fp);
+    return 1;
+}
+
+/*---< sse_at() >-------------------------------------------------------------*/
+/* sum of squared distances of the objects to the centers they belong to     */
+static double sse_at(float **objects, int numCoords, int numObjs,
+                     float **clusters, const int *membership) {
+    int    i, j;
+    double sse = 0.0;
+
+    #pragma omp parallel for private(j) reduction(+:sse)
+    for (i=0; i<numObjs; i++) {
+        for (j=0; j<numCoords; j++) {
+            double d = objects[i][j] - clusters[membership[i]][j];
+            sse += d * d;
+        }
+    }
+    return sse;
+}
+
+/*---< main() >---------------------------------------------------------------*/
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+           int     i, j, nthreads, verbose, isBinaryFile, isBinaryModel;
+           int     is_output_timing, is_cold, max_loops;
+           int     numObjs, numCoords, numClusters, modelCoords;
+           int     numOld, numBounded, *oldMembership, *membership;
+           char   *filename, *model_filename, *membership_filename;
+           char   *bounds_filename;
+           float   threshold, eps;
+           float **objects, **clusters, *upper, *lower;
+           double  io_timing, timing, clustering_timing;
+           double  cold_timing = 0.0, cold_sse = 0.0, cold_calcs = 0.0;
+           int     cold_loops = 0;
+           kmeans_config cfg;
+           kmeans_ctx   *ctx, *coldCtx;
+
+    _debug              = 0;
+    verbose             = 1;
+    nthreads            = 0;
+    threshold           = 0.001;
+    max_loops           = 10;
+    isBinaryFile        = 0;
+    isBinaryModel       = 0;
+    is_output_timing    = 0;
+    is_cold             = 0;
+    filename            = NULL;
+    model_filename      = NULL;
+    membership_filename = NULL;
+    bounds_filename     = NULL;
+
+    while ( (opt=getopt(argc,argv,"i:m:r:B:t:l:p:bMCoqdh"))!= EOF) {
+        switch (opt) {
+            case 'i': filename = optarg;
+                      break;
+            case 'b': isBinaryFile = 1;
+                      break;
+            case 'm': model_filename = optarg;
+                      break;
+            case 'M': isBinaryModel = 1;
+                      break;
+            case 'r': membership_filename = optarg;
+                      break;
+            case 'B': bounds_filename = optarg;
+                      break;
+            case 't': threshold = atof(optarg);
+                      break;
+            case 'l': max_loops = atoi(optarg);
+                      break;
+            case 'p': nthreads = atoi(optarg);
+                      break;
+            case 'C': is_cold = 1;
+                      break;
+            case 'o': is_output_timing = 1;
+                      break;
+            case 'q': verbose = 0;
+                      break;
+            case 'd': _debug = 1;
+                      break;
+            case 'h':
+            default: usage(argv[0], threshold, max_loops);
+                      break;
+        }
+    }
+    if (filename == NULL || model_filename == NULL ||
+        membership_filename == NULL || max_loops < 0)
+        usage(argv[0], threshold, max_loops);
+
+    kmeans_config_init(&cfg);
+    cfg.nthreads  = nthreads;
+    cfg.threshold = threshold;
+    cfg.debug     = _debug;
+    if (nthreads > 0)
+        omp_set_num_threads(nthreads);
+
+    /* read the data and the previous run ----------------------------------*/
+    io_timing = omp_get_wtime();
+    objects = file_read(isBinaryFile, filename, &numObjs, &numCoords);
+    if (objects == NULL) exit(1);
+    clusters = file_read(isBinaryModel, model_filename, &numClusters,
+                         &modelCoords);
+    if (clusters == NULL) exit(1);
+    if (modelCoords != numCoords || numClusters <= 1) {
+        printf("Error: %s holds %d centers of %d coordinates, the data has %d\n",
+               model_filename, numClusters, modelCoords, numCoords);
+        exit(1);
+    }
+    oldMembership = membership_read(membership_filename, &numOld);
+    if (oldMembership == NULL) exit(1);
+    if (numOld > numObjs) {
+        printf("Error: %s has %d objects, more than the %d in %s\n",
+               membership_filename, numOld, numObjs, filename);
+        exit(1);
+    }
+    for (i=0; i<numOld; i++) {
+        if (oldMembership[i] < 0 || oldMembership[i] >= numClusters) {
+            printf("Error: %s: object %d is in cluster %d of %d\n",
+                   membership_filename, i, oldMembership[i], numClusters);
+            exit(1);
+        }
+    }
+
+    membership = (int*)   malloc(numObjs * sizeof(int));
+    upper      = (float*) malloc(numObjs * sizeof(float));
+    lower      = (float*) malloc(numObjs * sizeof(float));
+    assert(membership != NULL && upper != NULL && lower != NULL);
+    memcpy(membership, oldMembership, numOld * sizeof(int));
+
+    numBounded = 0;
+    if (bounds_filename != NULL) {
+        if (!bounds_read(bounds_filename, numOld, upper, lower)) exit(1);
+        /* the centers file holds 6 decimals: widen the bounds by the most
+           the rounding can move a center */
+        eps = 0.5e-6f * sqrtf((float)numCoords);
+        for (i=0; i<numOld; i++) {
+            upper[i] += eps;
+            lower[i] -= eps;
+        }
+        numBounded = numOld;
+    }
+    io_timing = omp_get_wtime() - io_timing;
+
+    /* the cold fit, for comparison, runs to the threshold ------------------*/
+    if (is_cold) {
+        int    *coldMembership = (int*)    malloc(numObjs * sizeof(int));
+        float **coldClusters   = (float**) malloc(numClusters * sizeof(float*));
+        assert(coldMembership != NULL && coldClusters != NULL);
+        coldClusters[0] = (float*) malloc(numClusters * numCoords * sizeof(float));
+        assert(coldClusters[0] != NULL);
+        for (i=0; i<numClusters; i++) {
+            if (i > 0) coldClusters[i] = coldClusters[i-1] + numCoords;
+            for (j=0; j<numCoords; j++)
+                coldClusters[i][j] = objects[i][j];
+        }
+        coldCtx = kmeans_ctx_create(&cfg);
+        assert(coldCtx != NULL);
+        timing = omp_get_wtime();
+        kmeans_fit(coldCtx, objects, numCoords, numObjs, numClusters,
+                   coldMembership, coldClusters);
+        cold_timing = omp_get_wtime() - timing;
+        cold_loops  = kmeans_ctx_stats(coldCtx)->loops;
+        cold_calcs  = kmeans_ctx_stats(coldCtx)->dist_calcs;
+        /* kmeans_stats.sse is of the last assignment, before the update */
+        cold_sse    = sse_at(objects, numCoords, numObjs, coldClusters,
+                             coldMembership);
+        kmeans_ctx_destroy(coldCtx);
+        free(coldClusters[0]);
+        free(coldClusters);
+        free(coldMembership);
+    }
+
+    /* the incremental fit, from the previous centers and membership --------*/
+    if (max_loops > 0) cfg.max_loops = max_loops;
+    ctx = kmeans_ctx_create(&cfg);
+    assert(ctx != NULL);
+    timing = omp_get_wtime();
+    if (!kmeans_fit_incremental(ctx, objects, numCoords, numObjs, numClusters,
+                                numOld, numBounded, membership, clusters,
+                                upper, lower)) {
+        printf("Error: clustering failed\n");
+        exit(1);
+    }
+    clustering_timing = omp_get_wtime() - timing;
+
+    timing = omp_get_wtime();
+    file_write(filename, numClusters, numObjs, numCoords, clusters, membership,
+               verbose);
+    bounds_write(filename, numObjs, upper, lower, verbose);
+    io_timing += omp_get_wtime() - timing;
+
+    /*---- output performance numbers ---------------------------------------*/
+    if (is_output_timing) {
+        printf("\nPerforming **** Incremental Kmeans (OpenMP) ****\n");
+        printf("Number of threads = %d\n", omp_get_max_threads());
+        printf("Input file:     %s\n", filename);
+        printf("numObjs       = %d (%d old, %d appended)\n", numObjs, numOld,
+               numObjs - numOld);
+        printf("numCoords     = %d\n", numCoords);
+        printf("numClusters   = %d\n", numClusters);
+        printf("threshold     = %.4f\n", threshold);
+        printf("max loops     = %d\n", cfg.max_loops);
+        printf("bounds        = %s\n", numBounded > 0 ? "reused" : "computed");
+        printf("I/O time           = %10.4f sec\n", io_timing);
+        printf("Computation timing = %10.4f sec\n", clustering_timing);
+        printf("nloops             = %10d\n", kmeans_ctx_stats(ctx)->loops);
+        printf("SSE                = %10g (at the final centers)\n",
+               kmeans_ctx_stats(ctx)->sse);
+        printf("distances          = %10.0f (%.1f%% of full passes)\n",
+               kmeans_ctx_stats(ctx)->dist_calcs,
+               100.0 * kmeans_ctx_stats(ctx)->dist_calcs /
+               ((kmeans_ctx_stats(ctx)->loops + 1.0) * numObjs * numClusters));
+        if (is_cold) {
+            printf("cold fit timing    = %10.4f sec\n", cold_timing);
+            printf("cold fit nloops    = %10d\n", cold_loops);
+            printf("cold fit SSE       = %10g (at the final centers, incremental %+.2f%%)\n",
+                   cold_sse, 100.0 * (kmeans_ctx_stats(ctx)->sse - cold_sse) /
+                             cold_sse);
+            printf("cold fit distances = %10.0f\n", cold_calcs);
+        }
+    }
+
+    kmeans_ctx_destroy(ctx);
+    free(lower);
+    free(upper);
+    free(membership);
+    free(oldMembership);
+    free(clusters[0]);
+    free(clusters);
+    free(objects[0]);
+    free(objects);
+    return(0);
+}
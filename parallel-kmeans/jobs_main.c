@@ -0,0 +1,320 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         jobs_main.c                                               */
+/*   Description:  runs many clustering jobs in one process. All jobs share */
+/*                 one OpenMP team: every job is a task, and every pass of  */
+/*                 a job is split into block tasks (the "tasks" engine of   */
+/*                 the library), so threads that finish a small job pick up */
+/*                 blocks of the large ones. Jobs are started largest file  */
+/*                 first.                                                    */
+/*   Job file format:                                                        */
+/*                 one job per line, with the switches of omp_new_main:     */
+/*                   -i filename -n num_clusters [-b] [-t threshold]        */
+/*                   [-c centers]                                            */
+/*                 empty lines and lines starting with '#' are ignored      */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt() */
+#include <sys/stat.h>
+
+#include <omp.h>
+int      _debug;
+#include "kmeans.h"
+#include "kmeans_lib.h"
+
+#define MAX_JOB_ARGS 64
+
+typedef struct {
+    int     line;                /* line no. in the job file */
+    char   *text;                /* tokenized copy of the line */
+    char   *filename, *center_filename;   /* into text */
+    int     isBinaryFile, numClusters;
+    float   threshold;
+    long    size;                /* input file size, for the job order */
+
+    /* results */
+    int     ok, numObjs, numCoords, loops;
+    double  sse, start, io_timing, clustering_timing;
+} job_t;
+
+/*---< usage() >------------------------------------------------------------*/
+static void usage(char *argv0) {
+    char *help =
+        "Usage: %s [switches] -j jobfile\n"
+        "       -j jobfile     : file with one job per line\n"
+        "       -p nproc       : number of threads (default system allocated)\n"
+        "       -o             : output timing results (default no)\n"
+        "       -q             : quiet mode\n"
+        "       -d             : enable debug mode\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0);
+    exit(-1);
+}
+
+/*---< parse_job() >---------------------------------------------------------*/
+/* returns 1 for a job, whose text the caller frees, 0 for a comment line, */
+/* -1 for an error                                                           */
+static int parse_job(const char *line, int lineno, job_t *job) {
+    char *argv[MAX_JOB_ARGS], *save, *tok, *text;
+    int   argc = 0, opt;
+
+    if ((text = strdup(line)) == NULL) return -1;
+    argv[argc++] = "job";
+    for (tok = strtok_r(text, " \t\n", &save); tok != NULL;
+         tok = strtok_r(NULL, " \t\n", &save)) {
+        if (argc == 1 && tok[0] == '#') break;
+        if (argc == MAX_JOB_ARGS - 1) {
+            free(text);
+            return -1;
+        }
+        argv[argc++] = tok;
+    }
+    if (argc == 1) {
+        free(text);
+        return 0;
+    }
+    argv[argc] = NULL;
+
+    memset(job, 0, sizeof(job_t));
+    job->line      = lineno;
+    job->text      = text;
+    job->threshold = 0.001;
+
+    optind = 1;
+    while ( (opt=getopt(argc,argv,"i:c:n:t:b"))!= EOF) {
+        switch (opt) {
+            case 'i': job->filename = optarg;
+                      break;
+            case 'c': job->center_filename = optarg;
+                      break;
+            case 'b': job->isBinaryFile = 1;
+                      break;
+            case 't': job->threshold = atof(optarg);
+                      break;
+            case 'n': job->numClusters = atoi(optarg);
+                      break;
+            default:  free(text);
+                      return -1;
+        }
+    }
+    if (job->filename == NULL || job->numClusters <= 1) {
+        free(text);
+        return -1;
+    }
+    if (job->center_filename == NULL) job->center_filename = job->filename;
+    return 1;
+}
+
+static int cmp_size(const void *a, const void *b) {
+    const job_t *x = (const job_t*)a, *y = (const job_t*)b;
+    return (y->size > x->size) - (y->size < x->size);
+}
+
+/*---< run_job() >-----------------------------------------------------------*/
+/* the body of omp_new_main, as one task of the shared team                  */
+static void run_job(job_t *job, int verbose) {
+    int           i, j, ok;
+    int          *membership;
+    float       **objects, **clusters;
+    double        t;
+    kmeans_config cfg;
+    kmeans_ctx   *ctx;
+
+    job->start = omp_get_wtime();
+    objects = file_read(job->isBinaryFile, job->filename, &job->numObjs,
+                        &job->numCoords);
+    if (objects == NULL) return;
+    if (job->numObjs < job->numClusters) {
+        printf("Error: job %d: number of clusters must be smaller than the number of data points\n",
+               job->line);
+        free(objects[0]);
+        free(objects);
+        return;
+    }
+
+    clusters    = (float**) malloc(job->numClusters * sizeof(float*));
+    assert(clusters != NULL);
+    clusters[0] = (float*)  malloc(job->numClusters * job->numCoords * sizeof(float));
+    assert(clusters[0] != NULL);
+    for (i=1; i<job->numClusters; i++)
+        clusters[i] = clusters[i-1] + job->numCoords;
+
+    if (job->center_filename != job->filename)
+        read_n_objects(job->isBinaryFile, job->center_filename,
+                       job->numClusters, job->numCoords, clusters);
+    else
+        for (i=0; i<job->numClusters; i++)
+            for (j=0; j<job->numCoords; j++)
+                clusters[i][j] = objects[i][j];
+
+    /* check_repeated_clusters() sorts with a file-scope column index */
+    #pragma omp critical (check_repeated)
+    ok = check_repeated_clusters(job->numClusters, job->numCoords, clusters);
+    if (ok == 0) {
+        printf("Error: job %d: some initial clusters are repeated\n", job->line);
+        free(objects[0]); free(objects);
+        free(clusters[0]); free(clusters);
+        return;
+    }
+
+    membership = (int*) malloc(job->numObjs * sizeof(int));
+    assert(membership != NULL);
+
+    kmeans_config_init(&cfg);
+    cfg.engine    = KMEANS_ENGINE_OMP_TASKS;
+    cfg.threshold = job->threshold;
+    cfg.debug     = _debug;
+    ctx = kmeans_ctx_create(&cfg);
+
+    t = omp_get_wtime();
+    job->io_timing = t - job->start;
+    job->ok = (ctx != NULL) &&
+              kmeans_fit(ctx, objects, job->numCoords, job->numObjs,
+                         job->numClusters, membership, clusters);
+    job->clustering_timing = omp_get_wtime() - t;
+    if (job->ok) {
+        job->loops = kmeans_ctx_stats(ctx)->loops;
+        job->sse   = kmeans_ctx_stats(ctx)->sse;
+    }
+    kmeans_ctx_destroy(ctx);
+    free(objects[0]);
+    free(objects);
+
+    t = omp_get_wtime();
+    if (job->ok)
+        file_write(job->filename, job->numClusters, job->numObjs,
+                   job->numCoords, clusters, membership, verbose);
+    job->io_timing += omp_get_wtime() - t;
+
+    free(membership);
+    free(clusters[0]);
+    free(clusters);
+}
+
+/*---< main() >---------------------------------------------------------------*/
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+           int     i, nthreads, verbose, is_output_timing, numJobs, capJobs;
+           int     lineno, ret;
+           char   *jobfile, line[4096];
+           double  timing, busy, work;
+           FILE   *fp;
+           job_t  *jobs;
+           struct stat sb;
+
+    _debug           = 0;
+    verbose          = 1;
+    nthreads         = 0;
+    is_output_timing = 0;
+    jobfile          = NULL;
+
+    while ( (opt=getopt(argc,argv,"j:p:odqh"))!= EOF) {
+        switch (opt) {
+            case 'j': jobfile = optarg;
+                      break;
+            case 'p': nthreads = atoi(optarg);
+                      break;
+            case 'o': is_output_timing = 1;
+                      break;
+            case 'q': verbose = 0;
+                      break;
+            case 'd': _debug = 1;
+                      break;
+            case 'h':
+            default: usage(argv[0]);
+                      break;
+        }
+    }
+    if (jobfile == NULL) usage(argv[0]);
+
+    if (nthreads > 0)
+        omp_set_num_threads(nthreads);
+
+    /* read the job file ---------------------------------------------------*/
+    if ((fp = fopen(jobfile, "r")) == NULL) {
+        fprintf(stderr, "Error: no such file (%s)\n", jobfile);
+        exit(1);
+    }
+    numJobs = capJobs = 0;
+    jobs    = NULL;
+    lineno  = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        if (numJobs == capJobs) {
+            capJobs = (capJobs == 0) ? 16 : 2 * capJobs;
+            jobs = (job_t*) realloc(jobs, capJobs * sizeof(job_t));
+            assert(jobs != NULL);
+        }
+        ret = parse_job(line, lineno, &jobs[numJobs]);
+        if (ret < 0) {
+            printf("Error: %s line %d: bad job, need -i filename -n num_clusters [-b] [-t threshold] [-c centers]\n",
+                   jobfile, lineno);
+            exit(1);
+        }
+        if (ret == 0) continue;
+        jobs[numJobs].size = (stat(jobs[numJobs].filename, &sb) == 0)
+                           ? (long)sb.st_size : 0;
+        numJobs++;
+    }
+    fclose(fp);
+
+    /* largest jobs first, the small ones fill the gaps at the end */
+    qsort(jobs, numJobs, sizeof(job_t), cmp_size);
+
+    /* one team for all jobs -----------------------------------------------*/
+    timing = omp_get_wtime();
+    #pragma omp parallel
+    #pragma omp single
+    {
+        for (i=0; i<numJobs; i++) {
+            #pragma omp task firstprivate(i)
+            run_job(&jobs[i], verbose);
+        }
+    }
+    timing = omp_get_wtime() - timing;
+
+    /*---- output performance numbers ---------------------------------------*/
+    if (is_output_timing) {
+        printf("\nPerforming **** %d Kmeans jobs (OpenMP tasks) ****\n", numJobs);
+        printf("Number of threads = %d\n", omp_get_max_threads());
+        printf("%4s %8s %5s %6s %6s %10s %10s %14s  %s\n", "line", "numObjs",
+               "nCrd", "nClust", "nloops", "I/O (s)", "comp (s)",
+               "obj-iter/sec", "input");
+        busy = work = 0.0;
+        for (i=0; i<numJobs; i++) {
+            job_t *j = &jobs[i];
+            if (!j->ok) {
+                printf("%4d %8s %5s %6d %6s %10s %10s %14s  %s\n", j->line,
+                       "-", "-", j->numClusters, "-", "-", "-", "failed",
+                       j->filename);
+                continue;
+            }
+            printf("%4d %8d %5d %6d %6d %10.4f %10.4f %14.0f  %s\n", j->line,
+                   j->numObjs, j->numCoords, j->numClusters, j->loops,
+                   j->io_timing, j->clustering_timing,
+                   (double)j->numObjs * (j->loops + 1) / j->clustering_timing,
+                   j->filename);
+            busy += j->io_timing + j->clustering_timing;
+            work += (double)j->numObjs * (j->loops + 1);
+        }
+        printf("Total time         = %10.4f sec\n", timing);
+        printf("Sum of job times   = %10.4f sec\n", busy);
+        printf("Jobs per second    = %10.2f\n", numJobs / timing);
+        printf("Throughput         = %10.0f object-iterations/sec\n",
+               work / timing);
+    }
+
+    for (i=0; i<numJobs; i++) free(jobs[i].text);
+    free(jobs);
+    return(0);
+}
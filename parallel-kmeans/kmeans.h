@@ -15,17 +15,47 @@
 #define _H_KMEANS
 
 #include <assert.h>
+#include <stdio.h>
 
 int omp_kmeans(int, float**, int, int, int, float, int*, float**);
 int seq_kmeans(float**, int, int, int, float, int*, float**);
 
 float** file_read(int, char*, int*, int*);
+void    file_set_allocator(void* (*)(size_t), void (*)(void*));
+void    file_free_objects(float**);
 int     file_write(char*, int, int, int, float**, int*, int);
+int*    membership_read(char*, int*);
+int     index_write(char*, int, const int*, const int*, int);
 
 int read_n_objects(int, char*, int, int, float**);
 
+/* chunked reader of a data file, see stream_open() in file_io.c */
+typedef struct {
+    int    isBinaryFile;
+    int    fd;            /* binary file */
+    FILE  *fp;            /* ASCII file */
+    char  *line;
+    int    lineLen;
+    int    numObjs;       /* -1 for ASCII files */
+    int    numCoords;
+} obj_stream;
+
+obj_stream* stream_open(int, char*, int*, int*);
+int         stream_read(obj_stream*, int, float**);
+char*       stream_getline(obj_stream*);
+void        stream_close(obj_stream*);
+
 int check_repeated_clusters(int, int, float**);
 
+#ifdef MPI_VERSION  /* mpi.h is included first */
+#include "kmeans_lib.h"
+
+float** mpi_read(int, char*, int*, int*, int*, MPI_Comm);
+int     mpi_write(char*, int, int, int, int, float**, int*, int, MPI_Comm);
+int     mpi_kmeans(kmeans_ctx*, float**, int, int, int, int, int, int*,
+                   float**, MPI_Comm);
+#endif
+
 double  wtime(void);
 
 extern int _debug;
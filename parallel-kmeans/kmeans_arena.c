@@ -0,0 +1,181 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_arena.c                                            */
+/*   Description:  allocator of the long-lived buffers: the scratch of the  */
+/*                 contexts (kmeans_aligned_alloc()), the reorder copy and, */
+/*                 through file_set_allocator(), the objects of the loader. */
+/*                 A buffer of at least one huge page gets its own mapping, */
+/*                 aligned to a huge page and backed by reserved huge pages */
+/*                 (MAP_HUGETLB) or by transparent ones (MADV_HUGEPAGE),    */
+/*                 so a multi-GB objects array takes 512 times fewer TLB    */
+/*                 entries; without them, or for smaller buffers, it is     */
+/*                 posix_memalign(). Every block starts after a header of   */
+/*                 one cache line that records how to release it. The       */
+/*                 counters, with the page faults of the process, are       */
+/*                 returned by kmeans_arena_stats().                        */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/mman.h>       /* mmap(), madvise() */
+#include <sys/resource.h>   /* getrusage() */
+
+#include "kmeans_internal.h"
+
+#define ARENA_HUGE   ((size_t)2 << 20)  /* huge page size (x86-64, arm64) */
+#define ARENA_HEADER KMEANS_ALIGN       /* bytes before each block */
+#define ARENA_MAGIC  0x6b617265u
+
+typedef struct {
+    unsigned  magic;
+    int       kind;        /* the kmeans_pages that backs the block */
+    size_t    size;        /* bytes asked for */
+    size_t    maplen;      /* length of the mapping, 0 = posix_memalign() */
+    void     *base;        /* start of the mapping or block */
+} arena_header;
+
+static kmeans_pages     arena_pages = KMEANS_PAGES_THP;
+static kmeans_mem_stats arena_stats;
+
+static const char *pages_names[] = { "small", "thp", "explicit" };
+#define NUM_PAGES (int)(sizeof(pages_names)/sizeof(pages_names[0]))
+
+const char* kmeans_pages_name(kmeans_pages pages)
+{
+    if ((int)pages < 0 || (int)pages >= NUM_PAGES) return "unknown";
+    return pages_names[pages];
+}
+
+int kmeans_pages_parse(const char *name, kmeans_pages *pages)
+{
+    int i;
+    for (i=0; i<NUM_PAGES; i++)
+        if (strcmp(name, pages_names[i]) == 0) {
+            *pages = (kmeans_pages) i;
+            return 1;
+        }
+    return 0;
+}
+
+/*----< kmeans_arena_set_pages() >-------------------------------------------*/
+/* backing of the buffers allocated from now on                              */
+void kmeans_arena_set_pages(kmeans_pages pages)
+{
+    arena_pages = pages;
+}
+
+/*----< map_huge() >---------------------------------------------------------*/
+/* len bytes (a multiple of ARENA_HUGE) on huge pages, or NULL               */
+static char* map_huge(size_t len, int *kind, size_t *maplen)
+{
+    char *base, *start;
+
+#ifdef MAP_HUGETLB
+    /* the reserved pool (vm.nr_hugepages) may be empty or too small */
+    if (arena_pages == KMEANS_PAGES_EXPLICIT) {
+        base = (char*) mmap(NULL, len, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED) {
+            *kind   = KMEANS_PAGES_EXPLICIT;
+            *maplen = len;
+            return base;
+        }
+    }
+#endif
+    /* one more huge page to align the start, then trim both ends */
+    base = (char*) mmap(NULL, len + ARENA_HUGE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return NULL;
+    start = (char*)(((uintptr_t)base + ARENA_HUGE - 1) & ~(uintptr_t)(ARENA_HUGE - 1));
+    if (start > base) munmap(base, start - base);
+    munmap(start + len, base + ARENA_HUGE - start);
+#ifdef MADV_HUGEPAGE
+    madvise(start, len, MADV_HUGEPAGE);  /* only a hint: THP may be off */
+#endif
+    *kind   = KMEANS_PAGES_THP;
+    *maplen = len;
+    return start;
+}
+
+/*----< kmeans_arena_alloc() >-----------------------------------------------*/
+/* size bytes aligned to KMEANS_ALIGN, or NULL                               */
+void* kmeans_arena_alloc(size_t size)
+{
+    char         *start = NULL;
+    int           kind  = KMEANS_PAGES_SMALL;
+    size_t        maplen = 0, len;
+    void         *ptr;
+    arena_header *h;
+
+    if (size == 0) size = KMEANS_ALIGN;
+    if (arena_pages != KMEANS_PAGES_SMALL && size + ARENA_HEADER >= ARENA_HUGE) {
+        len   = (size + ARENA_HEADER + ARENA_HUGE - 1) & ~(ARENA_HUGE - 1);
+        start = map_huge(len, &kind, &maplen);
+    }
+    if (start == NULL) {
+        if (posix_memalign(&ptr, KMEANS_ALIGN, size + ARENA_HEADER) != 0)
+            return NULL;
+        start  = (char*) ptr;
+        kind   = KMEANS_PAGES_SMALL;
+        maplen = 0;
+    }
+
+    h         = (arena_header*) start;
+    h->magic  = ARENA_MAGIC;
+    h->kind   = kind;
+    h->size   = size;
+    h->maplen = maplen;
+    h->base   = start;
+
+    #pragma omp critical (kmeans_arena)
+    {
+        arena_stats.regions++;
+        if (kind == KMEANS_PAGES_EXPLICIT) arena_stats.huge_explicit++;
+        if (kind == KMEANS_PAGES_THP)      arena_stats.huge_thp++;
+        arena_stats.bytes += size;
+        if (arena_stats.bytes > arena_stats.peak_bytes)
+            arena_stats.peak_bytes = arena_stats.bytes;
+    }
+    return start + ARENA_HEADER;
+}
+
+/*----< kmeans_arena_free() >------------------------------------------------*/
+/* a block of kmeans_arena_alloc(), or NULL                                  */
+void kmeans_arena_free(void *ptr)
+{
+    arena_header *h;
+
+    if (ptr == NULL) return;
+    h = (arena_header*)((char*) ptr - ARENA_HEADER);
+    assert(h->magic == ARENA_MAGIC);
+    h->magic = 0;
+
+    #pragma omp critical (kmeans_arena)
+    arena_stats.bytes -= h->size;
+
+    if (h->maplen > 0) munmap(h->base, h->maplen);
+    else               free(h->base);
+}
+
+/*----< kmeans_arena_stats() >-----------------------------------------------*/
+void kmeans_arena_stats(kmeans_mem_stats *st)
+{
+    struct rusage ru;
+
+    #pragma omp critical (kmeans_arena)
+    *st = arena_stats;
+
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        st->minor_faults = ru.ru_minflt;
+        st->major_faults = ru.ru_majflt;
+    }
+}
@@ -0,0 +1,223 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_async.c                                            */
+/*   Description:  bounded-staleness k-means (kmeans_config.async). There is */
+/*                 no barrier between the assignment and the update: every  */
+/*                 thread owns a static block of objects and publishes its  */
+/*                 center sums when its block is done; the last thread to   */
+/*                 finish pass i builds centers version i+1 from them. A    */
+/*                 thread may start pass i+1 on version i when i+1 is not   */
+/*                 out yet, but never on anything older, so the centers a   */
+/*                 pass uses are at most one update behind.                  */
+/*                 The centers and the per-thread sums are double buffered  */
+/*                 by the parity of the pass: version i+1 overwrites the    */
+/*                 buffer of version i-1, which no thread reads any more    */
+/*                 once all threads are done with pass i. Passes on old     */
+/*                 centers slow down convergence, so this only pays when    */
+/*                 threads wait long at the barrier (see README).            */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>        /* sched_yield() */
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() do { } while (0)
+#endif
+
+/*----< kmeans_fit_async() >-------------------------------------------------*/
+int kmeans_fit_async(kmeans_ctx *ctx,
+                     float     **objects,      /* in: [numObjs][numCoords] */
+                     int         numCoords,
+                     int         numObjs,
+                     int         numClusters,
+                     int        *membership,   /* out: [numObjs] */
+                     float     **clusters)     /* in/out: [numClusters][numCoords] */
+{
+    int     i, j, nthreads = ctx->nthreads;
+    size_t  padK  = KMEANS_PAD((size_t)numClusters);
+    size_t  padKD = KMEANS_PAD((size_t)numClusters * numCoords);
+    float  *centersT;       /* [2][numCoords][padK], by version parity */
+    float  *sums;           /* [nthreads][2][padKD] */
+    int    *sizes;          /* [nthreads][2][padK] */
+    double *part;           /* [nthreads][2][8]: changes, sse */
+    double *wait;           /* [nthreads][8]: seconds waiting, stale passes */
+    int     arrived[2] = {0, 0};
+    int     version = 0, stop = 0, last = 0;
+    float   delta = 0.0;
+    double  sse = 0.0, timing, est = 0.0, prev = 0.0;
+    kmeans_stop reason = KMEANS_STOP_CONVERGED;
+
+    centersT = (float*)  kmeans_aligned_alloc(2 * numCoords * padK * sizeof(float));
+    sums     = (float*)  kmeans_aligned_alloc(2 * nthreads * padKD * sizeof(float));
+    sizes    = (int*)    kmeans_aligned_alloc(2 * nthreads * padK * sizeof(int));
+    part     = (double*) kmeans_aligned_alloc(2 * nthreads * 8 * sizeof(double));
+    wait     = (double*) kmeans_aligned_alloc(nthreads * 8 * sizeof(double));
+    if (centersT == NULL || sums == NULL || sizes == NULL || part == NULL ||
+        wait == NULL) {
+        kmeans_aligned_free(centersT); kmeans_aligned_free(sums);
+        kmeans_aligned_free(sizes);    kmeans_aligned_free(part);
+        kmeans_aligned_free(wait);
+        return 0;
+    }
+    ctx->stats.num_allocs++;
+    memset(wait, 0, nthreads * 8 * sizeof(double));
+
+    for (i=0; i<numClusters; i++)
+        for (j=0; j<numCoords; j++)
+            centersT[(size_t)j*padK + i] = clusters[i][j];
+    for (i=0; i<numObjs; i++) membership[i] = -1;
+
+    timing = omp_get_wtime();
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int     tid  = omp_get_thread_num();
+        int     team = omp_get_num_threads();   /* may be < nthreads */
+        int     lo   = (int)((long long)numObjs *  tid    / team);
+        int     hi   = (int)((long long)numObjs * (tid+1) / team);
+        int     pass, v, k, n, d, t, spins = 0;
+        float  *distArray = ctx->distArray + tid * KMEANS_PAD((size_t)ctx->capClusters);
+        double  t0;
+
+        for (pass=0; ; pass++) {
+            int     par = pass & 1;
+            float  *cT, *my_sum   = sums  + ((size_t)tid*2 + par) * padKD;
+            int    *my_size       = sizes + ((size_t)tid*2 + par) * padK;
+            double *my_part       = part  + ((size_t)tid*2 + par) * 8;
+            double  changes = 0.0, dist_sum = 0.0;
+
+            /* pass needs version pass-1 or newer */
+            t0 = omp_get_wtime();
+            while (__atomic_load_n(&version, __ATOMIC_ACQUIRE) < pass - 1 &&
+                   !__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+                /* yield now and then, in case the cores are oversubscribed */
+                if ((++spins & 63) == 0) sched_yield();
+                else                     cpu_relax();
+            }
+            wait[tid*8] += omp_get_wtime() - t0;
+            if (__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) break;
+
+            v  = __atomic_load_n(&version, __ATOMIC_ACQUIRE);
+            cT = centersT + (size_t)(v & 1) * numCoords * padK;
+            if (v < pass) wait[tid*8+1] += 1.0;
+
+            memset(my_sum,  0, (size_t)numClusters * numCoords * sizeof(float));
+            memset(my_size, 0, numClusters * sizeof(int));
+            for (n=lo; n<hi; n++) {
+                float dist;
+                k = kmeans_nearest_transposed(objects[n], cT, numCoords,
+                                              numClusters, (int)padK,
+                                              distArray, &dist);
+                dist_sum += dist;
+                if (membership[n] != k) changes += 1.0;
+                membership[n] = k;
+                my_size[k]++;
+                for (d=0; d<numCoords; d++)
+                    my_sum[(size_t)k*numCoords + d] += objects[n][d];
+            }
+            my_part[0] = changes;
+            my_part[1] = dist_sum;
+
+            /* publish; the last thread of the pass builds the next version */
+            if (__atomic_add_fetch(&arrived[par], 1, __ATOMIC_ACQ_REL) != team)
+                continue;
+            arrived[par] = 0;
+
+            {
+                float *next = centersT + (size_t)((pass+1) & 1) * numCoords * padK;
+                float *cur  = centersT + (size_t)( pass    & 1) * numCoords * padK;
+                double now;
+                int    halt = 1;
+
+                for (k=0; k<numClusters; k++) {
+                    int size = 0;
+                    for (t=0; t<team; t++)
+                        size += sizes[((size_t)t*2 + par) * padK + k];
+                    for (d=0; d<numCoords; d++) {
+                        float s = 0.0;
+                        if (size > 1)
+                            for (t=0; t<team; t++)
+                                s += sums[((size_t)t*2 + par) * padKD +
+                                          (size_t)k*numCoords + d];
+                        /* a center moves with more than one object */
+                        next[(size_t)d*padK + k] = (size > 1) ? s / size
+                                                   : cur[(size_t)d*padK + k];
+                    }
+                }
+                changes = dist_sum = 0.0;
+                for (t=0; t<team; t++) {
+                    changes  += part[((size_t)t*2 + par) * 8];
+                    dist_sum += part[((size_t)t*2 + par) * 8 + 1];
+                }
+                delta = changes / numObjs;
+                sse   = dist_sum;
+                last  = pass;
+
+                /* the same stopping rules as kmeans_fit() */
+                now = omp_get_wtime();
+                est = (pass == 0) ? now - timing : 0.5 * (est + now - prev);
+                prev = now;
+                if (delta <= ctx->cfg.threshold)
+                    halt = 1;
+                else if (ctx->cfg.stop != NULL && *ctx->cfg.stop)
+                    reason = KMEANS_STOP_SIGNAL;
+                else if (ctx->cfg.time_budget > 0.0 &&
+                         now - timing + est > ctx->cfg.time_budget)
+                    reason = KMEANS_STOP_BUDGET;
+                else if (pass >= ctx->cfg.max_loops) {
+                    reason = KMEANS_STOP_MAX_LOOPS;
+                    last   = pass + 1;
+                }
+                else
+                    halt = 0;
+                /* stop is read by the other threads as they spin */
+                __atomic_store_n(&stop, halt, __ATOMIC_RELEASE);
+                __atomic_store_n(&version, pass + 1, __ATOMIC_RELEASE);
+            }
+        }
+    }
+
+    /* the centers built from the last pass */
+    for (i=0; i<numClusters; i++)
+        for (j=0; j<numCoords; j++)
+            clusters[i][j] = centersT[(size_t)((version & 1) * numCoords + j) * padK + i];
+
+    ctx->stats.loops       = last;
+    ctx->stats.delta       = delta;
+    ctx->stats.sse         = sse;
+    ctx->stats.timing      = omp_get_wtime() - timing;
+    ctx->stats.stop_reason = reason;
+    ctx->stats.dist_calcs  = (double) version * numObjs * numClusters;
+    ctx->stats.dims_per_dist = numCoords;
+    ctx->stats.wait_time   = 0.0;
+    ctx->stats.stale_passes = 0;
+    for (i=0; i<nthreads; i++) {
+        ctx->stats.wait_time    += wait[i*8];
+        ctx->stats.stale_passes += (int) wait[i*8+1];
+    }
+
+    if (ctx->cfg.debug)
+        printf("engine = async nloops = %2d (T = %7.4f) stop = %s stale = %d wait = %.4f\n",
+               last, ctx->stats.timing, kmeans_stop_name(reason),
+               ctx->stats.stale_passes, ctx->stats.wait_time);
+
+    kmeans_aligned_free(wait);
+    kmeans_aligned_free(part);
+    kmeans_aligned_free(sizes);
+    kmeans_aligned_free(sums);
+    kmeans_aligned_free(centersT);
+    return 1;
+}
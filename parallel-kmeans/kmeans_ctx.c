@@ -0,0 +1,504 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_ctx.c                                              */
+/*   Description:  clustering context of the k-means library: configuration,*/
+/*                 reusable aligned scratch buffers and the iteration loop  */
+/*                 shared by all assignment engines                          */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* sysconf() */
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+static const char *engine_names[] = {
+    "seq", "atomic", "reduction", "transposed", "tasks", "pool",
+    "sorted", "tiled", "sketch", "ivf"
+};
+#define NUM_ENGINES (int)(sizeof(engine_names)/sizeof(engine_names[0]))
+
+static const char *stop_names[] = {
+    "converged", "max loops", "monitor", "time budget", "signal", "tree"
+};
+#define NUM_STOPS (int)(sizeof(stop_names)/sizeof(stop_names[0]))
+
+
+/*----< kmeans_engine_name() >-----------------------------------------------*/
+const char* kmeans_engine_name(kmeans_engine engine)
+{
+    if ((int)engine < 0 || (int)engine >= NUM_ENGINES) return "unknown";
+    return engine_names[engine];
+}
+
+/*----< kmeans_stop_name() >-------------------------------------------------*/
+const char* kmeans_stop_name(kmeans_stop reason)
+{
+    if ((int)reason < 0 || (int)reason >= NUM_STOPS) return "unknown";
+    return stop_names[reason];
+}
+
+/*----< kmeans_engine_parse() >----------------------------------------------*/
+/* returns 1 and sets *engine if name is a known engine, 0 otherwise         */
+int kmeans_engine_parse(const char *name, kmeans_engine *engine)
+{
+    int i;
+    for (i=0; i<NUM_ENGINES; i++) {
+        if (strcmp(name, engine_names[i]) == 0) {
+            *engine = (kmeans_engine) i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*----< kmeans_config_init() >-----------------------------------------------*/
+void kmeans_config_init(kmeans_config *cfg)
+{
+    memset(cfg, 0, sizeof(kmeans_config));
+    cfg->engine    = KMEANS_ENGINE_OMP_TRANSPOSED;
+    cfg->nthreads  = 0;
+    cfg->threshold = 0.001;
+    cfg->max_loops = 500;
+    cfg->debug     = 0;
+    cfg->time_budget = 0.0;
+    cfg->stop      = NULL;
+    cfg->async     = 0;
+    cfg->tile_clusters = 0;
+    cfg->partial   = 0;
+    cfg->sketch_dims  = 0;
+    cfg->sketch_cands = 0;
+    cfg->ivf_lists    = 0;
+    cfg->ivf_nprobe   = 0;
+    cfg->freeze_after  = 0;
+    cfg->freeze_verify = 0;
+    cfg->metric        = KMEANS_METRIC_L2;
+    cfg->repair        = 0;
+}
+
+/*----< kmeans_aligned_alloc() >---------------------------------------------*/
+/* scratch lives as long as its context: large buffers go on huge pages      */
+void* kmeans_aligned_alloc(size_t size)
+{
+    return kmeans_arena_alloc(size);
+}
+
+void kmeans_aligned_free(void *ptr)
+{
+    kmeans_arena_free(ptr);
+}
+
+/*----< kmeans_ctx_create() >------------------------------------------------*/
+kmeans_ctx* kmeans_ctx_create(const kmeans_config *cfg)
+{
+    kmeans_ctx *ctx = (kmeans_ctx*) calloc(1, sizeof(kmeans_ctx));
+    if (ctx == NULL) return NULL;
+
+    if (cfg != NULL) ctx->cfg = *cfg;
+    else             kmeans_config_init(&ctx->cfg);
+    return ctx;
+}
+
+static void free_scratch(kmeans_ctx *ctx)
+{
+    kmeans_aligned_free(ctx->newClusterSize);
+    kmeans_aligned_free(ctx->newClusters);
+    kmeans_aligned_free(ctx->clustersT);
+    kmeans_aligned_free(ctx->local_newClusterSize);
+    kmeans_aligned_free(ctx->local_newClusters);
+    kmeans_aligned_free(ctx->distArray);
+    kmeans_aligned_free(ctx->local_stats);
+    kmeans_aligned_free(ctx->farDist);
+    kmeans_aligned_free(ctx->farObj);
+    kmeans_aligned_free(ctx->farCount);
+    kmeans_aligned_free(ctx->repaired);
+    ctx->newClusterSize       = NULL;
+    ctx->newClusters          = NULL;
+    ctx->clustersT            = NULL;
+    ctx->local_newClusterSize = NULL;
+    ctx->local_newClusters    = NULL;
+    ctx->distArray            = NULL;
+    ctx->local_stats          = NULL;
+    ctx->farDist              = NULL;
+    ctx->farObj               = NULL;
+    ctx->farCount             = NULL;
+    ctx->repaired             = NULL;
+    ctx->capCoords = ctx->capClusters = ctx->capThreads = 0;
+}
+
+/*----< kmeans_ctx_destroy() >-----------------------------------------------*/
+void kmeans_ctx_destroy(kmeans_ctx *ctx)
+{
+    if (ctx == NULL) return;
+    free_scratch(ctx);
+    kmeans_pool_destroy(ctx->pool);
+    kmeans_aligned_free(ctx->order);
+    kmeans_aligned_free(ctx->offsets);
+    kmeans_aligned_free(ctx->dimOrder);
+    kmeans_aligned_free(ctx->partialC);
+    kmeans_aligned_free(ctx->partialObj);
+    kmeans_aligned_free(ctx->partialCand);
+    kmeans_aligned_free(ctx->sketchP);
+    kmeans_aligned_free(ctx->sketchMean);
+    kmeans_aligned_free(ctx->sketchObjs);
+    kmeans_aligned_free(ctx->sketchC);
+    kmeans_aligned_free(ctx->ivfCoarse);
+    kmeans_aligned_free(ctx->ivfOff);
+    kmeans_aligned_free(ctx->ivfIds);
+    kmeans_aligned_free(ctx->ivfVecs);
+    kmeans_aligned_free(ctx->ivfOf);
+    kmeans_aligned_free(ctx->freezeStable);
+    kmeans_aligned_free(ctx->freezeOn);
+    kmeans_aligned_free(ctx->freezeObjs);
+    kmeans_aligned_free(ctx->freezeIdx);
+    kmeans_aligned_free(ctx->freezeMem);
+    kmeans_aligned_free(ctx->freezeSum);
+    kmeans_aligned_free(ctx->freezeSize);
+    kmeans_aligned_free(ctx->freezeOld);
+    kmeans_aligned_free(ctx->freezeShift);
+    kmeans_aligned_free(ctx->freezeGap);
+    kmeans_aligned_free(ctx->modelT);
+    kmeans_aligned_free(ctx->modelDist);
+    free(ctx);
+}
+
+/*----< kmeans_ctx_configure() >---------------------------------------------*/
+/* replace the configuration; scratch buffers are kept for the next fit      */
+int kmeans_ctx_configure(kmeans_ctx *ctx, const kmeans_config *cfg)
+{
+    if (cfg->threshold < 0 || cfg->max_loops < 0 || cfg->nthreads < 0 ||
+        cfg->time_budget < 0)
+        return 0;
+    ctx->cfg = *cfg;
+    return 1;
+}
+
+const kmeans_config* kmeans_ctx_config(const kmeans_ctx *ctx)
+{
+    return &ctx->cfg;
+}
+
+const kmeans_stats* kmeans_ctx_stats(const kmeans_ctx *ctx)
+{
+    return &ctx->stats;
+}
+
+/*----< kmeans_ctx_set_monitor() >-------------------------------------------*/
+/* fn = NULL removes the monitor                                             */
+void kmeans_ctx_set_monitor(kmeans_ctx *ctx, kmeans_monitor fn, void *arg)
+{
+    ctx->monitor     = fn;
+    ctx->monitor_arg = arg;
+}
+
+/*----< kmeans_ctx_reserve() >-----------------------------------------------*/
+/* make sure the scratch buffers fit numClusters x numCoords for the number  */
+/* of threads of the current fit. Buffers only grow, so repeated fits on     */
+/* same-shaped data do not allocate.                                         */
+int kmeans_ctx_reserve(kmeans_ctx *ctx,
+                       int         numCoords,
+                       int         numClusters)
+{
+    int    nthreads = ctx->nthreads;
+    size_t padK, padKD;
+
+    if (numCoords   <= ctx->capCoords   &&
+        numClusters <= ctx->capClusters &&
+        nthreads    <= ctx->capThreads)
+        return 1;
+
+    /* grow every dimension to the max seen so far */
+    if (numCoords   < ctx->capCoords)   numCoords   = ctx->capCoords;
+    if (numClusters < ctx->capClusters) numClusters = ctx->capClusters;
+    if (nthreads    < ctx->capThreads)  nthreads    = ctx->capThreads;
+    free_scratch(ctx);
+
+    padK  = KMEANS_PAD((size_t)numClusters);
+    padKD = KMEANS_PAD((size_t)numClusters * numCoords);
+
+    ctx->newClusterSize       = (int*)   kmeans_aligned_alloc(padK  * sizeof(int));
+    ctx->newClusters          = (float*) kmeans_aligned_alloc(padKD * sizeof(float));
+    ctx->clustersT            = (float*) kmeans_aligned_alloc(padKD * sizeof(float));
+    ctx->local_newClusterSize = (int*)   kmeans_aligned_alloc(nthreads * padK  * sizeof(int));
+    ctx->local_newClusters    = (float*) kmeans_aligned_alloc(nthreads * padKD * sizeof(float));
+    ctx->distArray            = (float*) kmeans_aligned_alloc(nthreads * padK  * sizeof(float));
+    ctx->local_stats          = (double*)kmeans_aligned_alloc(nthreads * 8     * sizeof(double));
+    ctx->farDist              = (float*) kmeans_aligned_alloc(nthreads * KMEANS_FAR * sizeof(float));
+    ctx->farObj               = (int*)   kmeans_aligned_alloc(nthreads * KMEANS_FAR * sizeof(int));
+    ctx->farCount             = (int*)   kmeans_aligned_alloc(nthreads * 16    * sizeof(int));
+    ctx->repaired             = (char*)  kmeans_aligned_alloc(padK);
+    ctx->stats.num_allocs++;
+
+    if (ctx->newClusterSize == NULL || ctx->newClusters == NULL ||
+        ctx->clustersT == NULL || ctx->local_newClusterSize == NULL ||
+        ctx->local_newClusters == NULL || ctx->distArray == NULL ||
+        ctx->local_stats == NULL || ctx->farDist == NULL ||
+        ctx->farObj == NULL || ctx->farCount == NULL || ctx->repaired == NULL) {
+        free_scratch(ctx);
+        return 0;
+    }
+
+    memset(ctx->newClusterSize,       0, padK  * sizeof(int));
+    memset(ctx->newClusters,          0, padKD * sizeof(float));
+    memset(ctx->local_newClusterSize, 0, nthreads * padK  * sizeof(int));
+    memset(ctx->local_newClusters,    0, nthreads * padKD * sizeof(float));
+    memset(ctx->farCount,             0, nthreads * 16    * sizeof(int));
+
+    ctx->capCoords   = numCoords;
+    ctx->capClusters = numClusters;
+    ctx->capThreads  = nthreads;
+    return 1;
+}
+
+/*----< kmeans_update_centers() >--------------------------------------------*/
+/* average the sums and replace old cluster centers with newClusters; as in */
+/* the original omp_new_kmeans.c, a center moves only when its cluster has   */
+/* more than one object, but with cfg.repair any non-empty cluster moves     */
+void kmeans_update_centers(kmeans_ctx *ctx,
+                           int         numCoords,
+                           int         numClusters,
+                           float     **clusters)  /* [numClusters][numCoords] */
+{
+    int    i, j;
+    int   *newClusterSize = ctx->newClusterSize;
+    float *newClusters    = ctx->newClusters;
+    int    minSize        = ctx->cfg.repair ? 1 : 2;
+
+    for (i=0; i<numClusters; i++) {
+        float *sum = newClusters + (size_t)i * numCoords;
+        if (newClusterSize[i] >= minSize) {
+            float inv = 1.0f / newClusterSize[i];
+            for (j=0; j<numCoords; j++)
+                clusters[i][j] = sum[j] * inv;
+        }
+        for (j=0; j<numCoords; j++)
+            sum[j] = 0.0;           /* set back to 0 */
+        newClusterSize[i] = 0;      /* set back to 0 */
+    }
+}
+
+/*----< kmeans_fit_prepare() >----------------------------------------------*/
+/* pick the no. threads of the coming passes and size the scratch for them   */
+int kmeans_fit_prepare(kmeans_ctx *ctx,
+                       int         numCoords,
+                       int         numClusters)
+{
+    ctx->nthreads = (ctx->cfg.nthreads > 0) ? ctx->cfg.nthreads
+                                            : omp_get_max_threads();
+    if (ctx->cfg.engine == KMEANS_ENGINE_SEQ) ctx->nthreads = 1;
+    /* tasks spawned from inside a parallel region run on its team */
+    if (ctx->cfg.engine == KMEANS_ENGINE_OMP_TASKS && omp_in_parallel())
+        ctx->nthreads = omp_get_num_threads();
+    /* the pool does not ask the OpenMP runtime */
+    if (ctx->cfg.engine == KMEANS_ENGINE_POOL && ctx->cfg.nthreads <= 0)
+        ctx->nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    ctx->indexClusters = 0;     /* the index is of the previous fit */
+    ctx->partialReady  = 0;     /* and so is the coordinate order */
+    ctx->partialDims   = 0.0;
+    ctx->sketchKey     = NULL;  /* the objects may have changed */
+    ctx->sketchFallbacks = 0.0;
+    ctx->ivfLists      = 0;     /* the coarse index is of the old centers */
+    ctx->ivfChecked    = 0.0;
+    ctx->ivfMismatch   = 0.0;
+    ctx->freezePasses  = 0;
+    ctx->freezeSkipped = 0.0;
+    ctx->freezeStale   = 0.0;
+    return kmeans_ctx_reserve(ctx, numCoords, numClusters);
+}
+
+/*----< kmeans_pass() >------------------------------------------------------*/
+/* one assignment pass with the engine of the configuration; returns the     */
+/* no. changed memberships, or -1 for an unknown engine                      */
+float kmeans_pass(kmeans_ctx *ctx,
+                  float     **objects,
+                  int         numCoords,
+                  int         numObjs,
+                  int         numClusters,
+                  int        *membership,
+                  float     **clusters,
+                  double     *sse)
+{
+    if (ctx->cfg.metric != KMEANS_METRIC_L2)
+        return kmeans_pass_metric(ctx, objects, numCoords, numObjs,
+                                  numClusters, membership, clusters, sse);
+
+    if (ctx->cfg.partial) {
+        if (!kmeans_partial_engine(ctx->cfg.engine)) {
+            if (ctx->cfg.engine != KMEANS_ENGINE_SKETCH &&
+                ctx->cfg.engine != KMEANS_ENGINE_IVF)  /* these count their own */
+                ctx->partialDims += (double)numObjs * numClusters * numCoords;
+        }
+        else if (!kmeans_partial_setup(ctx, objects, numCoords, numObjs,
+                                       numClusters, clusters))
+            return -1;
+    }
+
+    switch (ctx->cfg.engine) {
+        case KMEANS_ENGINE_SEQ:
+            return kmeans_pass_seq(ctx, objects, numCoords, numObjs,
+                                   numClusters, membership, clusters, sse);
+        case KMEANS_ENGINE_OMP_ATOMIC:
+            return kmeans_pass_atomic(ctx, objects, numCoords, numObjs,
+                                      numClusters, membership, clusters, sse);
+        case KMEANS_ENGINE_OMP_REDUCTION:
+            return kmeans_pass_reduction(ctx, objects, numCoords, numObjs,
+                                         numClusters, membership, clusters,
+                                         sse);
+        case KMEANS_ENGINE_OMP_TRANSPOSED:
+            return kmeans_pass_transposed(ctx, objects, numCoords, numObjs,
+                                          numClusters, membership, clusters,
+                                          sse);
+        case KMEANS_ENGINE_OMP_TASKS:
+            return kmeans_pass_tasks(ctx, objects, numCoords, numObjs,
+                                     numClusters, membership, clusters, sse);
+        case KMEANS_ENGINE_POOL:
+            return kmeans_pass_pool(ctx, objects, numCoords, numObjs,
+                                    numClusters, membership, clusters, sse);
+        case KMEANS_ENGINE_SORTED:
+            return kmeans_pass_sorted(ctx, objects, numCoords, numObjs,
+                                      numClusters, membership, clusters, sse);
+        case KMEANS_ENGINE_TILED:
+            return kmeans_pass_tiled(ctx, objects, numCoords, numObjs,
+                                     numClusters, membership, clusters, sse);
+        case KMEANS_ENGINE_SKETCH:
+            return kmeans_pass_sketch(ctx, objects, numCoords, numObjs,
+                                      numClusters, membership, clusters, sse);
+        case KMEANS_ENGINE_IVF:
+            return kmeans_pass_ivf(ctx, objects, numCoords, numObjs,
+                                   numClusters, membership, clusters, sse);
+        default:
+            return -1;
+    }
+}
+
+/*----< kmeans_fit() >-------------------------------------------------------*/
+int kmeans_fit(kmeans_ctx *ctx,
+               float     **objects,      /* in: [numObjs][numCoords] */
+               int         numCoords,    /* no. coordinates */
+               int         numObjs,      /* no. objects */
+               int         numClusters,  /* no. clusters */
+               int        *membership,   /* out: [numObjs] */
+               float     **clusters)     /* in/out: [numClusters][numCoords] */
+{
+    int    i, r, loop=0, repairs=0;
+    float  delta;
+    double sse, timing, now, pass_start, pass_time, est = 0.0;
+    kmeans_stop reason = KMEANS_STOP_CONVERGED;
+
+    if (ctx == NULL || objects == NULL || clusters == NULL ||
+        membership == NULL || numObjs <= 0 || numCoords <= 0 ||
+        numClusters <= 0)
+        return 0;
+
+    if (ctx->cfg.metric != KMEANS_METRIC_L2 &&
+        (ctx->cfg.async || ctx->cfg.freeze_after > 0))
+        return 0;
+
+    if (!kmeans_fit_prepare(ctx, numCoords, numClusters)) return 0;
+    ctx->stats.repairs = 0;
+    if (ctx->cfg.async)
+        return kmeans_fit_async(ctx, objects, numCoords, numObjs, numClusters,
+                                membership, clusters);
+
+    /* initialize membership[] */
+    for (i=0; i<numObjs; i++) membership[i] = -1;
+    if (ctx->cfg.repair) memset(ctx->repaired, 0, numClusters);
+
+    timing = omp_get_wtime();
+    do {
+        sse = 0.0;
+        pass_start = omp_get_wtime();
+        kmeans_far_reset(ctx);
+        delta = (ctx->cfg.freeze_after > 0)
+              ? kmeans_pass_freeze(ctx, objects, numCoords, numObjs,
+                                   numClusters, membership, clusters, &sse)
+              : kmeans_pass(ctx, objects, numCoords, numObjs, numClusters,
+                            membership, clusters, &sse);
+        if (delta < 0) return 0;
+
+        /* reseed empty clusters from the farthest objects of the pass */
+        if (ctx->cfg.repair) {
+            r = kmeans_repair(ctx, objects, numCoords, numClusters,
+                              membership);
+            delta   += r;
+            repairs += r;
+        }
+
+        kmeans_update_centers(ctx, numCoords, numClusters, clusters);
+        if (ctx->cfg.metric != KMEANS_METRIC_L2 &&
+            !kmeans_metric_update(ctx, objects, numCoords, numObjs,
+                                  numClusters, membership, clusters))
+            return 0;
+
+        delta /= numObjs;
+
+        if (ctx->monitor != NULL &&
+            ctx->monitor(ctx->monitor_arg, loop, sse, delta, clusters)) {
+            reason = KMEANS_STOP_MONITOR;
+            break;
+        }
+        if (delta <= ctx->cfg.threshold) break;
+
+        if (ctx->cfg.stop != NULL && *ctx->cfg.stop) {
+            reason = KMEANS_STOP_SIGNAL;
+            break;
+        }
+
+        /* the cost of a pass changes little from one to the next: expect
+           the next one to take as long as the slower of the last pass and
+           the running average */
+        if (ctx->cfg.time_budget > 0.0) {
+            now       = omp_get_wtime();
+            pass_time = now - pass_start;
+            est       = (loop == 0) ? pass_time : 0.5 * (est + pass_time);
+            if (now - timing + (pass_time > est ? pass_time : est) >
+                ctx->cfg.time_budget) {
+                reason = KMEANS_STOP_BUDGET;
+                break;
+            }
+        }
+    } while (loop++ < ctx->cfg.max_loops);
+    if (loop > ctx->cfg.max_loops) reason = KMEANS_STOP_MAX_LOOPS;
+
+    ctx->stats.loops       = loop;
+    ctx->stats.delta       = delta;
+    ctx->stats.sse         = sse;
+    ctx->stats.timing      = omp_get_wtime() - timing;
+    ctx->stats.stop_reason = reason;
+    ctx->stats.dist_calcs  = (double)(loop + (reason == KMEANS_STOP_MAX_LOOPS ? 0 : 1))
+                           * numObjs * numClusters
+                           - ctx->freezeSkipped * numClusters;
+    ctx->stats.dims_per_dist = (ctx->cfg.partial ||
+                                ctx->cfg.engine == KMEANS_ENGINE_SKETCH ||
+                                ctx->cfg.engine == KMEANS_ENGINE_IVF)
+                             ? ctx->partialDims / ctx->stats.dist_calcs
+                             : numCoords;
+    ctx->stats.fallback_rate = ctx->sketchFallbacks * numClusters /
+                               ctx->stats.dist_calcs;
+    ctx->stats.mismatch_rate = (ctx->ivfChecked > 0)
+                             ? ctx->ivfMismatch / ctx->ivfChecked : 0.0;
+    ctx->stats.frozen_rate = ctx->freezeSkipped / ((double)(loop + 1) * numObjs);
+    ctx->stats.stale_rate  = ctx->freezeStale / numObjs;
+    ctx->stats.repairs     = repairs;
+    ctx->stats.tree_dist_calcs = 0.0;
+
+    if (ctx->cfg.debug)
+        printf("engine = %s nloops = %2d (T = %7.4f) stop = %s\n",
+               kmeans_engine_name(ctx->cfg.engine), loop, ctx->stats.timing,
+               kmeans_stop_name(reason));
+    if (ctx->cfg.debug && ctx->cfg.engine == KMEANS_ENGINE_POOL &&
+        ctx->pool != NULL)
+        printf("pool: %d workers, %ld steals\n", kmeans_pool_size(ctx->pool),
+               kmeans_pool_steals(ctx->pool));
+
+    return 1;
+}
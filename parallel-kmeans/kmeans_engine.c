@@ -0,0 +1,375 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_engine.c                                           */
+/*   Description:  assignment passes of the k-means library that work on    */
+/*                 centers stored as [numClusters][numCoords]: the kernels  */
+/*                 of seq_kmeans.c and omp_kmeans.c, running on the scratch */
+/*                 buffers owned by a kmeans_ctx                             */
+/*                                                                           */
+/*   Author:  Wei-keng Liao                                                  */
+/*            ECE Department, Northwestern University                        */
+/*            email: wkliao@ece.northwestern.edu                             */
+/*                                                                           */
+/*   Modified by: Tyson O'Leary, Blake Davis, Chris LaBerge                  */
+/*                Computer Science Department, Colorado State University     */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+
+/*----< euclid_dist_2() >----------------------------------------------------*/
+/* square of Euclid distance between two multi-dimensional points            */
+__inline static
+float euclid_dist_2(int    numdims,  /* no. dimensions */
+                    float *coord1,   /* [numdims] */
+                    float *coord2)   /* [numdims] */
+{
+    int i;
+    float ans=0.0;
+
+    for (i=0; i<numdims; i++)
+        ans += (coord1[i]-coord2[i]) * (coord1[i]-coord2[i]);
+
+    return(ans);
+}
+
+/*----< find_nearest_cluster() >---------------------------------------------*/
+__inline static
+int find_nearest_cluster(int     numClusters, /* no. clusters */
+                         int     numCoords,   /* no. coordinates */
+                         float  *object,      /* [numCoords] */
+                         float **clusters,    /* [numClusters][numCoords] */
+                         float  *min_dist_out)
+{
+    int   index, i;
+    float dist, min_dist;
+
+    /* find the cluster id that has min distance to object */
+    index    = 0;
+    min_dist = euclid_dist_2(numCoords, object, clusters[0]);
+
+    for (i=1; i<numClusters; i++) {
+        dist = euclid_dist_2(numCoords, object, clusters[i]);
+        /* no need square root */
+        if (dist < min_dist) { /* find the min and its array index */
+            min_dist = dist;
+            index    = i;
+        }
+    }
+    *min_dist_out = min_dist;
+    return(index);
+}
+
+/*----< nearest() >----------------------------------------------------------*/
+/* find_nearest_cluster(), or with cfg.partial its early-abandon version     */
+/* started from prev, the center of the object in the last pass             */
+__inline static
+int nearest(const kmeans_ctx *ctx,
+            int               tid,
+            int               numClusters,
+            int               numCoords,
+            float            *object,      /* [numCoords] */
+            float           **clusters,    /* [numClusters][numCoords] */
+            int               prev,
+            float            *min_dist_out,
+            double           *dims)        /* in/out: coordinates summed */
+{
+    if (!ctx->cfg.partial)
+        return find_nearest_cluster(numClusters, numCoords, object, clusters,
+                                    min_dist_out);
+    return kmeans_nearest_partial(kmeans_partial_object(ctx, tid, object, numCoords),
+                                  ctx->partialC, numCoords, numClusters,
+                                  (int)KMEANS_PAD((size_t)numCoords),
+                                  (prev >= 0 && prev < numClusters) ? prev : 0,
+                                  min_dist_out, dims);
+}
+
+/*----< kmeans_pass_seq() >--------------------------------------------------*/
+float kmeans_pass_seq(kmeans_ctx *ctx,
+                      float     **objects,     /* in: [numObjs][numCoords] */
+                      int         numCoords,
+                      int         numObjs,
+                      int         numClusters,
+                      int        *membership,  /* in/out: [numObjs] */
+                      float     **clusters,    /* [numClusters][numCoords] */
+                      double     *sse)         /* out: sum of min distances */
+{
+    int    i, j, index;
+    float  delta = 0.0, dist;
+    double sum = 0.0, dims = 0.0;
+    int   *newClusterSize = ctx->newClusterSize;
+    float *newClusters    = ctx->newClusters;
+
+    for (i=0; i<numObjs; i++) {
+        /* find the array index of nestest cluster center */
+        index = nearest(ctx, 0, numClusters, numCoords, objects[i], clusters,
+                        membership[i], &dist, &dims);
+        sum += dist;
+        kmeans_far_offer(ctx, 0, i, dist);
+
+        /* if membership changes, increase delta by 1 */
+        if (membership[i] != index) delta += 1.0;
+
+        /* assign the membership to object i */
+        membership[i] = index;
+
+        /* update new cluster center : sum of objects located within */
+        newClusterSize[index]++;
+        for (j=0; j<numCoords; j++)
+            newClusters[(size_t)index*numCoords + j] += objects[i][j];
+    }
+    ctx->partialDims += dims;
+    *sse = sum;
+    return delta;
+}
+
+/*----< kmeans_pass_atomic() >-----------------------------------------------*/
+float kmeans_pass_atomic(kmeans_ctx *ctx,
+                         float     **objects,
+                         int         numCoords,
+                         int         numObjs,
+                         int         numClusters,
+                         int        *membership,
+                         float     **clusters,
+                         double     *sse)
+{
+    int    i, j, index;
+    float  delta = 0.0, dist;
+    double sum = 0.0, dims = 0.0;
+    int   *newClusterSize = ctx->newClusterSize;
+    float *newClusters    = ctx->newClusters;
+
+    #pragma omp parallel for num_threads(ctx->nthreads) \
+            private(i,j,index,dist) \
+            firstprivate(numObjs,numClusters,numCoords) \
+            shared(objects,clusters,membership,newClusters,newClusterSize) \
+            schedule(static) \
+            reduction(+:delta,sum,dims)
+    for (i=0; i<numObjs; i++) {
+        /* find the array index of nestest cluster center */
+        index = nearest(ctx, omp_get_thread_num(), numClusters, numCoords,
+                        objects[i], clusters, membership[i], &dist, &dims);
+        sum += dist;
+        kmeans_far_offer(ctx, omp_get_thread_num(), i, dist);
+
+        /* if membership changes, increase delta by 1 */
+        if (membership[i] != index) delta += 1.0;
+
+        /* assign the membership to object i */
+        membership[i] = index;
+
+        /* update new cluster centers : sum of objects located within */
+        #pragma omp atomic
+        newClusterSize[index]++;
+        for (j=0; j<numCoords; j++)
+            #pragma omp atomic
+            newClusters[(size_t)index*numCoords + j] += objects[i][j];
+    }
+    ctx->partialDims += dims;
+    *sse = sum;
+    return delta;
+}
+
+/*----< kmeans_pass_reduction() >--------------------------------------------*/
+/* each thread calculates new centers using a private space of the context,  */
+/* then the threads do an array reduction on them                            */
+float kmeans_pass_reduction(kmeans_ctx *ctx,
+                            float     **objects,
+                            int         numCoords,
+                            int         numObjs,
+                            int         numClusters,
+                            int        *membership,
+                            float     **clusters,
+                            double     *sse)
+{
+    int    nthreads = ctx->nthreads;
+    size_t padK     = KMEANS_PAD((size_t)ctx->capClusters);
+    size_t padKD    = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);
+    float  delta = 0.0;
+    double sum   = 0.0, dims = 0.0;
+
+    #pragma omp parallel num_threads(nthreads) \
+            shared(objects,clusters,membership)
+    {
+        int    i, j, k, index;
+        float  dist;
+        int    tid = omp_get_thread_num();
+        int   *local_size = ctx->local_newClusterSize + tid * padK;
+        float *local_sum  = ctx->local_newClusters    + tid * padKD;
+
+        #pragma omp for schedule(static) reduction(+:delta,sum,dims)
+        for (i=0; i<numObjs; i++) {
+            /* find the array index of nestest cluster center */
+            index = nearest(ctx, tid, numClusters, numCoords, objects[i],
+                            clusters, membership[i], &dist, &dims);
+            sum += dist;
+            kmeans_far_offer(ctx, tid, i, dist);
+
+            /* if membership changes, increase delta by 1 */
+            if (membership[i] != index) delta += 1.0;
+
+            /* assign the membership to object i */
+            membership[i] = index;
+
+            /* update new cluster centers : sum of all objects located
+               within (average will be performed later) */
+            local_size[index]++;
+            for (j=0; j<numCoords; j++)
+                local_sum[(size_t)index*numCoords + j] += objects[i][j];
+        }
+
+        /* array reduction, split by cluster so the threads do not overlap */
+        #pragma omp for schedule(static)
+        for (i=0; i<numClusters; i++) {
+            for (j=0; j<nthreads; j++) {
+                int   *size_j = ctx->local_newClusterSize + j * padK;
+                float *sum_j  = ctx->local_newClusters    + j * padKD
+                                + (size_t)i * numCoords;
+                ctx->newClusterSize[i] += size_j[i];
+                size_j[i] = 0;
+                for (k=0; k<numCoords; k++) {
+                    ctx->newClusters[(size_t)i*numCoords + k] += sum_j[k];
+                    sum_j[k] = 0.0;
+                }
+            }
+        }
+    } /* end of #pragma omp parallel */
+
+    ctx->partialDims += dims;
+    *sse = sum;
+    return delta;
+}
+
+/*----< kmeans_reduce_local() >---------------------------------------------*/
+/* add the per-thread sums of local_newClusters/local_newClusterSize into    */
+/* newClusters/newClusterSize and zero them; to be called by all threads of  */
+/* the parallel region, split by cluster so the threads do not overlap       */
+void kmeans_reduce_local(kmeans_ctx *ctx,
+                         int         numCoords,
+                         int         numClusters)
+{
+    int    i, j, k;
+    size_t padK  = KMEANS_PAD((size_t)ctx->capClusters);
+    size_t padKD = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);
+
+    #pragma omp for schedule(static)
+    for (i=0; i<numClusters; i++) {
+        for (j=0; j<ctx->nthreads; j++) {
+            int   *size_j = ctx->local_newClusterSize + j * padK;
+            float *sum_j  = ctx->local_newClusters    + j * padKD
+                            + (size_t)i * numCoords;
+            ctx->newClusterSize[i] += size_j[i];
+            size_j[i] = 0;
+            for (k=0; k<numCoords; k++) {
+                ctx->newClusters[(size_t)i*numCoords + k] += sum_j[k];
+                sum_j[k] = 0.0;
+            }
+        }
+    }
+}
+
+/*----< tasks_pass_body() >--------------------------------------------------*/
+/* the objects are cut into blocks, each block is one task. A block uses the */
+/* private sums of the thread running it: a tied task has no scheduling      */
+/* point inside the block, so two blocks never share a thread's sums at the  */
+/* same time.                                                                */
+static void tasks_pass_body(kmeans_ctx *ctx,
+                            float     **objects,
+                            int         numCoords,
+                            int         numObjs,
+                            int         numClusters,
+                            int        *membership,
+                            float     **clusters)
+{
+    int    b, i, j, k, nblocks, blockSize;
+    int    nthreads = ctx->nthreads;
+    size_t padK     = KMEANS_PAD((size_t)ctx->capClusters);
+    size_t padKD    = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);
+
+    /* about 4 blocks per thread, but not smaller than 1024 objects */
+    blockSize = numObjs / (4 * nthreads);
+    if (blockSize < 1024) blockSize = 1024;
+    nblocks   = (numObjs + blockSize - 1) / blockSize;
+
+    #pragma omp taskloop grainsize(1) default(shared) private(i,j)
+    for (b=0; b<nblocks; b++) {
+        int     index, tid = omp_get_thread_num();
+        int     end        = (b+1)*blockSize < numObjs ? (b+1)*blockSize : numObjs;
+        int    *local_size = ctx->local_newClusterSize + tid * padK;
+        float  *local_sum  = ctx->local_newClusters    + tid * padKD;
+        double *local_st   = ctx->local_stats          + tid * 8;
+        float   dist;
+
+        for (i=b*blockSize; i<end; i++) {
+            index = nearest(ctx, tid, numClusters, numCoords, objects[i],
+                            clusters, membership[i], &dist, &local_st[2]);
+            local_st[1] += dist;
+            kmeans_far_offer(ctx, tid, i, dist);
+            if (membership[i] != index) local_st[0] += 1.0;
+            membership[i] = index;
+
+            local_size[index]++;
+            for (j=0; j<numCoords; j++)
+                local_sum[(size_t)index*numCoords + j] += objects[i][j];
+        }
+    }
+    /* the taskloop has waited for all blocks */
+
+    for (j=0; j<nthreads; j++) {
+        int   *size_j = ctx->local_newClusterSize + j * padK;
+        float *sum_j  = ctx->local_newClusters    + j * padKD;
+        for (i=0; i<numClusters; i++) {
+            if (size_j[i] == 0) continue;
+            ctx->newClusterSize[i] += size_j[i];
+            size_j[i] = 0;
+            for (k=0; k<numCoords; k++) {
+                ctx->newClusters[(size_t)i*numCoords + k] += sum_j[(size_t)i*numCoords + k];
+                sum_j[(size_t)i*numCoords + k] = 0.0;
+            }
+        }
+    }
+}
+
+/*----< kmeans_pass_tasks() >------------------------------------------------*/
+float kmeans_pass_tasks(kmeans_ctx *ctx,
+                        float     **objects,
+                        int         numCoords,
+                        int         numObjs,
+                        int         numClusters,
+                        int        *membership,
+                        float     **clusters,
+                        double     *sse)
+{
+    int    j;
+    float  delta = 0.0;
+    double sum   = 0.0;
+
+    for (j=0; j<ctx->nthreads; j++)
+        ctx->local_stats[j*8] = ctx->local_stats[j*8+1] =
+        ctx->local_stats[j*8+2] = 0.0;
+
+    if (omp_in_parallel())
+        tasks_pass_body(ctx, objects, numCoords, numObjs, numClusters,
+                        membership, clusters);
+    else {
+        #pragma omp parallel num_threads(ctx->nthreads)
+        #pragma omp single
+        tasks_pass_body(ctx, objects, numCoords, numObjs, numClusters,
+                        membership, clusters);
+    }
+
+    for (j=0; j<ctx->nthreads; j++) {
+        delta += ctx->local_stats[j*8];
+        sum   += ctx->local_stats[j*8+1];
+        ctx->partialDims += ctx->local_stats[j*8+2];
+    }
+    *sse = sum;
+    return delta;
+}
@@ -0,0 +1,277 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_freeze.c                                           */
+/*   Description:  freezing of stable objects (cfg.freeze_after), an        */
+/*                 approximation of kmeans_fit(). After the first passes    */
+/*                 most objects keep their cluster, yet every pass looks at */
+/*                 all of them again. Every freeze_verify passes, a full    */
+/*                 pass here assigns all objects exactly, keeping for each  */
+/*                 the gap between its nearest and second nearest center.   */
+/*                 An object unchanged for freeze_after passes is frozen if */
+/*                 its gap outlasts one more move like the last of its      */
+/*                 center and of the farthest moving one. After each update */
+/*                 the gap of a frozen object shrinks by what its center    */
+/*                 and the farthest moving center actually moved; while it  */
+/*                 stays positive no other center can have come nearer, so  */
+/*                 a frozen object is never in the wrong cluster and the    */
+/*                 fit takes the passes of an unfrozen one. An object whose */
+/*                 gap is used up is handed back to the engine. The passes  */
+/*                 in between run the configured engine on the objects not  */
+/*                 frozen and add the frozen ones to their clusters from    */
+/*                 sums kept aside.                                         */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+#define FREEZE_VERIFY 5     /* passes between full passes by default */
+
+/*----< euclid_dist_2() >----------------------------------------------------*/
+static inline
+float euclid_dist_2(int numdims, const float *coord1, const float *coord2)
+{
+    int i;
+    float ans=0.0;
+
+    for (i=0; i<numdims; i++)
+        ans += (coord1[i]-coord2[i]) * (coord1[i]-coord2[i]);
+
+    return(ans);
+}
+
+/*----< reserve_freeze() >---------------------------------------------------*/
+static int reserve_freeze(kmeans_ctx *ctx, int numObjs)
+{
+    size_t KD = (size_t)ctx->capClusters * ctx->capCoords;
+
+    if (numObjs <= ctx->capFreezeObjs && KD <= ctx->capFreezeKD)
+        return 1;
+
+    if (numObjs < ctx->capFreezeObjs) numObjs = ctx->capFreezeObjs;
+    if (KD      < ctx->capFreezeKD)   KD      = ctx->capFreezeKD;
+
+    kmeans_aligned_free(ctx->freezeStable);
+    kmeans_aligned_free(ctx->freezeOn);
+    kmeans_aligned_free(ctx->freezeObjs);
+    kmeans_aligned_free(ctx->freezeIdx);
+    kmeans_aligned_free(ctx->freezeMem);
+    kmeans_aligned_free(ctx->freezeSum);
+    kmeans_aligned_free(ctx->freezeSize);
+    kmeans_aligned_free(ctx->freezeOld);
+    kmeans_aligned_free(ctx->freezeShift);
+    kmeans_aligned_free(ctx->freezeGap);
+    ctx->freezeStable = (int*)    kmeans_aligned_alloc((size_t)numObjs * sizeof(int));
+    ctx->freezeOn     = (char*)   kmeans_aligned_alloc((size_t)numObjs);
+    ctx->freezeObjs   = (float**) kmeans_aligned_alloc((size_t)numObjs * sizeof(float*));
+    ctx->freezeIdx    = (int*)    kmeans_aligned_alloc((size_t)numObjs * sizeof(int));
+    ctx->freezeMem    = (int*)    kmeans_aligned_alloc((size_t)numObjs * sizeof(int));
+    ctx->freezeSum    = (float*)  kmeans_aligned_alloc(KD * sizeof(float));
+    ctx->freezeSize   = (int*)    kmeans_aligned_alloc(ctx->capClusters * sizeof(int));
+    ctx->freezeOld    = (float*)  kmeans_aligned_alloc(KD * sizeof(float));
+    ctx->freezeShift  = (float*)  kmeans_aligned_alloc(ctx->capClusters * sizeof(float));
+    ctx->freezeGap    = (float*)  kmeans_aligned_alloc((size_t)numObjs * sizeof(float));
+    ctx->stats.num_allocs++;
+
+    if (ctx->freezeStable == NULL || ctx->freezeOn == NULL ||
+        ctx->freezeObjs == NULL || ctx->freezeIdx == NULL ||
+        ctx->freezeMem == NULL || ctx->freezeSum == NULL ||
+        ctx->freezeSize == NULL || ctx->freezeOld == NULL ||
+        ctx->freezeShift == NULL || ctx->freezeGap == NULL) {
+        ctx->capFreezeObjs = 0;
+        ctx->capFreezeKD   = 0;
+        return 0;
+    }
+    ctx->capFreezeObjs = numObjs;
+    ctx->capFreezeKD   = KD;
+    return 1;
+}
+
+/*----< gather_active() >----------------------------------------------------*/
+/* the objects not frozen, in object order, for the engine                   */
+static void gather_active(kmeans_ctx *ctx, float **objects, int numObjs)
+{
+    int i, nactive = 0;
+
+    for (i=0; i<numObjs; i++)
+        if (!ctx->freezeOn[i]) {
+            ctx->freezeObjs[nactive] = objects[i];
+            ctx->freezeIdx[nactive]  = i;
+            nactive++;
+        }
+    ctx->freezeActive = nactive;
+    ctx->sketchKey    = NULL;   /* the engine sees other objects now */
+}
+
+/*----< full_pass() >--------------------------------------------------------*/
+/* assign every object exactly, then choose the objects to freeze and sum    */
+/* them aside                                                                */
+static float full_pass(kmeans_ctx *ctx,
+                       float     **objects,     /* [numObjs][numCoords] */
+                       int         numCoords,
+                       int         numObjs,
+                       int         numClusters,
+                       int        *membership,  /* in/out: [numObjs] */
+                       float     **clusters,    /* [numClusters][numCoords] */
+                       float       other,       /* farthest move of a center */
+                       double     *sse)
+{
+    int    i, j, n;
+    size_t padK  = KMEANS_PAD((size_t)ctx->capClusters);
+    size_t padKD = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);
+    float  delta = 0.0;
+    double sum   = 0.0, stale = 0.0;
+
+    #pragma omp parallel num_threads(ctx->nthreads) \
+            shared(objects,clusters,membership)
+    {
+        int    k, d, index;
+        float  d1, d2, dist;
+        int    tid        = omp_get_thread_num();
+        int   *local_size = ctx->local_newClusterSize + tid * padK;
+        float *local_sum  = ctx->local_newClusters    + tid * padKD;
+
+        #pragma omp for schedule(static) reduction(+:delta,sum,stale)
+        for (n=0; n<numObjs; n++) {
+            /* nearest center, ties to the lowest, and the second nearest */
+            index = 0;
+            d1    = euclid_dist_2(numCoords, objects[n], clusters[0]);
+            d2    = FLT_MAX;
+            for (k=1; k<numClusters; k++) {
+                dist = euclid_dist_2(numCoords, objects[n], clusters[k]);
+                if (dist < d1)      { d2 = d1; d1 = dist; index = k; }
+                else if (dist < d2) d2 = dist;
+            }
+
+            sum += d1;
+            kmeans_far_offer(ctx, tid, n, d1);
+            if (membership[n] != index) {
+                delta += 1.0;
+                if (ctx->freezeOn[n]) stale += 1.0;
+                ctx->freezeStable[n] = 0;
+            }
+            else
+                ctx->freezeStable[n]++;
+            membership[n] = index;
+
+            ctx->freezeGap[n] = sqrtf(d2) - sqrtf(d1);
+            ctx->freezeOn[n]  = (ctx->freezeStable[n] >= ctx->cfg.freeze_after &&
+                                 ctx->freezeGap[n] > ctx->freezeShift[index] + other);
+
+            local_size[index]++;
+            for (d=0; d<numCoords; d++)
+                local_sum[(size_t)index*numCoords + d] += objects[n][d];
+        }
+
+        kmeans_reduce_local(ctx, numCoords, numClusters);
+    }
+
+    /* the frozen sums, and the other objects for the engine */
+    memset(ctx->freezeSum,  0, (size_t)numClusters * numCoords * sizeof(float));
+    memset(ctx->freezeSize, 0, numClusters * sizeof(int));
+    for (i=0; i<numObjs; i++)
+        if (ctx->freezeOn[i]) {
+            float *s = ctx->freezeSum + (size_t)membership[i] * numCoords;
+            ctx->freezeSize[membership[i]]++;
+            for (j=0; j<numCoords; j++) s[j] += objects[i][j];
+        }
+    gather_active(ctx, objects, numObjs);
+    ctx->freezeStale += stale;
+
+    *sse = sum;
+    return delta;
+}
+
+/*----< kmeans_pass_freeze() >-----------------------------------------------*/
+/* one pass of kmeans_fit() with cfg.freeze_after set                        */
+float kmeans_pass_freeze(kmeans_ctx *ctx,
+                         float     **objects,     /* [numObjs][numCoords] */
+                         int         numCoords,
+                         int         numObjs,
+                         int         numClusters,
+                         int        *membership,  /* in/out: [numObjs] */
+                         float     **clusters,    /* [numClusters][numCoords] */
+                         double     *sse)
+{
+    int    i, j, a, n, verify, thawed;
+    float  delta, other = 0.0;
+
+    verify = (ctx->cfg.freeze_verify > 0) ? ctx->cfg.freeze_verify
+                                          : FREEZE_VERIFY;
+    if (!reserve_freeze(ctx, numObjs)) return -1;
+
+    /* the move of each center in the last pass, and the farthest move */
+    if (ctx->freezePasses == 0) {
+        memset(ctx->freezeStable, 0, (size_t)numObjs * sizeof(int));
+        memset(ctx->freezeOn,     0, (size_t)numObjs);
+        memset(ctx->freezeShift,  0, numClusters * sizeof(float));
+    }
+    else
+        for (i=0; i<numClusters; i++) {
+            float m = euclid_dist_2(numCoords, clusters[i],
+                                    ctx->freezeOld + (size_t)i * numCoords);
+            ctx->freezeShift[i] = sqrtf(m);
+            if (ctx->freezeShift[i] > other) other = ctx->freezeShift[i];
+        }
+    for (i=0; i<numClusters; i++)
+        memcpy(ctx->freezeOld + (size_t)i * numCoords, clusters[i],
+               numCoords * sizeof(float));
+
+    if (ctx->freezePasses++ % verify == 0)
+        return full_pass(ctx, objects, numCoords, numObjs, numClusters,
+                         membership, clusters, other, sse);
+
+    /* the centers moved: a frozen object whose gap they may have closed
+       goes back to the engine */
+    thawed = 0;
+    for (n=0; n<numObjs; n++) {
+        if (!ctx->freezeOn[n]) continue;
+        i = membership[n];
+        ctx->freezeGap[n] -= ctx->freezeShift[i] + other;
+        if (ctx->freezeGap[n] <= 0.0f) {
+            float *s = ctx->freezeSum + (size_t)i * numCoords;
+            for (j=0; j<numCoords; j++) s[j] -= objects[n][j];
+            ctx->freezeSize[i]--;
+            ctx->freezeOn[n] = 0;
+            thawed++;
+        }
+    }
+    if (thawed > 0) gather_active(ctx, objects, numObjs);
+
+    /* the engine on the objects not frozen */
+    for (a=0; a<ctx->freezeActive; a++)
+        ctx->freezeMem[a] = membership[ctx->freezeIdx[a]];
+    delta = (ctx->freezeActive > 0)
+          ? kmeans_pass(ctx, ctx->freezeObjs, numCoords, ctx->freezeActive,
+                        numClusters, ctx->freezeMem, clusters, sse)
+          : 0.0;
+    if (delta < 0) return -1;
+    kmeans_far_remap(ctx, ctx->freezeIdx);
+    ctx->indexClusters  = 0;    /* a sorted index would be of those only */
+    ctx->freezeSkipped += numObjs - ctx->freezeActive;
+
+    for (a=0; a<ctx->freezeActive; a++) {
+        int n = ctx->freezeIdx[a];
+        if (membership[n] == ctx->freezeMem[a]) ctx->freezeStable[n]++;
+        else                                    ctx->freezeStable[n] = 0;
+        membership[n] = ctx->freezeMem[a];
+    }
+    for (i=0; i<numClusters; i++) {
+        float *sum = ctx->newClusters + (size_t)i * numCoords;
+        float *fz  = ctx->freezeSum   + (size_t)i * numCoords;
+        ctx->newClusterSize[i] += ctx->freezeSize[i];
+        for (j=0; j<numCoords; j++) sum[j] += fz[j];
+    }
+    return delta;
+}
@@ -0,0 +1,274 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_hier.c                                             */
+/*   Description:  top-down (hierarchical) fit for a large K. A flat pass    */
+/*                 costs numObjs * K distances; here the objects are split */
+/*                 by a fit of only `branch' centers (2 = bisecting), each  */
+/*                 part gets a share of the K clusters in proportion to its */
+/*                 SSE, and the parts are split again until every part is   */
+/*                 one cluster. Every split is a kmeans_fit() of at most    */
+/*                 HIER_SPLIT_LOOPS passes with the tasks engine on the     */
+/*                 rows of its part: a split only has to separate the part, */
+/*                 the splits below and the flat passes refine it further.  */
+/*                 That is at most numObjs * branch * HIER_SPLIT_LOOPS *    */
+/*                 log_branch(K) distances, and less than one flat pass of  */
+/*                 numObjs * K for a large K. The parts run as OpenMP tasks */
+/*                 of one team, so large parts are split by the whole team  */
+/*                 and many small ones side by side. A few flat passes from */
+/*                 the resulting centers can follow. Centers and SSE are    */
+/*                 those of cfg.metric.                                     */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+#define HIER_TASK_MIN    256   /* smaller parts are split by the task itself */
+#define HIER_SPLIT_LOOPS 10    /* passes of a split at most */
+
+typedef struct {
+    kmeans_config cfg;         /* of the splits */
+    int           numCoords;
+    int           branch;
+    int          *membership;  /* [numObjs] of the whole fit */
+    float       **clusters;    /* [numClusters][numCoords] */
+    double        dist_calcs;
+    int           failed;
+} hier_state;
+
+/*----< leaf() >-------------------------------------------------------------*/
+/* the part is cluster id: its mean (median, unit mean) is the center        */
+static void leaf(hier_state *st, float **objs, const int *idx, int n, int id)
+{
+    int i;
+
+    for (i=0; i<n; i++) st->membership[idx[i]] = id;
+    if (!kmeans_metric_center(st->cfg.metric, objs, n, st->numCoords,
+                              st->clusters[id])) {
+        #pragma omp atomic write
+        st->failed = 1;
+    }
+}
+
+/*----< split() >------------------------------------------------------------*/
+/* cluster the n rows objs[] (input rows idx[]) into numClusters clusters   */
+/* with ids from base; objs[] and idx[] are reordered part by part           */
+static void split(hier_state *st,
+                  float     **objs,        /* [n] rows of the part */
+                  int        *idx,         /* [n] their input position */
+                  int         n,
+                  int         numClusters,
+                  int         base)
+{
+    int         i, j, c, b, numCoords = st->numCoords;
+    int        *mem, *cnt, *kk, *off, *tidx;
+    float     **cent, **tobjs;
+    double     *sse;
+    kmeans_ctx *ctx;
+
+    if (numClusters == 1) {
+        leaf(st, objs, idx, n, base);
+        return;
+    }
+    b = (st->branch < numClusters) ? st->branch : numClusters;
+
+    mem   = (int*)    malloc((size_t)n * sizeof(int));
+    tidx  = (int*)    malloc((size_t)n * sizeof(int));
+    tobjs = (float**) malloc((size_t)n * sizeof(float*));
+    cnt   = (int*)    calloc(b, sizeof(int));
+    kk    = (int*)    calloc(b, sizeof(int));
+    off   = (int*)    calloc(b + 1, sizeof(int));
+    sse   = (double*) calloc(b, sizeof(double));
+    cent  = (float**) calloc(b, sizeof(float*));
+    ctx   = kmeans_ctx_create(&st->cfg);
+    if (mem == NULL || tidx == NULL || tobjs == NULL || cnt == NULL ||
+        kk == NULL || off == NULL || sse == NULL || cent == NULL ||
+        ctx == NULL ||
+        (cent[0] = (float*) calloc((size_t)b * numCoords, sizeof(float))) == NULL) {
+        #pragma omp atomic write
+        st->failed = 1;
+        goto done;
+    }
+    for (c=1; c<b; c++) cent[c] = cent[c-1] + numCoords;
+
+    /* the b centers split from the mean of the part, as kmeans_split_centers()
+       grows a finished fit */
+    for (i=0; i<n; i++) {
+        mem[i] = 0;
+        for (j=0; j<numCoords; j++) cent[0][j] += objs[i][j];
+    }
+    for (j=0; j<numCoords; j++) cent[0][j] /= n;
+    if (!kmeans_split_centers(objs, numCoords, n, mem, 1, b, cent) ||
+        !kmeans_fit(ctx, objs, numCoords, n, b, mem, cent)) {
+        #pragma omp atomic write
+        st->failed = 1;
+        goto done;
+    }
+    #pragma omp atomic
+    st->dist_calcs += ctx->stats.dist_calcs;
+
+    for (i=0; i<n; i++) {
+        cnt[mem[i]]++;
+        sse[mem[i]] += kmeans_metric_dist(st->cfg.metric, numCoords, objs[i],
+                                          cent[mem[i]]);
+    }
+    /* identical objects do not split: cut the part in b runs instead */
+    for (c=0; c<b; c++)
+        if (cnt[c] == n) break;
+    if (c < b) {
+        for (c=0; c<b; c++) cnt[c] = 0;
+        for (i=0; i<n; i++) {
+            mem[i] = (int)((long long)i * b / n);
+            cnt[mem[i]]++;
+        }
+        for (c=0; c<b; c++) sse[c] = cnt[c];
+    }
+
+    /* one cluster for each part, then one at a time to the part with the
+       largest SSE per cluster that still has more objects than clusters */
+    for (c=0; c<b; c++) kk[c] = (cnt[c] > 0);
+    for (i=0; i<b; i++) numClusters -= kk[i];
+    while (numClusters-- > 0) {
+        int best = -1;
+        for (c=0; c<b; c++)
+            if (kk[c] < cnt[c] &&
+                (best < 0 || sse[c] * kk[best] > sse[best] * kk[c]))
+                best = c;
+        kk[best]++;
+    }
+
+    /* the rows part by part */
+    for (c=0; c<b; c++) off[c+1] = off[c] + cnt[c];
+    memcpy(cnt, off, b * sizeof(int));
+    for (i=0; i<n; i++) {
+        int pos   = cnt[mem[i]]++;
+        tobjs[pos] = objs[i];
+        tidx[pos]  = idx[i];
+    }
+    memcpy(objs, tobjs, (size_t)n * sizeof(float*));
+    memcpy(idx,  tidx,  (size_t)n * sizeof(int));
+
+    for (c=0; c<b; c++) {
+        int lo = off[c], nc = off[c+1] - off[c], kc = kk[c];
+        if (kc == 0) continue;
+        #pragma omp task if(nc > HIER_TASK_MIN) firstprivate(lo, nc, kc, base)
+        split(st, objs + lo, idx + lo, nc, kc, base);
+        base += kc;
+    }
+
+done:
+    kmeans_ctx_destroy(ctx);
+    if (cent != NULL) free(cent[0]);
+    free(cent);
+    free(sse);
+    free(off);
+    free(kk);
+    free(cnt);
+    free(tobjs);
+    free(tidx);
+    free(mem);
+}
+
+/*----< kmeans_fit_hierarchical() >------------------------------------------*/
+int kmeans_fit_hierarchical(kmeans_ctx *ctx,
+                            float     **objects,      /* in: [numObjs][numCoords] */
+                            int         numCoords,
+                            int         numObjs,
+                            int         numClusters,
+                            int         branch,
+                            int         refine,
+                            int        *membership,   /* out: [numObjs] */
+                            float     **clusters)     /* out: [numClusters][numCoords] */
+{
+    int           i, nthreads;
+    int          *idx;
+    float       **objs;
+    double        timing, sse, dist_calcs;
+    hier_state    st;
+    kmeans_config cfg;
+
+    if (ctx == NULL || objects == NULL || clusters == NULL ||
+        membership == NULL || numObjs < numClusters || numCoords <= 0 ||
+        numClusters <= 0 || branch < 2 || refine < 0)
+        return 0;
+
+    idx  = (int*)    malloc((size_t)numObjs * sizeof(int));
+    objs = (float**) malloc((size_t)numObjs * sizeof(float*));
+    if (idx == NULL || objs == NULL) {
+        free(idx); free(objs);
+        return 0;
+    }
+    for (i=0; i<numObjs; i++) {
+        idx[i]  = i;
+        objs[i] = objects[i];
+    }
+
+    st.cfg            = ctx->cfg;
+    st.cfg.engine     = KMEANS_ENGINE_OMP_TASKS;  /* the splits share one team */
+    st.cfg.async      = 0;
+    st.cfg.freeze_after = 0;
+    st.cfg.time_budget  = 0.0;
+    st.cfg.debug      = 0;
+    if (st.cfg.max_loops > HIER_SPLIT_LOOPS) st.cfg.max_loops = HIER_SPLIT_LOOPS;
+    st.numCoords      = numCoords;
+    st.branch         = branch;
+    st.membership     = membership;
+    st.clusters       = clusters;
+    st.dist_calcs     = 0.0;
+    st.failed         = 0;
+
+    nthreads = (ctx->cfg.nthreads > 0) ? ctx->cfg.nthreads
+                                       : omp_get_max_threads();
+    timing = omp_get_wtime();
+
+    #pragma omp parallel num_threads(nthreads)
+    #pragma omp single
+    split(&st, objs, idx, numObjs, numClusters, 0);
+
+    free(objs);
+    free(idx);
+    if (st.failed) return 0;
+
+    if (ctx->cfg.debug)
+        printf("hierarchical: branch = %d (T = %7.4f) distances = %g\n",
+               branch, omp_get_wtime() - timing, st.dist_calcs);
+
+    /* flat passes from the centers of the tree */
+    if (refine > 0) {
+        cfg = ctx->cfg;
+        if (refine - 1 < ctx->cfg.max_loops) ctx->cfg.max_loops = refine - 1;
+        i = kmeans_fit(ctx, objects, numCoords, numObjs, numClusters,
+                       membership, clusters);
+        ctx->cfg = cfg;
+        if (!i) return 0;
+        dist_calcs = ctx->stats.dist_calcs;
+    }
+    else {
+        sse = 0.0;
+        #pragma omp parallel for num_threads(nthreads) reduction(+:sse)
+        for (i=0; i<numObjs; i++)
+            sse += kmeans_metric_dist(ctx->cfg.metric, numCoords, objects[i],
+                                      clusters[membership[i]]);
+        /* no flat pass ran: the tree is the result */
+        ctx->stats.loops       = 0;
+        ctx->stats.delta       = 0.0;
+        ctx->stats.sse         = sse;
+        ctx->stats.stop_reason = KMEANS_STOP_TREE;
+        ctx->stats.dims_per_dist = numCoords;
+        ctx->stats.repairs     = 0;
+        dist_calcs = 0.0;
+    }
+    ctx->stats.dist_calcs = st.dist_calcs + dist_calcs;
+    ctx->stats.tree_dist_calcs = st.dist_calcs;
+    ctx->stats.timing     = omp_get_wtime() - timing;
+    return 1;
+}
@@ -0,0 +1,268 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_incremental.c                                      */
+/*   Description:  re-clustering after new objects are appended to a data  */
+/*                 set that was clustered before. The fit starts from the  */
+/*                 old centers and memberships and keeps, for every object, */
+/*                 an upper bound on the distance to its center and a lower */
+/*                 bound on the distance to any other center (Hamerly's    */
+/*                 bounds). After the centers move, the bounds are loosened */
+/*                 by the distance the centers moved, and an object whose   */
+/*                 upper bound is below its lower bound, or below half the */
+/*                 distance from its center to the closest other center,    */
+/*                 cannot change cluster and is skipped. The bounds are     */
+/*                 returned so that the next increment skips the old        */
+/*                 objects from its first pass.                              */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+/*----< dist2() >------------------------------------------------------------*/
+__inline static
+float dist2(int numdims, const float *coord1, const float *coord2)
+{
+    int   i;
+    float ans = 0.0;
+    for (i=0; i<numdims; i++)
+        ans += (coord1[i]-coord2[i]) * (coord1[i]-coord2[i]);
+    return ans;
+}
+
+/*----< scan_all() >---------------------------------------------------------*/
+/* nearest center and the distances to the nearest and second nearest        */
+__inline static
+int scan_all(int numCoords, int numClusters, const float *object,
+             float **clusters, float *upper, float *lower)
+{
+    int   k, index = 0;
+    float d, d1 = 3.4e38f, d2 = 3.4e38f;
+
+    for (k=0; k<numClusters; k++) {
+        d = dist2(numCoords, object, clusters[k]);
+        if (d < d1)      { d2 = d1; d1 = d; index = k; }
+        else if (d < d2) { d2 = d; }
+    }
+    *upper = sqrtf(d1);
+    *lower = sqrtf(d2);
+    return index;
+}
+
+/*----< center_sums() >------------------------------------------------------*/
+/* ctx->newClusters/newClusterSize from membership[], per-thread sums as in  */
+/* kmeans_pass_reduction()                                                   */
+static void center_sums(kmeans_ctx *ctx, float **objects, int numCoords,
+                        int numObjs, int numClusters, const int *membership)
+{
+    int    nthreads = ctx->nthreads;
+    size_t padK     = KMEANS_PAD((size_t)ctx->capClusters);
+    size_t padKD    = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int    i, j, k;
+        int    tid = omp_get_thread_num();
+        int   *local_size = ctx->local_newClusterSize + tid * padK;
+        float *local_sum  = ctx->local_newClusters    + tid * padKD;
+
+        #pragma omp for schedule(static)
+        for (i=0; i<numObjs; i++) {
+            k = membership[i];
+            local_size[k]++;
+            for (j=0; j<numCoords; j++)
+                local_sum[(size_t)k*numCoords + j] += objects[i][j];
+        }
+
+        #pragma omp for schedule(static)
+        for (i=0; i<numClusters; i++) {
+            for (j=0; j<nthreads; j++) {
+                int   *size_j = ctx->local_newClusterSize + j * padK;
+                float *sum_j  = ctx->local_newClusters    + j * padKD
+                                + (size_t)i * numCoords;
+                ctx->newClusterSize[i] += size_j[i];
+                size_j[i] = 0;
+                for (k=0; k<numCoords; k++) {
+                    ctx->newClusters[(size_t)i*numCoords + k] += sum_j[k];
+                    sum_j[k] = 0.0;
+                }
+            }
+        }
+    }
+}
+
+/*----< move_centers() >-----------------------------------------------------*/
+/* update step, then loosen the bounds by how far the centers moved          */
+static void move_centers(kmeans_ctx *ctx, float **objects, int numCoords,
+                         int numObjs, int numClusters, const int *membership,
+                         float **clusters, float *oldClusters, float *drift,
+                         float *upper, float *lower)
+{
+    int   i, k, far1 = 0;
+    float p1 = 0.0, p2 = 0.0;
+
+    for (k=0; k<numClusters; k++)
+        memcpy(oldClusters + (size_t)k*numCoords, clusters[k],
+               numCoords * sizeof(float));
+
+    center_sums(ctx, objects, numCoords, numObjs, numClusters, membership);
+    kmeans_update_centers(ctx, numCoords, numClusters, clusters);
+
+    /* the two largest moves: an object's lower bound is loosened by the
+       largest move of any center other than its own */
+    for (k=0; k<numClusters; k++) {
+        drift[k] = sqrtf(dist2(numCoords, oldClusters + (size_t)k*numCoords,
+                               clusters[k]));
+        if (drift[k] > p1)      { p2 = p1; p1 = drift[k]; far1 = k; }
+        else if (drift[k] > p2) { p2 = drift[k]; }
+    }
+
+    #pragma omp parallel for num_threads(ctx->nthreads) schedule(static)
+    for (i=0; i<numObjs; i++) {
+        upper[i] += drift[membership[i]];
+        lower[i] -= (membership[i] == far1) ? p2 : p1;
+    }
+}
+
+/*----< kmeans_fit_incremental() >-------------------------------------------*/
+int kmeans_fit_incremental(kmeans_ctx *ctx,
+                           float     **objects,     /* in: [numObjs][numCoords] */
+                           int         numCoords,
+                           int         numObjs,     /* old + appended objects */
+                           int         numClusters,
+                           int         numOld,      /* objects with a membership */
+                           int         numBounded,  /* objects with bounds, <= numOld */
+                           int        *membership,  /* in/out: [numObjs] */
+                           float     **clusters,    /* in/out: [numClusters][numCoords] */
+                           float      *upper,       /* in/out: [numObjs] */
+                           float      *lower)       /* in/out: [numObjs] */
+{
+    int    i, k, loop = 0;
+    float  delta;
+    float *oldClusters, *drift, *half;
+    double sse, timing, dist_calcs;
+
+    if (ctx == NULL || objects == NULL || clusters == NULL ||
+        membership == NULL || upper == NULL || lower == NULL ||
+        numObjs <= 0 || numCoords <= 0 || numClusters <= 1 ||
+        numOld < 0 || numOld > numObjs || numBounded < 0 ||
+        numBounded > numOld)
+        return 0;
+
+    ctx->nthreads = (ctx->cfg.nthreads > 0) ? ctx->cfg.nthreads
+                                            : omp_get_max_threads();
+    if (!kmeans_ctx_reserve(ctx, numCoords, numClusters)) return 0;
+
+    oldClusters = (float*) malloc((size_t)numClusters * numCoords * sizeof(float));
+    drift       = (float*) malloc(numClusters * sizeof(float));
+    half        = (float*) malloc(numClusters * sizeof(float));
+    if (oldClusters == NULL || drift == NULL || half == NULL) {
+        free(oldClusters); free(drift); free(half);
+        return 0;
+    }
+
+    timing = omp_get_wtime();
+
+    /* objects without bounds need a full scan, against the old centers;
+       the first pass then checks the old memberships with the bounds */
+    delta = 0.0;
+    #pragma omp parallel for num_threads(ctx->nthreads) private(k) \
+            schedule(static) reduction(+:delta)
+    for (i=numBounded; i<numObjs; i++) {
+        k = scan_all(numCoords, numClusters, objects[i], clusters,
+                     &upper[i], &lower[i]);
+        if (i >= numOld || membership[i] != k) delta += 1.0;
+        membership[i] = k;
+    }
+    dist_calcs = (double)(numObjs - numBounded) * numClusters;
+
+    do {
+        double calcs = 0.0;
+
+        if (loop > 0)
+            move_centers(ctx, objects, numCoords, numObjs, numClusters,
+                         membership, clusters, oldClusters, drift, upper,
+                         lower);
+
+        /* half the distance from each center to the closest other one */
+        #pragma omp parallel for num_threads(ctx->nthreads) private(i) \
+                schedule(static)
+        for (k=0; k<numClusters; k++) {
+            float d, m = 3.4e38f;
+            for (i=0; i<numClusters; i++) {
+                if (i == k) continue;
+                d = dist2(numCoords, clusters[k], clusters[i]);
+                if (d < m) m = d;
+            }
+            half[k] = 0.5f * sqrtf(m);
+        }
+        dist_calcs += (double)numClusters * (numClusters - 1);
+
+        if (loop > 0) delta = 0.0;
+        #pragma omp parallel for num_threads(ctx->nthreads) private(k) \
+                schedule(static) reduction(+:delta,calcs)
+        for (i=0; i<numObjs; i++) {
+            int   a = membership[i];
+            float z = (lower[i] > half[a]) ? lower[i] : half[a];
+
+            if (upper[i] <= z) continue;
+
+            /* tighten the upper bound and test again */
+            upper[i] = sqrtf(dist2(numCoords, objects[i], clusters[a]));
+            calcs   += 1.0;
+            if (upper[i] <= z) continue;
+
+            k = scan_all(numCoords, numClusters, objects[i], clusters,
+                         &upper[i], &lower[i]);
+            calcs += numClusters;
+            if (k != a) {
+                membership[i] = k;
+                delta += 1.0;
+            }
+        }
+        dist_calcs += calcs;
+
+        delta /= numObjs;
+    } while (delta > ctx->cfg.threshold && loop++ < ctx->cfg.max_loops);
+
+    /* centers of the final membership, with exact upper bounds for them */
+    move_centers(ctx, objects, numCoords, numObjs, numClusters, membership,
+                 clusters, oldClusters, drift, upper, lower);
+    sse = 0.0;
+    #pragma omp parallel for num_threads(ctx->nthreads) schedule(static) \
+            reduction(+:sse)
+    for (i=0; i<numObjs; i++) {
+        float d = dist2(numCoords, objects[i], clusters[membership[i]]);
+        upper[i] = sqrtf(d);
+        sse     += d;
+    }
+    dist_calcs += numObjs;
+
+    ctx->stats.loops       = loop;
+    ctx->stats.delta       = delta;
+    ctx->stats.sse         = sse;
+    ctx->stats.timing      = omp_get_wtime() - timing;
+    ctx->stats.stop_reason = (loop > ctx->cfg.max_loops) ? KMEANS_STOP_MAX_LOOPS
+                                                         : KMEANS_STOP_CONVERGED;
+    ctx->stats.dist_calcs  = dist_calcs;
+    ctx->stats.dims_per_dist = numCoords;
+
+    if (ctx->cfg.debug)
+        printf("incremental: nloops = %2d (T = %7.4f) distances = %.0f\n",
+               loop, ctx->stats.timing, dist_calcs);
+
+    free(half);
+    free(drift);
+    free(oldClusters);
+    return 1;
+}
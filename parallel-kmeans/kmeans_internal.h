@@ -0,0 +1,377 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_internal.h                                         */
+/*   Description:  layout of kmeans_ctx and the engine entry points shared  */
+/*                 by the library sources. Not installed with the library.  */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _H_KMEANS_INTERNAL
+#define _H_KMEANS_INTERNAL
+
+#include <stddef.h>
+#include "kmeans_lib.h"
+
+#define KMEANS_ALIGN  64                    /* cache line size in bytes */
+#define KMEANS_PAD(n) (((n) + 15) & ~15)    /* n floats/ints to whole lines */
+#define KMEANS_FAR    16                    /* farthest objects kept per thread */
+
+typedef struct kmeans_pool kmeans_pool;   /* see kmeans_pool.c */
+
+struct kmeans_ctx {
+    kmeans_config cfg;
+    kmeans_stats  stats;
+
+    /* shape the scratch buffers are currently sized for */
+    int     capCoords, capClusters, capThreads;
+    int     nthreads;      /* threads used by the current fit */
+
+    kmeans_monitor monitor;        /* NULL or called after every update */
+    void          *monitor_arg;
+
+    int    *newClusterSize;        /* [numClusters] */
+    float  *newClusters;           /* [numClusters][numCoords] */
+    float  *clustersT;             /* [numCoords][numClusters] */
+    int    *local_newClusterSize;  /* [capThreads][PAD(numClusters)] */
+    float  *local_newClusters;     /* [capThreads][PAD(numClusters*numCoords)] */
+    float  *distArray;             /* [capThreads][PAD(numClusters)] */
+    double *local_stats;           /* [capThreads][8]: delta, sse */
+    float  *farDist;               /* [capThreads][KMEANS_FAR] see kmeans_repair.c */
+    int    *farObj;                /* [capThreads][KMEANS_FAR] their object */
+    int    *farCount;              /* [capThreads][16]: no. kept, nearest slot */
+    char   *repaired;              /* [capClusters] reseeded by the current fit */
+
+    kmeans_pool *pool;             /* workers of the pool engine, or NULL */
+
+    /* cluster -> objects index of the sorted engine */
+    int    *order;                 /* [capObjs] object ids by cluster */
+    int    *offsets;               /* [capOffsets]: cluster k at offsets[k] */
+    int     capObjs, capOffsets;
+    int     indexObjs, indexClusters;  /* shape of the index, 0 = none */
+
+    /* partial distances of cfg.partial, see kmeans_partial.c */
+    int    *dimOrder;              /* [capPartialCoords] by decreasing variance */
+    float  *partialC;              /* [numClusters][PAD(numCoords)] in dimOrder */
+    float  *partialObj;            /* [capThreads][PAD(capPartialCoords)] */
+    int    *partialCand;           /* [capThreads][PAD(capPartialClusters)] */
+    int     capPartialCoords, capPartialClusters, capPartialThreads;
+    int     partialReady;          /* dimOrder is of the current fit */
+    double  partialDims;           /* coordinates summed by the current fit */
+
+    /* random projections of the sketch engine, see kmeans_sketch.c */
+    double *sketchP;               /* [sketchDims][numCoords] orthonormal rows */
+    double *sketchMean;            /* [numCoords] sketches are of x - mean */
+    float  *sketchObjs;            /* [numObjs][sketchDims+1] */
+    float  *sketchC;               /* [numClusters][sketchDims+1] */
+    size_t  capSketchP, capSketchObjs, capSketchC;
+    int     capSketchCoords;
+    float **sketchKey;             /* objects sketchObjs is of, NULL = none */
+    int     sketchN, sketchDims;
+    float   sketchSlack;           /* rounding allowed in sketch distances */
+    double  sketchFallbacks;       /* object-passes checked past the shortlist */
+
+    /* coarse index over the centers of the ivf engine, see kmeans_ivf.c */
+    float  *ivfCoarse;             /* [ivfLists][numCoords] coarse centers */
+    int    *ivfOff;                /* [ivfLists+1] start of each list */
+    int    *ivfIds;                /* [numClusters] centers, list by list */
+    float  *ivfVecs;               /* [numClusters][numCoords] same order */
+    int    *ivfOf;                 /* [numClusters] list of each center */
+    int     capIvfCoords, capIvfClusters, capIvfLists;
+    int     ivfLists;              /* lists of the index, 0 = not built */
+    double  ivfChecked, ivfMismatch;   /* sampled objects, and those off exact */
+
+    /* stable objects frozen by cfg.freeze_after, see kmeans_freeze.c */
+    int    *freezeStable;          /* [numObjs] passes without a change */
+    char   *freezeOn;              /* [numObjs] skipped while its gap lasts */
+    float **freezeObjs;            /* [freezeActive] objects not frozen */
+    int    *freezeIdx;             /* [freezeActive] their position */
+    int    *freezeMem;             /* [freezeActive] their membership */
+    float  *freezeSum;             /* [numClusters][numCoords] of the frozen */
+    int    *freezeSize;            /* [numClusters] */
+    float  *freezeOld;             /* [numClusters][numCoords] last centers */
+    float  *freezeShift;           /* [numClusters] their move in the last pass */
+    float  *freezeGap;             /* [numObjs] what the centers may still move */
+    int     capFreezeObjs;
+    size_t  capFreezeKD;
+    int     freezeActive, freezePasses;
+    double  freezeSkipped;         /* object-passes skipped by the fit */
+    double  freezeStale;           /* frozen objects moved by a full pass */
+
+    /* resident centers for kmeans_predict(), see kmeans_set_centers() */
+    int     modelCoords, modelClusters;
+    float  *modelT;                /* [modelCoords][PAD(modelClusters)] */
+    float  *modelDist;             /* [modelThreads][PAD(modelClusters)] */
+    int     modelThreads;
+};
+
+void* kmeans_aligned_alloc(size_t);
+void  kmeans_aligned_free(void*);
+
+int   kmeans_ctx_reserve(kmeans_ctx*, int, int);
+int   kmeans_fit_prepare(kmeans_ctx*, int, int);
+
+kmeans_pool* kmeans_pool_create(int);
+void         kmeans_pool_destroy(kmeans_pool*);
+int          kmeans_pool_size(const kmeans_pool*);
+long         kmeans_pool_steals(const kmeans_pool*);
+
+/* one assignment pass: set membership[] and accumulate the new center sums
+   into ctx->newClusters/newClusterSize; returns no. changed memberships */
+float kmeans_pass           (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);   /* configured engine */
+float kmeans_pass_seq       (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+float kmeans_pass_atomic    (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+float kmeans_pass_reduction (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+float kmeans_pass_transposed(kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+float kmeans_pass_tasks     (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+float kmeans_pass_pool      (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+float kmeans_pass_sorted    (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+float kmeans_pass_tiled     (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+int   kmeans_tile_clusters  (const kmeans_ctx*, int, int);
+float kmeans_pass_sketch    (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+void  kmeans_sketch_shape   (const kmeans_ctx*, int, int, int*, int*);
+
+#define KMEANS_SKETCH_MAX_CANDS 32  /* longest shortlist of the sketch engine */
+
+float kmeans_pass_ivf       (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+void  kmeans_ivf_shape      (const kmeans_ctx*, int, int*, int*);
+
+#define KMEANS_IVF_MAX_PROBE 256    /* most lists probed by the ivf engine */
+
+float kmeans_pass_freeze    (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+float kmeans_pass_metric    (kmeans_ctx*, float**, int, int, int, int*,
+                             float**, double*);
+int   kmeans_metric_update  (kmeans_ctx*, float**, int, int, int, const int*,
+                             float**);
+float kmeans_metric_dist    (kmeans_metric, int, const float*, const float*);
+int   kmeans_metric_center  (kmeans_metric, float**, int, int, float*);
+
+void  kmeans_update_centers(kmeans_ctx*, int, int, float**);
+void  kmeans_reduce_local(kmeans_ctx*, int, int);   /* inside a parallel region */
+
+int   kmeans_fit_async(kmeans_ctx*, float**, int, int, int, int*, float**);
+
+void  kmeans_far_reset(kmeans_ctx*);
+void  kmeans_far_remap(kmeans_ctx*, const int*);
+int   kmeans_repair(kmeans_ctx*, float**, int, int, int*);
+
+int   kmeans_partial_setup(kmeans_ctx*, float**, int, int, int, float**);
+int   kmeans_partial_engine(kmeans_engine);
+
+/*----< kmeans_nearest_transposed() >----------------------------------------*/
+/* id of the center nearest to object, with the centers stored transposed as */
+/* clustersT[numCoords][ldK]; distArray is [numClusters] scratch             */
+static inline
+int kmeans_nearest_transposed(const float *object,     /* [numCoords] */
+                              const float *clustersT,  /* [numCoords][ldK] */
+                              int          numCoords,
+                              int          numClusters,
+                              int          ldK,
+                              float       *distArray,  /* [numClusters] */
+                              float       *min_dist_out)
+{
+    int   j, k, index = 0;
+    float min_dist;
+
+    for (j=0; j<numClusters; j++)
+        distArray[j] = (object[0]-clustersT[j]) * (object[0]-clustersT[j]);
+
+    for (k=1; k<numCoords; k++) {
+        const float *row = clustersT + (size_t)k*ldK;
+        for (j=0; j<numClusters; j++)
+            distArray[j] += (object[k] - row[j]) * (object[k] - row[j]);
+    }
+
+    min_dist = distArray[0];
+    for (j=1; j<numClusters; j++) {
+        if (distArray[j] < min_dist) { /* find the min and its array index */
+            min_dist = distArray[j];
+            index    = j;
+        }
+    }
+    *min_dist_out = min_dist;
+    return index;
+}
+
+/*----< kmeans_far_offer() >------------------------------------------------*/
+/* with cfg.repair, keep object obj among the KMEANS_FAR farthest from their */
+/* center seen by thread tid in this pass; dist is its distance as summed   */
+/* into the SSE. Engines call it for every object they assign               */
+static inline
+void kmeans_far_offer(kmeans_ctx *ctx, int tid, int obj, float dist)
+{
+    int    j, *cnt;
+    float *fd;
+
+    if (!ctx->cfg.repair) return;
+    cnt = ctx->farCount + (size_t)tid * 16;
+    fd  = ctx->farDist  + (size_t)tid * KMEANS_FAR;
+    if (cnt[0] < KMEANS_FAR)
+        j = cnt[0]++;
+    else if (dist > fd[cnt[1]])
+        j = cnt[1];
+    else
+        return;
+    fd[j] = dist;
+    ctx->farObj[(size_t)tid * KMEANS_FAR + j] = obj;
+
+    /* the slot to replace next: the nearest of those kept */
+    if (cnt[0] == KMEANS_FAR) {
+        cnt[1] = 0;
+        for (j=1; j<KMEANS_FAR; j++)
+            if (fd[j] < fd[cnt[1]]) cnt[1] = j;
+    }
+}
+
+#define KMEANS_LANES 8      /* coordinates summed per early-abandon check */
+
+/*----< kmeans_partial_object() >-------------------------------------------*/
+/* object in the coordinate order of the partial search, in the scratch of  */
+/* thread tid, zero padded to whole blocks of KMEANS_LANES                   */
+static inline
+const float* kmeans_partial_object(const kmeans_ctx *ctx,
+                                   int               tid,
+                                   const float      *object,
+                                   int               numCoords)
+{
+    int    j;
+    float *obj = ctx->partialObj + (size_t)tid * KMEANS_PAD((size_t)ctx->capPartialCoords);
+
+    for (j=0; j<numCoords; j++) obj[j] = object[ctx->dimOrder[j]];
+    for (; j & (KMEANS_LANES-1); j++) obj[j] = 0.0;
+    return obj;
+}
+
+/*----< kmeans_nearest_partial() >------------------------------------------*/
+/* find_nearest_cluster() with early abandon: the distance to each center   */
+/* is summed KMEANS_LANES coordinates at a time, the most spread out first, */
+/* and the center is dropped once the partial sum is above the best full    */
+/* distance so far. The search starts from center start, usually the one    */
+/* of the last pass, so the first bound is already tight. The lanes are     */
+/* only ever added to, so a dropped center cannot have been nearer; ties go */
+/* to the lowest index as in the full scan                                  */
+static inline
+int kmeans_nearest_partial(const float *object,     /* [numCoords] from kmeans_partial_object() */
+                           const float *centers,    /* [numClusters][ldD] ctx->partialC */
+                           int          numCoords,
+                           int          numClusters,
+                           int          ldD,
+                           int          start,
+                           float       *min_dist_out,
+                           double      *dims)       /* in/out: coordinates summed */
+{
+    int   j, k, l, index = start;
+    int   nlanes = (numCoords + KMEANS_LANES - 1) & ~(KMEANS_LANES - 1);
+    float min_dist = 0.0;
+
+    for (k=-1; k<numClusters; k++) {
+        const float *c = centers + (size_t)(k < 0 ? start : k) * ldD;
+        float lane[KMEANS_LANES] = {0.0}, dist = 0.0;
+
+        if (k == start) continue;
+        for (j=0; j<nlanes; j+=KMEANS_LANES) {
+            for (l=0; l<KMEANS_LANES; l++)
+                lane[l] += (object[j+l] - c[j+l]) * (object[j+l] - c[j+l]);
+            dist = ((lane[0] + lane[1]) + (lane[2] + lane[3])) +
+                   ((lane[4] + lane[5]) + (lane[6] + lane[7]));
+            if (k >= 0 && dist > min_dist) break;
+        }
+        *dims += (j + KMEANS_LANES < numCoords) ? j + KMEANS_LANES : numCoords;
+        if (k < 0) min_dist = dist;
+        else if (dist < min_dist || (dist == min_dist && k < index)) {
+            min_dist = dist;
+            index    = k;
+        }
+    }
+    *min_dist_out = min_dist;
+    return index;
+}
+
+/*----< kmeans_nearest_transposed_partial() >-------------------------------*/
+/* the early abandon of kmeans_nearest_partial() on transposed centers whose */
+/* rows are in the order of the partial search: all remaining candidates    */
+/* take the next KMEANS_LANES coordinates together, then those above the    */
+/* bound (the full distance to center start) are dropped from cand[]        */
+static inline
+int kmeans_nearest_transposed_partial(const float *object,    /* [numCoords] from kmeans_partial_object() */
+                                      const float *clustersT, /* [numCoords][ldK] */
+                                      int          numCoords,
+                                      int          numClusters,
+                                      int          ldK,
+                                      int          start,
+                                      float       *distArray, /* [numClusters] */
+                                      int         *cand,      /* [numClusters] */
+                                      float       *min_dist_out,
+                                      double      *dims)
+{
+    int   j, j1, k, c, n, index = start;
+    float bound = 0.0, min_dist;
+
+    /* the same additions, in the same order, as for the other centers */
+    for (j=0; j<numCoords; j++)
+        bound += (object[j] - clustersT[(size_t)j*ldK + start]) *
+                 (object[j] - clustersT[(size_t)j*ldK + start]);
+    *dims += numCoords;
+
+    for (k=0; k<numClusters; k++) {
+        distArray[k] = 0.0;
+        cand[k]      = k;
+    }
+    n = numClusters;
+    for (j=0; j<numCoords && n > 1; j=j1) {
+        j1 = (j + KMEANS_LANES < numCoords) ? j + KMEANS_LANES : numCoords;
+        *dims += (double)(j1 - j) * n;
+        if (n == numClusters) {
+            for (; j<j1; j++) {
+                const float *row = clustersT + (size_t)j*ldK;
+                for (k=0; k<numClusters; k++)
+                    distArray[k] += (object[j] - row[k]) * (object[j] - row[k]);
+            }
+        }
+        else {
+            for (; j<j1; j++) {
+                const float *row = clustersT + (size_t)j*ldK;
+                for (c=0; c<n; c++) {
+                    k = cand[c];
+                    distArray[k] += (object[j] - row[k]) * (object[j] - row[k]);
+                }
+            }
+        }
+        /* keep the order of cand[], so ties still go to the lowest index */
+        for (k=0, c=0; c<n; c++)
+            if (distArray[cand[c]] <= bound) cand[k++] = cand[c];
+        n = k;
+    }
+
+    /* center start always stays: only it is left, or the sums are full */
+    min_dist = bound;
+    if (n > 1) {
+        for (c=0; c<n; c++) {
+            k = cand[c];
+            if (distArray[k] < min_dist || (distArray[k] == min_dist && k < index)) {
+                min_dist = distArray[k];
+                index    = k;
+            }
+        }
+    }
+    *min_dist_out = min_dist;
+    return index;
+}
+
+#endif
@@ -0,0 +1,284 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_ivf.c                                              */
+/*   Description:  the "ivf" engine: approximate assignment for a very large */
+/*                 number of clusters. The centers are themselves clustered */
+/*                 into a coarse index (inverted file) of ivf_lists lists,  */
+/*                 with the centers of a list stored together. An object    */
+/*                 computes its distance to the coarse centers, and then    */
+/*                 only to the centers in the ivf_nprobe nearest lists.     */
+/*                 The first pass of a fit builds the index with a few      */
+/*                 Lloyd iterations over the centers; later passes, where   */
+/*                 the centers moved little, only re-file every center and  */
+/*                 move the coarse centers once. More probes find the exact */
+/*                 nearest center more often and cost more. Every           */
+/*                 IVF_CHECK_STRIDE-th object is also assigned exactly, to  */
+/*                 measure how often the two differ.                        */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+#define IVF_BUILD_ITERS  10     /* Lloyd iterations of a full build */
+#define IVF_CHECK_STRIDE 64     /* one object in this many is checked */
+
+/*----< kmeans_ivf_shape() >-------------------------------------------------*/
+/* no. lists and probes of the configuration for numClusters centers         */
+void kmeans_ivf_shape(const kmeans_ctx *ctx,
+                      int               numClusters,
+                      int              *lists,
+                      int              *probes)
+{
+    *lists = (ctx->cfg.ivf_lists > 0) ? ctx->cfg.ivf_lists
+                                      : (int) sqrt((double) numClusters);
+    if (*lists < 1)           *lists = 1;
+    if (*lists > numClusters) *lists = numClusters;
+
+    *probes = (ctx->cfg.ivf_nprobe > 0) ? ctx->cfg.ivf_nprobe : 4;
+    if (*probes > KMEANS_IVF_MAX_PROBE) *probes = KMEANS_IVF_MAX_PROBE;
+    if (*probes > *lists)               *probes = *lists;
+}
+
+/*----< euclid_dist_2() >----------------------------------------------------*/
+static inline
+float euclid_dist_2(int numdims, const float *coord1, const float *coord2)
+{
+    int i;
+    float ans=0.0;
+
+    for (i=0; i<numdims; i++)
+        ans += (coord1[i]-coord2[i]) * (coord1[i]-coord2[i]);
+
+    return(ans);
+}
+
+/*----< reserve_ivf() >------------------------------------------------------*/
+static int reserve_ivf(kmeans_ctx *ctx, int numCoords, int numClusters,
+                       int lists)
+{
+    if (numCoords   <= ctx->capIvfCoords   &&
+        numClusters <= ctx->capIvfClusters &&
+        lists       <= ctx->capIvfLists)
+        return 1;
+
+    if (numCoords   < ctx->capIvfCoords)   numCoords   = ctx->capIvfCoords;
+    if (numClusters < ctx->capIvfClusters) numClusters = ctx->capIvfClusters;
+    if (lists       < ctx->capIvfLists)    lists       = ctx->capIvfLists;
+
+    kmeans_aligned_free(ctx->ivfCoarse);
+    kmeans_aligned_free(ctx->ivfOff);
+    kmeans_aligned_free(ctx->ivfIds);
+    kmeans_aligned_free(ctx->ivfVecs);
+    kmeans_aligned_free(ctx->ivfOf);
+    ctx->ivfCoarse = (float*) kmeans_aligned_alloc((size_t)lists * numCoords * sizeof(float));
+    ctx->ivfOff    = (int*)   kmeans_aligned_alloc((lists + 1) * sizeof(int));
+    ctx->ivfIds    = (int*)   kmeans_aligned_alloc(numClusters * sizeof(int));
+    ctx->ivfVecs   = (float*) kmeans_aligned_alloc((size_t)numClusters * numCoords * sizeof(float));
+    ctx->ivfOf     = (int*)   kmeans_aligned_alloc(numClusters * sizeof(int));
+    ctx->stats.num_allocs++;
+    ctx->ivfLists  = 0;         /* the index has to be built again */
+
+    if (ctx->ivfCoarse == NULL || ctx->ivfOff == NULL || ctx->ivfIds == NULL ||
+        ctx->ivfVecs == NULL || ctx->ivfOf == NULL) {
+        ctx->capIvfCoords = ctx->capIvfClusters = ctx->capIvfLists = 0;
+        return 0;
+    }
+    ctx->capIvfCoords   = numCoords;
+    ctx->capIvfClusters = numClusters;
+    ctx->capIvfLists    = lists;
+    return 1;
+}
+
+/*----< build_index() >------------------------------------------------------*/
+/* file every center under its nearest coarse center, after iters Lloyd      */
+/* steps of the coarse centers over the centers; with full set, the coarse   */
+/* centers start from every (numClusters/lists)-th center                    */
+static int build_index(kmeans_ctx *ctx,
+                       float     **clusters,    /* [numClusters][numCoords] */
+                       int         numCoords,
+                       int         numClusters,
+                       int         lists,
+                       int         full)
+{
+    int     i, j, l, it, iters = full ? IVF_BUILD_ITERS : 1;
+    float  *coarse = ctx->ivfCoarse;
+    int    *of     = ctx->ivfOf;
+    int    *count;
+    double *sum;
+
+    count = (int*)    calloc(lists + 1, sizeof(int));
+    sum   = (double*) malloc((size_t)lists * numCoords * sizeof(double));
+    if (count == NULL || sum == NULL) {
+        free(count); free(sum);
+        return 0;
+    }
+    if (full)
+        for (l=0; l<lists; l++)
+            memcpy(coarse + (size_t)l * numCoords,
+                   clusters[(int)((long long)l * numClusters / lists)],
+                   numCoords * sizeof(float));
+
+    for (it=0; it<=iters; it++) {
+        /* nearest coarse center of every center */
+        #pragma omp parallel for num_threads(ctx->nthreads) schedule(static) \
+                private(l)
+        for (i=0; i<numClusters; i++) {
+            float best = euclid_dist_2(numCoords, clusters[i], coarse);
+            of[i] = 0;
+            for (l=1; l<lists; l++) {
+                float d = euclid_dist_2(numCoords, clusters[i],
+                                        coarse + (size_t)l * numCoords);
+                if (d < best) { best = d; of[i] = l; }
+            }
+        }
+        if (it == iters) break;
+
+        /* the coarse centers to the mean of their centers; an empty list
+           keeps its coarse center */
+        memset(count, 0, lists * sizeof(int));
+        memset(sum,   0, (size_t)lists * numCoords * sizeof(double));
+        for (i=0; i<numClusters; i++) {
+            count[of[i]]++;
+            for (j=0; j<numCoords; j++)
+                sum[(size_t)of[i]*numCoords + j] += clusters[i][j];
+        }
+        for (l=0; l<lists; l++)
+            if (count[l] > 0)
+                for (j=0; j<numCoords; j++)
+                    coarse[(size_t)l*numCoords + j] =
+                        (float)(sum[(size_t)l*numCoords + j] / count[l]);
+    }
+
+    /* the lists, centers in increasing id, and their coordinates */
+    memset(count, 0, (lists + 1) * sizeof(int));
+    for (i=0; i<numClusters; i++) count[of[i] + 1]++;
+    for (l=0; l<lists; l++) count[l+1] += count[l];
+    memcpy(ctx->ivfOff, count, (lists + 1) * sizeof(int));
+    for (i=0; i<numClusters; i++) {
+        int pos = count[of[i]]++;
+        ctx->ivfIds[pos] = i;
+        memcpy(ctx->ivfVecs + (size_t)pos * numCoords, clusters[i],
+               numCoords * sizeof(float));
+    }
+    free(sum);
+    free(count);
+    ctx->ivfLists = lists;
+    return 1;
+}
+
+/*----< kmeans_pass_ivf() >--------------------------------------------------*/
+float kmeans_pass_ivf(kmeans_ctx *ctx,
+                      float     **objects,     /* [numObjs][numCoords] */
+                      int         numCoords,
+                      int         numObjs,
+                      int         numClusters,
+                      int        *membership,  /* in/out: [numObjs] */
+                      float     **clusters,    /* [numClusters][numCoords] */
+                      double     *sse)
+{
+    int    lists, probes;
+    size_t padK  = KMEANS_PAD((size_t)ctx->capClusters);
+    size_t padKD = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);
+    float  delta = 0.0;
+    double sum   = 0.0, coords = 0.0, checked = 0.0, mismatch = 0.0;
+
+    kmeans_ivf_shape(ctx, numClusters, &lists, &probes);
+    if (!reserve_ivf(ctx, numCoords, numClusters, lists)) return -1;
+    if (!build_index(ctx, clusters, numCoords, numClusters, lists,
+                     ctx->ivfLists != lists))
+        return -1;
+
+    #pragma omp parallel num_threads(ctx->nthreads) \
+            shared(objects,clusters,membership)
+    {
+        int    n, k, l, p, c, d, nprobe, index;
+        int    probe[KMEANS_IVF_MAX_PROBE];
+        float  probe_d[KMEANS_IVF_MAX_PROBE];
+        int    tid        = omp_get_thread_num();
+        int   *local_size = ctx->local_newClusterSize + tid * padK;
+        float *local_sum  = ctx->local_newClusters    + tid * padKD;
+
+        #pragma omp for schedule(static) \
+                reduction(+:delta,sum,coords,checked,mismatch)
+        for (n=0; n<numObjs; n++) {
+            const float *object = objects[n];
+            float  min_dist = FLT_MAX, dist;
+
+            /* the probes nearest coarse centers, nearest first */
+            nprobe = 0;
+            for (l=0; l<lists; l++) {
+                dist = euclid_dist_2(numCoords, object,
+                                     ctx->ivfCoarse + (size_t)l * numCoords);
+                if (nprobe == probes) {
+                    if (dist >= probe_d[nprobe-1]) continue;
+                    nprobe--;
+                }
+                for (p=nprobe; p>0 && probe_d[p-1] > dist; p--) {
+                    probe[p]   = probe[p-1];
+                    probe_d[p] = probe_d[p-1];
+                }
+                probe[p]   = l;
+                probe_d[p] = dist;
+                nprobe++;
+            }
+            coords += (double)lists * numCoords;
+
+            /* the centers of those lists; ties to the lowest id */
+            index = -1;
+            for (p=0; p<nprobe; p++) {
+                l = probe[p];
+                for (c=ctx->ivfOff[l]; c<ctx->ivfOff[l+1]; c++) {
+                    k    = ctx->ivfIds[c];
+                    dist = euclid_dist_2(numCoords, object,
+                                         ctx->ivfVecs + (size_t)c * numCoords);
+                    if (dist < min_dist || (dist == min_dist && k < index)) {
+                        min_dist = dist;
+                        index    = k;
+                    }
+                }
+                coords += (double)(ctx->ivfOff[l+1] - ctx->ivfOff[l]) * numCoords;
+            }
+
+            /* a sample of the objects also scans every center */
+            if (n % IVF_CHECK_STRIDE == 0) {
+                int   exact = 0;
+                float best  = euclid_dist_2(numCoords, object, clusters[0]);
+                for (k=1; k<numClusters; k++) {
+                    dist = euclid_dist_2(numCoords, object, clusters[k]);
+                    if (dist < best) { best = dist; exact = k; }
+                }
+                checked += 1.0;
+                if (exact != index) mismatch += 1.0;
+            }
+
+            sum += min_dist;
+            kmeans_far_offer(ctx, tid, n, min_dist);
+            if (membership[n] != index) delta += 1.0;
+            membership[n] = index;
+
+            local_size[index]++;
+            for (d=0; d<numCoords; d++)
+                local_sum[(size_t)index*numCoords + d] += object[d];
+        }
+
+        kmeans_reduce_local(ctx, numCoords, numClusters);
+    }
+
+    ctx->partialDims += coords;
+    ctx->ivfChecked  += checked;
+    ctx->ivfMismatch += mismatch;
+    *sse = sum;
+    return delta;
+}
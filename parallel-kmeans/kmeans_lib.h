@@ -0,0 +1,355 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_lib.h                                              */
+/*   Description:  public interface of the embeddable k-means library       */
+/*                 (libkmeans.a / libkmeans.so). All state needed by a      */
+/*                 clustering run lives in a kmeans_ctx, so a service can   */
+/*                 keep one context per worker and call kmeans_fit()        */
+/*                 repeatedly without reallocating its scratch buffers.     */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _H_KMEANS_LIB
+#define _H_KMEANS_LIB
+
+#include <stddef.h>     /* size_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* assignment engines, the same kernels as seq_kmeans.c, omp_kmeans.c and
+   omp_new_kmeans.c */
+typedef enum {
+    KMEANS_ENGINE_SEQ = 0,       /* sequential                              */
+    KMEANS_ENGINE_OMP_ATOMIC,    /* OpenMP, atomic center accumulation      */
+    KMEANS_ENGINE_OMP_REDUCTION, /* OpenMP, per-thread array reduction      */
+    KMEANS_ENGINE_OMP_TRANSPOSED,/* OpenMP, transposed centers [D][K]       */
+    KMEANS_ENGINE_OMP_TASKS,     /* OpenMP tasks on blocks of objects; from */
+                                 /* inside a parallel region the blocks run */
+                                 /* on the enclosing team                   */
+    KMEANS_ENGINE_POOL,          /* pthread work-stealing pool, no OpenMP   */
+                                 /* runtime in the pass                     */
+    KMEANS_ENGINE_SORTED,        /* counting sort by cluster, then one      */
+                                 /* contiguous sum per cluster: no atomics, */
+                                 /* same result for any no. threads         */
+    KMEANS_ENGINE_TILED,         /* centers in L2-sized tiles, each run     */
+                                 /* over a block of objects: for large K    */
+    KMEANS_ENGINE_SKETCH,        /* shortlist from random projections, then */
+                                 /* exact distances: for large numCoords    */
+    KMEANS_ENGINE_IVF            /* approximate: centers clustered into a   */
+                                 /* coarse index, only the nearest lists    */
+                                 /* are searched: for very large K          */
+} kmeans_engine;
+
+/* distances of kmeans_config.metric */
+typedef enum {
+    KMEANS_METRIC_L2 = 0,        /* squared Euclidean, any engine           */
+    KMEANS_METRIC_COSINE,        /* 1 - cos, unit centers (spherical)       */
+    KMEANS_METRIC_L1             /* sum of |x - c|, median centers          */
+} kmeans_metric;
+
+/* space-filling curves of kmeans_reorder() */
+typedef enum {
+    KMEANS_ORDER_NONE = 0,
+    KMEANS_ORDER_MORTON,         /* Z-order: interleaved coordinate bits    */
+    KMEANS_ORDER_HILBERT         /* Hilbert curve, no long jumps            */
+} kmeans_order;
+
+/* why the last fit ended */
+typedef enum {
+    KMEANS_STOP_CONVERGED = 0,   /* delta reached the threshold             */
+    KMEANS_STOP_MAX_LOOPS,       /* max_loops passes done                   */
+    KMEANS_STOP_MONITOR,         /* the monitor returned non-zero           */
+    KMEANS_STOP_BUDGET,          /* another pass would exceed time_budget   */
+    KMEANS_STOP_SIGNAL,          /* *stop became non-zero                   */
+    KMEANS_STOP_TREE             /* kmeans_fit_hierarchical() without flat
+                                    passes: the tree is the result          */
+} kmeans_stop;
+
+typedef struct {
+    kmeans_engine engine;
+    int    nthreads;    /* no. threads, 0 = run-time default */
+    float  threshold;   /* stop when this fraction of objects changes */
+    int    max_loops;   /* hard cap on the number of iterations */
+    int    debug;       /* print per-run diagnostics */
+    double time_budget; /* wall time of a fit (sec), 0 = no limit; the fit
+                           stops when the next pass is expected to end
+                           past the budget */
+    volatile int *stop; /* if not NULL, the fit stops after the pass in
+                           which *stop becomes non-zero, e.g. on SIGTERM */
+    int    async;       /* 1 = no barrier between assignment and update:
+                           a thread may run a pass on centers one update
+                           old (see kmeans_async.c); the engine and the
+                           monitor are not used */
+    int    tile_clusters;/* tiled engine: centers per tile, 0 = as many as
+                           fit in half the L2 cache */
+    int    partial;     /* 1 = partial distances: coordinates by decreasing
+                           variance, a center is dropped once its partial
+                           sum is above the best distance (seq, atomic,
+                           reduction, transposed and tasks engines) */
+    int    sketch_dims; /* sketch engine: random directions, 0 = numCoords/4
+                           up to 16 */
+    int    sketch_cands;/* sketch engine: centers shortlisted per object
+                           (at most 32), 0 = 4 */
+    int    ivf_lists;   /* ivf engine: coarse lists, 0 = sqrt(numClusters) */
+    int    ivf_nprobe;  /* ivf engine: lists searched per object (at most
+                           256), 0 = 4; more is nearer exact and slower */
+    int    freeze_after;/* kmeans_fit(): skip objects unchanged for this
+                           no. passes and far from the boundary of their
+                           cluster, 0 = never; not with async (see
+                           kmeans_freeze.c) */
+    int    freeze_verify;/* full pass over all objects every this no.
+                           passes, 0 = 5 */
+    kmeans_metric metric;/* other than L2: own kernels, the engine is not
+                           used; not with async, freeze_after or the MPI
+                           fit */
+    int    repair;      /* kmeans_fit(): after each pass reseed empty
+                           clusters (1), or empty and singleton ones (2),
+                           from the objects farthest from their center,
+                           0 = never; when set, clusters of one object
+                           move onto it too; not with async or the MPI
+                           fit (see kmeans_repair.c) */
+} kmeans_config;
+
+typedef struct {
+    int    loops;       /* iterations performed by the last fit */
+    float  delta;       /* fraction of objects changed in the last pass */
+    double sse;         /* sum of squared distances of the last pass */
+    double timing;      /* wall time of the last fit (sec) */
+    long   num_allocs;  /* scratch (re)allocations over the context life */
+    kmeans_stop stop_reason; /* why the last fit ended */
+    double dist_calcs;  /* object-center distances computed by the last fit */
+    int    best_restart;/* restart kept by kmeans_fit_restarts() */
+    int    abandoned;   /* restarts abandoned by kmeans_fit_restarts() */
+    double wait_time;   /* async: thread-seconds spent waiting for centers */
+    int    stale_passes;/* async: thread-passes run on centers one update old */
+    double dims_per_dist;/* coordinates summed per object-center distance,
+                           numCoords unless cfg.partial or the sketch
+                           or ivf engine */
+    double fallback_rate;/* sketch engine: fraction of objects whose
+                           shortlist margin was too small */
+    double mismatch_rate;/* ivf engine: fraction of a sample of objects
+                           assigned to another center than the exact one */
+    double frozen_rate; /* freeze_after: fraction of the object-passes
+                           skipped */
+    double stale_rate;  /* freeze_after: fraction of the objects found
+                           frozen in the wrong cluster by the full passes */
+    int    repairs;     /* repair: clusters reseeded by the last fit */
+    double tree_dist_calcs;/* kmeans_fit_hierarchical(): distances of the
+                           splits, part of dist_calcs */
+} kmeans_stats;
+
+/* backing of the long-lived buffers, see kmeans_arena.c */
+typedef enum {
+    KMEANS_PAGES_SMALL = 0,      /* posix_memalign() only                  */
+    KMEANS_PAGES_THP,            /* default: buffers of a huge page or more */
+                                 /* mapped huge-page aligned, with         */
+                                 /* madvise(MADV_HUGEPAGE)                 */
+    KMEANS_PAGES_EXPLICIT        /* MAP_HUGETLB from the reserved pool,    */
+                                 /* else as THP                            */
+} kmeans_pages;
+
+/* allocator counters of kmeans_arena_stats() */
+typedef struct {
+    long   regions;       /* blocks handed out so far */
+    long   huge_explicit; /* of them, on reserved huge pages */
+    long   huge_thp;      /* of them, huge-page aligned for THP */
+    double bytes;         /* in use now */
+    double peak_bytes;    /* most in use at once */
+    long   minor_faults;  /* page faults of the process so far */
+    long   major_faults;
+} kmeans_mem_stats;
+
+/* seeded restarts of kmeans_fit_restarts() */
+typedef struct {
+    int      n_init;        /* no. restarts, run concurrently */
+    unsigned seed;          /* restart r > 0 starts from numClusters distinct
+                               objects drawn with seed + r */
+    int      abandon_after; /* passes before a restart may be abandoned,
+                               0 = run every restart to the end */
+    float    abandon_ratio; /* abandon a restart whose SSE is above ratio
+                               times the lowest SSE seen at the same pass */
+} kmeans_restart_config;
+
+/* decision of kmeans_plan() */
+typedef struct {
+    kmeans_engine engine;
+    int    partial;     /* early abandon, kmeans_config.partial */
+    int    nthreads;
+    int    probes;      /* candidates timed, 0 = from the tuning file or
+                           a fit too small to probe */
+    double pass_time;   /* time of one pass of the choice over the sample
+                           (sec), 0 if not probed */
+    double probe_time;  /* wall time of kmeans_plan() (sec) */
+} kmeans_plan_result;
+
+/* called after every update step with the pass number (from 0), the SSE
+   and the fraction of changed objects of the pass and the updated centers;
+   a non-zero return value stops the fit */
+typedef int (*kmeans_monitor)(void *arg, int loop, double sse, float delta,
+                              float **clusters);
+
+typedef struct kmeans_ctx kmeans_ctx;
+
+const char* kmeans_engine_name(kmeans_engine);
+int         kmeans_engine_parse(const char*, kmeans_engine*);
+const char* kmeans_stop_name(kmeans_stop);
+const char* kmeans_metric_name(kmeans_metric);
+int         kmeans_metric_parse(const char*, kmeans_metric*);
+
+void        kmeans_config_init(kmeans_config*);
+
+const char* kmeans_pages_name(kmeans_pages);
+int         kmeans_pages_parse(const char*, kmeans_pages*);
+void        kmeans_arena_set_pages(kmeans_pages);
+void*       kmeans_arena_alloc(size_t);   /* KMEANS_ALIGN aligned */
+void        kmeans_arena_free(void*);
+void        kmeans_arena_stats(kmeans_mem_stats*);
+
+kmeans_ctx* kmeans_ctx_create(const kmeans_config*);
+void        kmeans_ctx_destroy(kmeans_ctx*);
+int         kmeans_ctx_configure(kmeans_ctx*, const kmeans_config*);
+const kmeans_config* kmeans_ctx_config(const kmeans_ctx*);
+const kmeans_stats*  kmeans_ctx_stats(const kmeans_ctx*);
+void        kmeans_ctx_set_monitor(kmeans_ctx*, kmeans_monitor, void *arg);
+
+void        kmeans_restart_config_init(kmeans_restart_config*);
+int         kmeans_restarts_shared(kmeans_engine);  /* 1: one team */
+
+/* set cfg->engine, cfg->partial and cfg->nthreads for a fit of the objects
+   from the centers in clusters: tiny fits run seq; other decisions are
+   read from the tuning file or, the first time for this host and shape
+   class, timed by one probe pass per candidate over a sample and then
+   appended to it. With cfg->nthreads > 0 only the engine is chosen;
+   tuning_file NULL is $HOME/.kmeans_tuning.<host>. Returns 1 on success, 0 on failure */
+int kmeans_plan(kmeans_config      *cfg,          /* in/out */
+                float             **objects,      /* in: [numObjs][numCoords] */
+                int                 numCoords,
+                int                 numObjs,
+                int                 numClusters,
+                float             **clusters,     /* in: [numClusters][numCoords] */
+                const char         *tuning_file,
+                kmeans_plan_result *plan);        /* out */
+
+/* cluster objects[numObjs][numCoords] starting from the centers passed in
+   clusters[numClusters][numCoords]; returns 1 on success, 0 on failure */
+int kmeans_fit(kmeans_ctx *ctx,
+               float     **objects,      /* in: [numObjs][numCoords] */
+               int         numCoords,    /* no. coordinates */
+               int         numObjs,      /* no. objects */
+               int         numClusters,  /* no. clusters */
+               int        *membership,   /* out: [numObjs] */
+               float     **clusters);    /* in/out: [numClusters][numCoords] */
+
+/* run rc->n_init fits over the same objects and keep the centers and
+   membership of the lowest final SSE. Restart 0 starts from the centers
+   passed in clusters, the others from random objects. Every restart runs
+   the engine of the context: with tasks or seq they run concurrently on one
+   shared team, with the others one after another
+   (kmeans_restarts_shared()); restarts that fall clearly behind are
+   abandoned. Not with async. Returns 1 on success, 0 on failure */
+int kmeans_fit_restarts(kmeans_ctx *ctx,
+                        float     **objects,      /* in: [numObjs][numCoords] */
+                        int         numCoords,
+                        int         numObjs,
+                        int         numClusters,
+                        const kmeans_restart_config *rc,
+                        int        *membership,   /* out: [numObjs] */
+                        float     **clusters);    /* in/out: [numClusters][numCoords] */
+
+/* top-down fit for a large K: the objects are split by fits of branch
+   centers (2 = bisecting, at most 10 passes each), each part gets a share
+   of the clusters by its SSE and is split again, down to single clusters;
+   the parts are OpenMP tasks of one team. Then at most refine flat passes
+   of kmeans_fit() start from the centers found; with refine = 0 the stop
+   reason is KMEANS_STOP_TREE and loops is 0. clusters needs no initial
+   centers. Returns 1 on success, 0 on failure */
+int kmeans_fit_hierarchical(kmeans_ctx *ctx,
+                            float     **objects,      /* in: [numObjs][numCoords] */
+                            int         numCoords,
+                            int         numObjs,
+                            int         numClusters,
+                            int         branch,
+                            int         refine,
+                            int        *membership,   /* out: [numObjs] */
+                            float     **clusters);    /* out: [numClusters][numCoords] */
+
+/* re-cluster after objects were appended: objects[0..numOld-1] come with
+   their membership, the first numBounded of them also with the upper and
+   lower distance bounds returned by an earlier call, and clusters holds
+   the centers they were computed for. Objects that provably cannot change
+   cluster are skipped. On return upper[] and lower[] hold valid bounds of
+   all numObjs objects for the returned centers. Returns 1 on success */
+int kmeans_fit_incremental(kmeans_ctx *ctx,
+                           float     **objects,     /* in: [numObjs][numCoords] */
+                           int         numCoords,
+                           int         numObjs,     /* old + appended objects */
+                           int         numClusters,
+                           int         numOld,      /* objects with a membership */
+                           int         numBounded,  /* objects with bounds, <= numOld */
+                           int        *membership,  /* in/out: [numObjs] */
+                           float     **clusters,    /* in/out: [numClusters][numCoords] */
+                           float      *upper,       /* in/out: [numObjs] */
+                           float      *lower);      /* in/out: [numObjs] */
+
+/* warm start for a larger K: grow the numClusters centers of a finished
+   fit to newClusters by splitting the cluster with the largest SSE, as
+   given by membership[], until there are enough; when none can be split,
+   the new centers are objects not on a center already. clusters must have
+   room for newClusters rows. Returns 1 on success, 0 on failure or when
+   there are fewer distinct objects than newClusters */
+int kmeans_split_centers(float     **objects,     /* in: [numObjs][numCoords] */
+                         int         numCoords,
+                         int         numObjs,
+                         const int  *membership,  /* in: [numObjs] */
+                         int         numClusters,
+                         int         newClusters,
+                         float     **clusters);   /* in/out: [newClusters][numCoords] */
+
+/* keep clusters[numClusters][numCoords] resident as the model of
+   kmeans_predict(); returns 1 on success, 0 on failure */
+int kmeans_set_centers(kmeans_ctx *ctx,
+                       float     **clusters,     /* in: [numClusters][numCoords] */
+                       int         numCoords,
+                       int         numClusters);
+
+/* assign objects to the nearest model center, no update step; distances
+   (squared) are written only if the pointer is not NULL */
+int kmeans_predict(kmeans_ctx *ctx,
+                   float     **objects,      /* in: [numObjs][numCoords] */
+                   int         numObjs,
+                   int        *membership,   /* out: [numObjs] */
+                   float      *distances);
+
+/* cluster -> objects index left by the last pass of the sorted engine: the
+   objects of cluster k are order[offsets[k] .. offsets[k+1]-1], ascending.
+   The arrays belong to the context; returns 0 if there is no index */
+int kmeans_cluster_index(const kmeans_ctx *ctx,
+                         int              *numObjs,
+                         int              *numClusters,
+                         const int       **offsets,   /* [numClusters+1] */
+                         const int       **order);    /* [numObjs] */
+
+/* the same index from any membership[]; offsets has numClusters+1 entries */
+int kmeans_build_index(const int *membership, int numObjs, int numClusters,
+                       int *offsets, int *order);   /* out: [numObjs] or NULL */
+
+/* reorder the rows of objects along a space-filling curve, for locality in
+   the fit; perm[i] is the input position of the new row i. Results of a fit
+   on the reordered objects go back to input order with
+   kmeans_restore_order() */
+int kmeans_reorder(float **objects, int numCoords, int numObjs,
+                   kmeans_order order, int *perm);
+int kmeans_restore_order(const int *perm, int numObjs, int *membership);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,352 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_metric.c                                           */
+/*   Description:  distances other than the squared Euclidean one           */
+/*                 (cfg.metric); squared L2 is the kernels of the engines.  */
+/*                 Each other metric is a distance macro; the               */
+/*                 macros METRIC_NEAREST and METRIC_PASS below expand one   */
+/*                 nearest-center kernel and one assignment pass per        */
+/*                 metric, so the metric is fixed at compile time inside    */
+/*                 the loops and the inner loop over coordinates is a plain */
+/*                 simd reduction. kmeans_pass() picks the pass once per    */
+/*                 pass, and kmeans_metric_update() finishes the update     */
+/*                 step of the metric:                                      */
+/*                   cosine: spherical k-means. The nearest center has the  */
+/*                           largest dot product with the object over its   */
+/*                           norm; centers are the mean of the normalized   */
+/*                           objects, renormalized to unit length.          */
+/*                   l1:     k-medians. Centers are the per-coordinate      */
+/*                           median of their objects.                       */
+/*                 A new metric is a distance macro, two expansions and a   */
+/*                 case in kmeans_pass_metric().                            */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+static const char *metric_names[] = { "l2", "cosine", "l1" };
+#define NUM_METRICS (int)(sizeof(metric_names)/sizeof(metric_names[0]))
+
+const char* kmeans_metric_name(kmeans_metric metric)
+{
+    if ((int)metric < 0 || (int)metric >= NUM_METRICS) return "unknown";
+    return metric_names[metric];
+}
+
+int kmeans_metric_parse(const char *name, kmeans_metric *metric)
+{
+    int i;
+    for (i=0; i<NUM_METRICS; i++)
+        if (strcmp(name, metric_names[i]) == 0) {
+            *metric = (kmeans_metric) i;
+            return 1;
+        }
+    return 0;
+}
+
+/*----< distances >----------------------------------------------------------*/
+/* d(x, center k); w[k] is a per-center weight, the inverse norm for cosine  */
+static inline float dist_l1(int numCoords, const float *x, const float *c)
+{
+    int   j;
+    float ans = 0.0;
+    #pragma omp simd reduction(+:ans)
+    for (j=0; j<numCoords; j++)
+        ans += fabsf(x[j] - c[j]);
+    return ans;
+}
+
+static inline float neg_dot(int numCoords, const float *x, const float *c)
+{
+    int   j;
+    float ans = 0.0;
+    #pragma omp simd reduction(+:ans)
+    for (j=0; j<numCoords; j++)
+        ans += x[j] * c[j];
+    return -ans;
+}
+
+#define DIST_L1(D, x, clusters, w, k)  dist_l1(D, x, clusters[k])
+#define DIST_COS(D, x, clusters, w, k) (neg_dot(D, x, clusters[k]) * w[k])
+
+/*----< METRIC_NEAREST() >---------------------------------------------------*/
+/* nearest center by DIST, ties to the lowest index                          */
+#define METRIC_NEAREST(NAME, DIST)                                           \
+static inline int NAME(const float  *x,                                      \
+                       float       **clusters,                               \
+                       const float  *w,                                      \
+                       int           numCoords,                              \
+                       int           numClusters,                            \
+                       float        *min_dist)                               \
+{                                                                            \
+    int   k, index = 0;                                                      \
+    float dist, best = DIST(numCoords, x, clusters, w, 0);                   \
+    for (k=1; k<numClusters; k++) {                                          \
+        dist = DIST(numCoords, x, clusters, w, k);                           \
+        if (dist < best) { best = dist; index = k; }                         \
+    }                                                                        \
+    *min_dist = best;                                                        \
+    return index;                                                            \
+}
+
+METRIC_NEAREST(nearest_l1,  DIST_L1)
+METRIC_NEAREST(nearest_cos, DIST_COS)
+
+/*----< METRIC_PASS() >------------------------------------------------------*/
+/* an assignment pass with NEAREST; with COSINE (a constant) the distance   */
+/* becomes 1 - cos and the sums are of the normalized objects               */
+#define METRIC_PASS(NAME, NEAREST, COSINE)                                   \
+static float NAME(kmeans_ctx *ctx,                                           \
+                  float     **objects,                                       \
+                  int         numCoords,                                     \
+                  int         numObjs,                                       \
+                  int         numClusters,                                   \
+                  int        *membership,                                    \
+                  float     **clusters,                                      \
+                  const float *w,                                            \
+                  double     *sse)                                           \
+{                                                                            \
+    size_t padK  = KMEANS_PAD((size_t)ctx->capClusters);                     \
+    size_t padKD = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);    \
+    float  delta = 0.0;                                                      \
+    double sum   = 0.0;                                                      \
+                                                                             \
+    _Pragma("omp parallel num_threads(ctx->nthreads)")                       \
+    {                                                                        \
+        int    n, d, index;                                                  \
+        float  dist, scale;                                                  \
+        int    tid        = omp_get_thread_num();                            \
+        int   *local_size = ctx->local_newClusterSize + tid * padK;          \
+        float *local_sum  = ctx->local_newClusters    + tid * padKD;         \
+                                                                             \
+        _Pragma("omp for schedule(static) reduction(+:delta,sum)")           \
+        for (n=0; n<numObjs; n++) {                                          \
+            const float *x = objects[n];                                     \
+            index = NEAREST(x, clusters, w, numCoords, numClusters, &dist);  \
+            scale = 1.0f;                                                    \
+            if (COSINE) {                                                    \
+                float norm = sqrtf(-neg_dot(numCoords, x, x));               \
+                scale = (norm > 0.0f) ? 1.0f / norm : 0.0f;                  \
+                dist  = 1.0f + dist * scale;                                 \
+            }                                                                \
+            sum += dist;                                                     \
+            kmeans_far_offer(ctx, tid, n, dist);                             \
+            if (membership[n] != index) delta += 1.0;                        \
+            membership[n] = index;                                           \
+                                                                             \
+            local_size[index]++;                                             \
+            for (d=0; d<numCoords; d++)                                      \
+                local_sum[(size_t)index*numCoords + d] += x[d] * scale;      \
+        }                                                                    \
+                                                                             \
+        kmeans_reduce_local(ctx, numCoords, numClusters);                    \
+    }                                                                        \
+    *sse = sum;                                                              \
+    return delta;                                                            \
+}
+
+METRIC_PASS(pass_l1,  nearest_l1,  0)
+METRIC_PASS(pass_cos, nearest_cos, 1)
+
+/*----< kmeans_pass_metric() >-----------------------------------------------*/
+/* the pass of cfg.metric; squared L2 stays with the engines                 */
+float kmeans_pass_metric(kmeans_ctx *ctx,
+                         float     **objects,     /* [numObjs][numCoords] */
+                         int         numCoords,
+                         int         numObjs,
+                         int         numClusters,
+                         int        *membership,  /* in/out: [numObjs] */
+                         float     **clusters,    /* [numClusters][numCoords] */
+                         double     *sse)
+{
+    int    k;
+    float *w = ctx->clustersT;  /* [numClusters] center weights */
+
+    ctx->partialDims += (double)numObjs * numClusters * numCoords;
+    switch (ctx->cfg.metric) {
+        case KMEANS_METRIC_L1:
+            return pass_l1(ctx, objects, numCoords, numObjs, numClusters,
+                           membership, clusters, w, sse);
+        case KMEANS_METRIC_COSINE:
+            /* initial centers need not have unit length */
+            for (k=0; k<numClusters; k++) {
+                float norm = sqrtf(-neg_dot(numCoords, clusters[k], clusters[k]));
+                w[k] = (norm > 0.0f) ? 1.0f / norm : 0.0f;
+            }
+            return pass_cos(ctx, objects, numCoords, numObjs, numClusters,
+                            membership, clusters, w, sse);
+        default:
+            return -1;
+    }
+}
+
+/*----< select_kth() >-------------------------------------------------------*/
+/* the k-th smallest of a[0..n-1] (Hoare's quickselect); a is reordered      */
+static float select_kth(float *a, int n, int k)
+{
+    int lo = 0, hi = n - 1;
+
+    while (lo < hi) {
+        float pivot = a[lo + (hi - lo) / 2];
+        int   i = lo, j = hi;
+        while (i <= j) {
+            while (a[i] < pivot) i++;
+            while (a[j] > pivot) j--;
+            if (i <= j) {
+                float t = a[i]; a[i] = a[j]; a[j] = t;
+                i++; j--;
+            }
+        }
+        if      (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else             break;
+    }
+    return a[k];
+}
+
+/*----< kmeans_metric_dist() >-----------------------------------------------*/
+/* d(x, c) as the passes of the metric add it to the SSE                     */
+float kmeans_metric_dist(kmeans_metric metric,
+                         int           numCoords,
+                         const float  *x,
+                         const float  *c)
+{
+    int   j;
+    float nx, nc, ans = 0.0;
+
+    switch (metric) {
+        case KMEANS_METRIC_L1:
+            return dist_l1(numCoords, x, c);
+        case KMEANS_METRIC_COSINE:
+            nx = sqrtf(-neg_dot(numCoords, x, x));
+            nc = sqrtf(-neg_dot(numCoords, c, c));
+            if (nx == 0.0f || nc == 0.0f) return 1.0f;
+            return 1.0f + neg_dot(numCoords, x, c) / (nx * nc);
+        default:
+            for (j=0; j<numCoords; j++)
+                ans += (x[j] - c[j]) * (x[j] - c[j]);
+            return ans;
+    }
+}
+
+/*----< kmeans_metric_center() >---------------------------------------------*/
+/* the center the update step of the metric gives the n objects objs[]:     */
+/* their mean, the unit mean of their directions, or their median; 1 on     */
+/* success                                                                   */
+int kmeans_metric_center(kmeans_metric metric,
+                         float       **objs,       /* [n][numCoords] */
+                         int           n,
+                         int           numCoords,
+                         float        *center)     /* out: [numCoords] */
+{
+    int     i, j;
+    float   norm, *buf;
+    double *sum;
+
+    if (metric == KMEANS_METRIC_L1) {
+        if ((buf = (float*) malloc((size_t)n * sizeof(float))) == NULL)
+            return 0;
+        for (j=0; j<numCoords; j++) {
+            for (i=0; i<n; i++) buf[i] = objs[i][j];
+            center[j] = select_kth(buf, n, (n - 1) / 2);
+        }
+        free(buf);
+        return 1;
+    }
+
+    if ((sum = (double*) calloc(numCoords, sizeof(double))) == NULL)
+        return 0;
+    for (i=0; i<n; i++) {
+        float scale = 1.0f;
+        if (metric == KMEANS_METRIC_COSINE) {
+            norm  = sqrtf(-neg_dot(numCoords, objs[i], objs[i]));
+            scale = (norm > 0.0f) ? 1.0f / norm : 0.0f;
+        }
+        for (j=0; j<numCoords; j++) sum[j] += objs[i][j] * scale;
+    }
+    for (j=0; j<numCoords; j++) center[j] = (float)(sum[j] / n);
+    free(sum);
+
+    if (metric == KMEANS_METRIC_COSINE) {
+        norm = sqrtf(-neg_dot(numCoords, center, center));
+        if (norm > 0.0f)
+            for (j=0; j<numCoords; j++) center[j] /= norm;
+    }
+    return 1;
+}
+
+/*----< kmeans_metric_update() >---------------------------------------------*/
+/* after kmeans_update_centers(): unit centers for cosine, medians for l1    */
+int kmeans_metric_update(kmeans_ctx *ctx,
+                         float     **objects,     /* [numObjs][numCoords] */
+                         int         numCoords,
+                         int         numObjs,
+                         int         numClusters,
+                         const int  *membership,  /* [numObjs] */
+                         float     **clusters)    /* in/out: [numClusters][numCoords] */
+{
+    int  i, k, *offsets, *order, failed = 0;
+
+    if (ctx->cfg.metric == KMEANS_METRIC_COSINE) {
+        for (k=0; k<numClusters; k++) {
+            float norm = sqrtf(-neg_dot(numCoords, clusters[k], clusters[k]));
+            if (norm > 0.0f)
+                for (i=0; i<numCoords; i++) clusters[k][i] /= norm;
+        }
+        return 1;
+    }
+    if (ctx->cfg.metric != KMEANS_METRIC_L1) return 1;
+
+    offsets = (int*) malloc((numClusters + 1) * sizeof(int));
+    order   = (int*) malloc((size_t)numObjs * sizeof(int));
+    if (offsets == NULL || order == NULL ||
+        !kmeans_build_index(membership, numObjs, numClusters, offsets, order)) {
+        free(offsets); free(order);
+        return 0;
+    }
+
+    #pragma omp parallel num_threads(ctx->nthreads) private(i,k)
+    {
+        float *buf = NULL;
+        int    cap = 0, j;
+
+        #pragma omp for schedule(dynamic)
+        for (k=0; k<numClusters; k++) {
+            int size = offsets[k+1] - offsets[k];
+            /* as kmeans_update_centers() */
+            if (size == 0 || (size == 1 && !ctx->cfg.repair)) continue;
+            if (size > cap) {
+                free(buf);
+                cap = size;
+                buf = (float*) malloc(cap * sizeof(float));
+                if (buf == NULL) {
+                    cap = 0;
+                    #pragma omp atomic write
+                    failed = 1;
+                    continue;
+                }
+            }
+            /* the lower median of each coordinate */
+            for (j=0; j<numCoords; j++) {
+                for (i=0; i<size; i++)
+                    buf[i] = objects[order[offsets[k] + i]][j];
+                clusters[k][j] = select_kth(buf, size, (size - 1) / 2);
+            }
+        }
+        free(buf);
+    }
+    free(order);
+    free(offsets);
+    return !failed;
+}
@@ -0,0 +1,136 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_partial.c                                          */
+/*   Description:  set-up of the partial-distance search (cfg.partial). In  */
+/*                 many dimensions most centers are further from an object  */
+/*                 than its nearest one already after a part of the         */
+/*                 coordinates. The coordinates are put in decreasing order */
+/*                 of variance, so the sums grow fastest first, and the     */
+/*                 kernels in kmeans_internal.h drop a center as soon as    */
+/*                 its partial sum is above the best full distance.         */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+typedef struct {
+    double var;
+    int    dim;
+} dim_var;
+
+/* decreasing variance, then increasing coordinate */
+static int cmp_dim_var(const void *a, const void *b)
+{
+    const dim_var *x = (const dim_var*)a, *y = (const dim_var*)b;
+    if (x->var != y->var) return (x->var < y->var) ? 1 : -1;
+    return x->dim - y->dim;
+}
+
+/*----< kmeans_partial_engine() >--------------------------------------------*/
+/* engines that run the partial search when cfg.partial is set; the others   */
+/* compute every distance in full                                            */
+int kmeans_partial_engine(kmeans_engine engine)
+{
+    return (engine == KMEANS_ENGINE_SEQ           ||
+            engine == KMEANS_ENGINE_OMP_ATOMIC    ||
+            engine == KMEANS_ENGINE_OMP_REDUCTION ||
+            engine == KMEANS_ENGINE_OMP_TRANSPOSED||
+            engine == KMEANS_ENGINE_OMP_TASKS);
+}
+
+/*----< reserve_partial() >--------------------------------------------------*/
+static int reserve_partial(kmeans_ctx *ctx, int numCoords, int numClusters)
+{
+    int nthreads = ctx->nthreads;
+
+    if (numCoords   <= ctx->capPartialCoords   &&
+        numClusters <= ctx->capPartialClusters &&
+        nthreads    <= ctx->capPartialThreads)
+        return 1;
+
+    if (numCoords   < ctx->capPartialCoords)   numCoords   = ctx->capPartialCoords;
+    if (numClusters < ctx->capPartialClusters) numClusters = ctx->capPartialClusters;
+    if (nthreads    < ctx->capPartialThreads)  nthreads    = ctx->capPartialThreads;
+
+    kmeans_aligned_free(ctx->dimOrder);
+    kmeans_aligned_free(ctx->partialC);
+    kmeans_aligned_free(ctx->partialObj);
+    kmeans_aligned_free(ctx->partialCand);
+    ctx->dimOrder    = (int*)   kmeans_aligned_alloc(numCoords * sizeof(int));
+    ctx->partialC    = (float*) kmeans_aligned_alloc((size_t)numClusters *
+                                KMEANS_PAD((size_t)numCoords) * sizeof(float));
+    ctx->partialObj  = (float*) kmeans_aligned_alloc((size_t)nthreads *
+                                KMEANS_PAD((size_t)numCoords) * sizeof(float));
+    ctx->partialCand = (int*)   kmeans_aligned_alloc((size_t)nthreads *
+                                KMEANS_PAD((size_t)numClusters) * sizeof(int));
+    ctx->stats.num_allocs++;
+    ctx->partialReady = 0;
+
+    if (ctx->dimOrder == NULL || ctx->partialC == NULL ||
+        ctx->partialObj == NULL || ctx->partialCand == NULL) {
+        ctx->capPartialCoords = ctx->capPartialClusters = ctx->capPartialThreads = 0;
+        return 0;
+    }
+    ctx->capPartialCoords   = numCoords;
+    ctx->capPartialClusters = numClusters;
+    ctx->capPartialThreads  = nthreads;
+    return 1;
+}
+
+/*----< kmeans_partial_setup() >---------------------------------------------*/
+/* before a pass: on the first pass of a fit, order the coordinates by their */
+/* variance over objects; then copy the centers in that order                */
+int kmeans_partial_setup(kmeans_ctx *ctx,
+                         float     **objects,     /* [numObjs][numCoords] */
+                         int         numCoords,
+                         int         numObjs,
+                         int         numClusters,
+                         float     **clusters)    /* [numClusters][numCoords] */
+{
+    int    i, j;
+    size_t ldD = KMEANS_PAD((size_t)numCoords);
+
+    if (!reserve_partial(ctx, numCoords, numClusters)) return 0;
+
+    if (!ctx->partialReady) {
+        dim_var *dv  = (dim_var*) malloc(numCoords * sizeof(dim_var));
+        double  *sum = (double*)  calloc(numCoords, sizeof(double));
+        if (dv == NULL || sum == NULL) {
+            free(dv); free(sum);
+            return 0;
+        }
+        for (j=0; j<numCoords; j++) dv[j].var = 0.0;
+        for (i=0; i<numObjs; i++)
+            for (j=0; j<numCoords; j++) {
+                sum[j]    += objects[i][j];
+                dv[j].var += (double)objects[i][j] * objects[i][j];
+            }
+        for (j=0; j<numCoords; j++) {
+            double mean = sum[j] / numObjs;
+            dv[j].var = dv[j].var / numObjs - mean * mean;
+            dv[j].dim = j;
+        }
+        qsort(dv, numCoords, sizeof(dim_var), cmp_dim_var);
+        for (j=0; j<numCoords; j++) ctx->dimOrder[j] = dv[j].dim;
+        free(sum);
+        free(dv);
+        ctx->partialReady = 1;
+    }
+
+    for (i=0; i<numClusters; i++) {
+        float *c = ctx->partialC + i * ldD;
+        for (j=0; j<numCoords; j++) c[j] = clusters[i][ctx->dimOrder[j]];
+        for (; j<(int)ldD; j++)     c[j] = 0.0;
+    }
+    return 1;
+}
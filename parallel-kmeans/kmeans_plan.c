@@ -0,0 +1,289 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_plan.c                                             */
+/*   Description:  choice of the engine and no. threads of a fit. A tiny    */
+/*                 fit is all thread startup and runs sequentially; a large */
+/*                 one wants every core, and which engine is fastest        */
+/*                 depends on numClusters, numCoords and the caches. Other  */
+/*                 fits are decided by micro-probes: one timed pass of each */
+/*                 candidate (seq; reduction, transposed, tiled when the    */
+/*                 centers outgrow half the L2 cache, and transposed with  */
+/*                 early abandon for many coordinates; at 1, 2, 4, ...     */
+/*                 threads up to the no. cores) over a sample of the       */
+/*                 objects. The winner is appended to a per-host tuning    */
+/*                 file under the power-of-two class of numObjs,           */
+/*                 numClusters and numCoords, so later fits of that class  */
+/*                 read it back without probing.                            */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* sysconf(), gethostname() */
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+#define PLAN_TINY     (1L << 16)    /* numObjs*numClusters*numCoords run seq */
+#define PLAN_WORK     (1L << 24)    /* coordinates summed by one probe pass */
+#define PLAN_MIN_OBJS 1024          /* smallest sample */
+#define PLAN_SLACK    1.05          /* fewer threads win within 5% */
+#define PLAN_L2_BYTES (256 * 1024)  /* when the L2 size is not known */
+#define PLAN_PARTIAL_COORDS 16      /* early abandon needs this many coords */
+
+typedef struct {
+    kmeans_engine engine;
+    int           partial;
+} plan_cand;
+
+/*----< plan_class() >-------------------------------------------------------*/
+/* smallest b with 2^b >= n                                                  */
+static int plan_class(long n)
+{
+    int b = 0;
+    while ((1L << b) < n) b++;
+    return b;
+}
+
+/*----< plan_file() >--------------------------------------------------------*/
+/* tuning_file, or $HOME/.kmeans_tuning.<host>                               */
+static void plan_file(const char *tuning_file, char *path, size_t len)
+{
+    char        host[256];
+    const char *home = getenv("HOME");
+
+    if (tuning_file != NULL) {
+        snprintf(path, len, "%s", tuning_file);
+        return;
+    }
+    if (gethostname(host, sizeof(host)) != 0) strcpy(host, "localhost");
+    host[sizeof(host) - 1] = '\0';
+    snprintf(path, len, "%s/.kmeans_tuning.%s",
+             (home != NULL) ? home : ".", host);
+}
+
+/*----< plan_lookup() >------------------------------------------------------*/
+/* the last decision of the file for the class key[]; 1 if found            */
+static int plan_lookup(const char *path, const int key[5],
+                       kmeans_plan_result *plan)
+{
+    FILE  *fp;
+    char   line[256], name[32];
+    int    k[5], partial, nthreads, found = 0;
+    double pass_time;
+
+    if ((fp = fopen(path, "r")) == NULL) return 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        kmeans_engine engine;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%d %d %d %d %d %31s %d %d %lf", &k[0], &k[1],
+                   &k[2], &k[3], &k[4], name, &partial, &nthreads,
+                   &pass_time) != 9)
+            continue;
+        if (memcmp(k, key, sizeof(k)) != 0 || nthreads <= 0 ||
+            !kmeans_engine_parse(name, &engine))
+            continue;
+        plan->engine    = engine;
+        plan->partial   = partial;
+        plan->nthreads  = nthreads;
+        plan->pass_time = pass_time;
+        found = 1;
+    }
+    fclose(fp);
+    return found;
+}
+
+/*----< plan_store() >-------------------------------------------------------*/
+static void plan_store(const char *path, const int key[5],
+                       const kmeans_plan_result *plan)
+{
+    FILE *fp;
+    int   is_new = (access(path, F_OK) != 0);
+
+    if ((fp = fopen(path, "a")) == NULL) return;    /* probed again next time */
+    if (is_new)
+        fprintf(fp, "# kmeans_plan(): log2 numObjs numClusters numCoords, "
+                    "cores, fixed threads (0 = none), engine partial nthreads "
+                    "sample pass (sec)\n");
+    fprintf(fp, "%d %d %d %d %d %s %d %d %g\n", key[0], key[1], key[2],
+            key[3], key[4], kmeans_engine_name(plan->engine), plan->partial,
+            plan->nthreads, plan->pass_time);
+    fclose(fp);
+}
+
+/*----< plan_probe() >-------------------------------------------------------*/
+/* wall time of one pass of cfg over the sample, after a first pass that    */
+/* sizes the scratch and builds whatever the engine keeps; < 0 on failure   */
+static double plan_probe(const kmeans_config *cfg,
+                         float              **sample,
+                         int                  numCoords,
+                         int                  numSample,
+                         int                  numClusters,
+                         float              **clusters,
+                         int                 *membership)
+{
+    int         i, r;
+    double      sse, t = -1.0;
+    kmeans_ctx *ctx = kmeans_ctx_create(cfg);
+
+    if (ctx == NULL) return -1.0;
+    if (kmeans_fit_prepare(ctx, numCoords, numClusters)) {
+        for (i=0; i<numSample; i++) membership[i] = -1;
+        for (r=0; r<2; r++) {
+            t = omp_get_wtime();
+            if (kmeans_pass(ctx, sample, numCoords, numSample, numClusters,
+                            membership, clusters, &sse) < 0) {
+                t = -1.0;
+                break;
+            }
+            t = omp_get_wtime() - t;
+            /* the centers stay as they are */
+            memset(ctx->newClusters, 0,
+                   (size_t)numClusters * numCoords * sizeof(float));
+            memset(ctx->newClusterSize, 0, numClusters * sizeof(int));
+        }
+    }
+    kmeans_ctx_destroy(ctx);
+    return t;
+}
+
+/*----< kmeans_plan() >------------------------------------------------------*/
+int kmeans_plan(kmeans_config      *cfg,          /* in/out */
+                float             **objects,      /* in: [numObjs][numCoords] */
+                int                 numCoords,
+                int                 numObjs,
+                int                 numClusters,
+                float             **clusters,     /* in: [numClusters][numCoords] */
+                const char         *tuning_file,  /* NULL = per-host default */
+                kmeans_plan_result *plan)         /* out */
+{
+    int           i, c, t, ncands, numSample, cores, fixedThreads;
+    int           key[5], *membership;
+    long          l2 = 0;
+    double        start, best, pass;
+    char          path[1024];
+    float       **sample;
+    plan_cand     cands[4];
+    kmeans_config probe;
+
+    if (cfg == NULL || objects == NULL || clusters == NULL || plan == NULL ||
+        numObjs <= 0 || numCoords <= 0 || numClusters <= 0)
+        return 0;
+
+    start      = omp_get_wtime();
+    cores      = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    fixedThreads = (cfg->nthreads > 0) ? cfg->nthreads : 0;
+    memset(plan, 0, sizeof(kmeans_plan_result));
+
+    /* thread startup is all there is to a tiny fit */
+    if ((long)numObjs * numClusters * numCoords < PLAN_TINY) {
+        plan->engine   = KMEANS_ENGINE_SEQ;
+        plan->nthreads = 1;
+        goto done;
+    }
+
+    key[0] = plan_class(numObjs);
+    key[1] = plan_class(numClusters);
+    key[2] = plan_class(numCoords);
+    key[3] = cores;
+    key[4] = fixedThreads;
+    plan_file(tuning_file, path, sizeof(path));
+    if (plan_lookup(path, key, plan)) goto done;
+
+    /* the candidates: other metrics have their own kernels, so only the
+       no. threads is chosen for them */
+    ncands = 0;
+    if (cfg->metric != KMEANS_METRIC_L2) {
+        cands[ncands].engine    = cfg->engine;
+        cands[ncands++].partial = 0;
+    }
+    else {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        if (l2 <= 0) l2 = PLAN_L2_BYTES;
+        cands[ncands].engine    = KMEANS_ENGINE_OMP_REDUCTION;
+        cands[ncands++].partial = 0;
+        cands[ncands].engine    = KMEANS_ENGINE_OMP_TRANSPOSED;
+        cands[ncands++].partial = 0;
+        if ((size_t)numClusters * numCoords * sizeof(float) > (size_t)l2 / 2) {
+            cands[ncands].engine    = KMEANS_ENGINE_TILED;
+            cands[ncands++].partial = 0;
+        }
+        if (numCoords >= PLAN_PARTIAL_COORDS) {
+            cands[ncands].engine    = KMEANS_ENGINE_OMP_TRANSPOSED;
+            cands[ncands++].partial = 1;
+        }
+    }
+
+    /* a strided sample of about PLAN_WORK coordinates per pass */
+    numSample = (int)(PLAN_WORK / ((long)numClusters * numCoords));
+    if (numSample < PLAN_MIN_OBJS) numSample = PLAN_MIN_OBJS;
+    if (numSample > numObjs)       numSample = numObjs;
+    sample     = (float**) malloc((size_t)numSample * sizeof(float*));
+    membership = (int*)    malloc((size_t)numSample * sizeof(int));
+    if (sample == NULL || membership == NULL) {
+        free(sample); free(membership);
+        return 0;
+    }
+    for (i=0; i<numSample; i++)
+        sample[i] = objects[(long long)i * numObjs / numSample];
+
+    probe       = *cfg;
+    probe.async = 0;
+    probe.debug = 0;
+    best        = -1.0;
+    for (t=1; ; t*=2) {
+        int nthreads = (fixedThreads > 0) ? fixedThreads
+                     : (t < cores) ? t : cores;
+        for (c=-1; c<ncands; c++) {
+            /* seq only once, and only where it is an option */
+            if (c < 0 && (nthreads > 1 || cfg->metric != KMEANS_METRIC_L2))
+                continue;
+            probe.engine   = (c < 0) ? KMEANS_ENGINE_SEQ : cands[c].engine;
+            probe.partial  = (c < 0) ? 0 : cands[c].partial;
+            probe.nthreads = nthreads;
+            pass = plan_probe(&probe, sample, numCoords, numSample,
+                              numClusters, clusters, membership);
+            plan->probes++;
+            if (pass < 0) continue;
+            if (cfg->debug)
+                printf("plan: %-10s%s %2d threads %9.6f sec\n",
+                       kmeans_engine_name(probe.engine),
+                       probe.partial ? " -E" : "   ", nthreads, pass);
+            /* more threads must be clearly faster */
+            if (best < 0 || pass * PLAN_SLACK < best ||
+                (pass < best && nthreads == plan->nthreads)) {
+                best            = pass;
+                plan->engine    = probe.engine;
+                plan->partial   = probe.partial;
+                plan->nthreads  = nthreads;
+                plan->pass_time = pass;
+            }
+        }
+        if (fixedThreads > 0 || nthreads >= cores) break;
+    }
+    free(membership);
+    free(sample);
+    if (best < 0) return 0;
+
+    plan_store(path, key, plan);
+
+done:
+    cfg->engine   = plan->engine;
+    cfg->partial  = plan->partial;
+    cfg->nthreads = plan->nthreads;
+    plan->probe_time = omp_get_wtime() - start;
+    if (cfg->debug)
+        printf("plan: %s%s with %d threads (%d probes, T = %7.4f)\n",
+               kmeans_engine_name(plan->engine), plan->partial ? " -E" : "",
+               plan->nthreads, plan->probes, plan->probe_time);
+    return 1;
+}
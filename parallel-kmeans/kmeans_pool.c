@@ -0,0 +1,420 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_pool.c                                             */
+/*   Description:  a work-stealing thread pool that does not depend on the  */
+/*                 OpenMP runtime, and the "pool" engine built on it. The   */
+/*                 workers are pthreads created once per context and kept   */
+/*                 between passes; a waiting worker spins for a while and   */
+/*                 then sleeps on a condition variable. Every worker owns a */
+/*                 range of the loop and takes small pieces off its front;  */
+/*                 a worker whose range is empty steals the back half of    */
+/*                 another worker's range. Faster cores thus end up with    */
+/*                 more of the loop, where a static split would wait for    */
+/*                 the slowest one.                                          */
+/*                 The library is C, so this is pthreads and the GCC        */
+/*                 __atomic builtins rather than a C++ pool. A pass is one  */
+/*                 loop of objects of equal cost, so the per-worker deque   */
+/*                 of tasks is a range [lo, hi) under a spinlock: taking a  */
+/*                 grain pops its front and a steal splits off its back     */
+/*                 half, with no task objects to allocate or queue.         */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>        /* sched_yield() */
+
+#include "kmeans_internal.h"
+
+#define POOL_SPIN   4096    /* polls of a waiting worker before it sleeps */
+#define POOL_YIELD  64      /* polls between yields, for oversubscribed cores */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() do { } while (0)
+#endif
+
+typedef void (*pool_body)(void *arg, int tid, int lo, int hi);
+
+/* the part of the loop a worker still has to do, one per cache line */
+typedef struct {
+    int  lock;
+    int  lo, hi;
+    char pad[KMEANS_ALIGN - 3 * sizeof(int)];
+} pool_range;
+
+struct kmeans_pool {
+    int             nthreads;   /* workers, the calling thread is worker 0 */
+    pthread_t      *threads;    /* [nthreads-1] */
+    pool_range     *ranges;     /* [nthreads] */
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  wake;       /* a new loop or quit */
+    pthread_cond_t  done;       /* the last worker finished */
+    unsigned        generation; /* no. loops started */
+    int             pending;    /* workers not done with the current loop */
+    int             quit;
+    long            steals;     /* successful steals since creation */
+
+    pool_body       body;       /* the current loop */
+    void           *arg;
+    int             grain;
+};
+
+typedef struct {
+    kmeans_pool *pool;
+    int          tid;
+} pool_worker;
+
+/*----< pool_pause() >-------------------------------------------------------*/
+static void pool_pause(int s)
+{
+    if (s % POOL_YIELD == POOL_YIELD - 1) sched_yield();
+    else                                  cpu_relax();
+}
+
+/*----< range_lock() >-------------------------------------------------------*/
+static void range_lock(pool_range *r)
+{
+    while (__atomic_test_and_set(&r->lock, __ATOMIC_ACQUIRE))
+        while (__atomic_load_n(&r->lock, __ATOMIC_RELAXED)) cpu_relax();
+}
+
+static void range_unlock(pool_range *r)
+{
+    __atomic_clear(&r->lock, __ATOMIC_RELEASE);
+}
+
+/*----< pool_take() >--------------------------------------------------------*/
+/* the next grain of a worker's own range                                    */
+static int pool_take(kmeans_pool *pool, int tid, int *lo, int *hi)
+{
+    pool_range *r = pool->ranges + tid;
+    int         ok;
+
+    range_lock(r);
+    ok = (r->lo < r->hi);
+    if (ok) {
+        *lo   = r->lo;
+        *hi   = (r->hi - r->lo > pool->grain) ? r->lo + pool->grain : r->hi;
+        r->lo = *hi;
+    }
+    range_unlock(r);
+    return ok;
+}
+
+/*----< pool_steal() >-------------------------------------------------------*/
+/* move the back half of the first non-empty range after tid into tid's own */
+static int pool_steal(kmeans_pool *pool, int tid)
+{
+    int i, lo, hi;
+
+    for (i=1; i<pool->nthreads; i++) {
+        pool_range *v = pool->ranges + (tid + i) % pool->nthreads;
+
+        if (__atomic_load_n(&v->hi, __ATOMIC_RELAXED) -
+            __atomic_load_n(&v->lo, __ATOMIC_RELAXED) <= 0)
+            continue;
+
+        range_lock(v);
+        hi = v->hi;
+        lo = v->hi - (v->hi - v->lo + 1) / 2;
+        if (lo < hi) v->hi = lo;
+        range_unlock(v);
+
+        if (lo < hi) {
+            pool_range *r = pool->ranges + tid;
+            range_lock(r);
+            r->lo = lo;
+            r->hi = hi;
+            range_unlock(r);
+            __atomic_add_fetch(&pool->steals, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*----< pool_work() >--------------------------------------------------------*/
+static void pool_work(kmeans_pool *pool, int tid)
+{
+    int lo, hi;
+
+    for (;;) {
+        if (pool_take(pool, tid, &lo, &hi))
+            pool->body(pool->arg, tid, lo, hi);
+        else if (!pool_steal(pool, tid))
+            break;
+    }
+
+    /* everything left is held by workers still running */
+    if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+/*----< pool_main() >--------------------------------------------------------*/
+static void* pool_main(void *arg)
+{
+    pool_worker *w    = (pool_worker*) arg;
+    kmeans_pool *pool = w->pool;
+    int          tid  = w->tid, s;
+    unsigned     seen = 0;
+
+    free(w);
+    for (;;) {
+        /* spin, then sleep until the next loop */
+        for (s=0; s<POOL_SPIN &&
+                  __atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE) == seen; s++)
+            pool_pause(s);
+        if (__atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE) == seen) {
+            pthread_mutex_lock(&pool->mutex);
+            while (__atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE) == seen)
+                pthread_cond_wait(&pool->wake, &pool->mutex);
+            pthread_mutex_unlock(&pool->mutex);
+        }
+        seen = __atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE);
+        if (pool->quit) break;
+
+        pool_work(pool, tid);
+    }
+    return NULL;
+}
+
+/*----< kmeans_pool_create() >-----------------------------------------------*/
+kmeans_pool* kmeans_pool_create(int nthreads)
+{
+    int          i;
+    kmeans_pool *pool;
+
+    if (nthreads <= 0) return NULL;
+    pool = (kmeans_pool*) calloc(1, sizeof(kmeans_pool));
+    if (pool == NULL) return NULL;
+
+    pool->nthreads = nthreads;
+    pool->ranges   = (pool_range*) kmeans_aligned_alloc(nthreads * sizeof(pool_range));
+    pool->threads  = (pthread_t*)  malloc(nthreads * sizeof(pthread_t));
+    if (pool->ranges == NULL || pool->threads == NULL) {
+        kmeans_aligned_free(pool->ranges);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    memset(pool->ranges, 0, nthreads * sizeof(pool_range));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (i=1; i<nthreads; i++) {
+        pool_worker *w = (pool_worker*) malloc(sizeof(pool_worker));
+        if (w == NULL) break;
+        w->pool = pool;
+        w->tid  = i;
+        if (pthread_create(&pool->threads[i-1], NULL, pool_main, w) != 0) {
+            free(w);
+            break;
+        }
+    }
+    if (i < nthreads) {        /* stop the workers that did start */
+        pool->nthreads = i;
+        kmeans_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/*----< kmeans_pool_destroy() >----------------------------------------------*/
+void kmeans_pool_destroy(kmeans_pool *pool)
+{
+    int i;
+
+    if (pool == NULL) return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = 1;
+    __atomic_add_fetch(&pool->generation, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i=1; i<pool->nthreads; i++)
+        pthread_join(pool->threads[i-1], NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->mutex);
+    kmeans_aligned_free(pool->ranges);
+    free(pool->threads);
+    free(pool);
+}
+
+int kmeans_pool_size(const kmeans_pool *pool)
+{
+    return pool->nthreads;
+}
+
+long kmeans_pool_steals(const kmeans_pool *pool)
+{
+    return __atomic_load_n(&pool->steals, __ATOMIC_RELAXED);
+}
+
+/*----< kmeans_pool_run() >--------------------------------------------------*/
+/* body(arg, tid, lo, hi) over [0, n) in pieces of at most grain, on all     */
+/* workers; returns when the whole loop is done                               */
+static void kmeans_pool_run(kmeans_pool *pool, int n, int grain,
+                            pool_body body, void *arg)
+{
+    int t, s;
+
+    pool->body    = body;
+    pool->arg     = arg;
+    pool->grain   = (grain > 0) ? grain : 1;
+    pool->pending = pool->nthreads;
+
+    /* start from the static split; stealing evens out the rest */
+    for (t=0; t<pool->nthreads; t++) {
+        pool->ranges[t].lo = (int)((long long)n *  t    / pool->nthreads);
+        pool->ranges[t].hi = (int)((long long)n * (t+1) / pool->nthreads);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    __atomic_add_fetch(&pool->generation, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool_work(pool, 0);
+
+    /* spin, then sleep until the other workers are done */
+    for (s=0; s<POOL_SPIN &&
+              __atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0; s++)
+        pool_pause(s);
+    if (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0) {
+        pthread_mutex_lock(&pool->mutex);
+        while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0)
+            pthread_cond_wait(&pool->done, &pool->mutex);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+/*----< the pool engine >----------------------------------------------------*/
+typedef struct {
+    kmeans_ctx  *ctx;
+    float      **objects;
+    int          numCoords, numClusters;
+    int         *membership;
+} pool_pass;
+
+/* assignment of objects [lo, hi) into the private sums of worker tid */
+static void assign_body(void *arg, int tid, int lo, int hi)
+{
+    pool_pass  *p     = (pool_pass*) arg;
+    kmeans_ctx *ctx   = p->ctx;
+    int         D     = p->numCoords, K = p->numClusters;
+    size_t      padK  = KMEANS_PAD((size_t)ctx->capClusters);
+    size_t      padKD = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);
+    int        *local_size = ctx->local_newClusterSize + tid * padK;
+    float      *local_sum  = ctx->local_newClusters    + tid * padKD;
+    float      *distArray  = ctx->distArray            + tid * padK;
+    double     *stats      = ctx->local_stats          + tid * 8;
+    int         i, j, index;
+    float       dist, delta = 0.0;
+    double      sum = 0.0;
+
+    for (i=lo; i<hi; i++) {
+        float *object = p->objects[i];
+
+        index = kmeans_nearest_transposed(object, ctx->clustersT, D, K, K,
+                                          distArray, &dist);
+        sum += dist;
+        kmeans_far_offer(ctx, tid, i, dist);
+        if (p->membership[i] != index) delta += 1.0;
+        p->membership[i] = index;
+
+        local_size[index]++;
+        for (j=0; j<D; j++)
+            local_sum[(size_t)index*D + j] += object[j];
+    }
+    stats[0] += delta;
+    stats[1] += sum;
+}
+
+/* array reduction of the private sums, clusters [lo, hi) */
+static void reduce_body(void *arg, int tid, int lo, int hi)
+{
+    pool_pass  *p     = (pool_pass*) arg;
+    kmeans_ctx *ctx   = p->ctx;
+    int         D     = p->numCoords;
+    size_t      padK  = KMEANS_PAD((size_t)ctx->capClusters);
+    size_t      padKD = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);
+    int         i, j, k;
+
+    (void) tid;
+    for (i=lo; i<hi; i++) {
+        for (j=0; j<ctx->nthreads; j++) {
+            int   *size_j = ctx->local_newClusterSize + j * padK;
+            float *sum_j  = ctx->local_newClusters    + j * padKD + (size_t)i * D;
+            ctx->newClusterSize[i] += size_j[i];
+            size_j[i] = 0;
+            for (k=0; k<D; k++) {
+                ctx->newClusters[(size_t)i*D + k] += sum_j[k];
+                sum_j[k] = 0.0;
+            }
+        }
+    }
+}
+
+/*----< kmeans_pass_pool() >-------------------------------------------------*/
+float kmeans_pass_pool(kmeans_ctx *ctx,
+                       float     **objects,     /* [numObjs][numCoords] */
+                       int         numCoords,
+                       int         numObjs,
+                       int         numClusters,
+                       int        *membership,  /* in/out: [numObjs] */
+                       float     **clusters,    /* [numClusters][numCoords] */
+                       double     *sse)
+{
+    int       i, j, grain;
+    float     delta = 0.0;
+    double    sum   = 0.0;
+    pool_pass p;
+
+    if (ctx->pool == NULL || kmeans_pool_size(ctx->pool) != ctx->nthreads) {
+        kmeans_pool_destroy(ctx->pool);
+        ctx->pool = kmeans_pool_create(ctx->nthreads);
+        if (ctx->pool == NULL) return -1;
+    }
+
+    for (i=0; i<numClusters; i++)
+        for (j=0; j<numCoords; j++)
+            ctx->clustersT[(size_t)j*numClusters + i] = clusters[i][j];
+    for (i=0; i<ctx->nthreads; i++)
+        ctx->local_stats[i*8] = ctx->local_stats[i*8+1] = 0.0;
+
+    p.ctx         = ctx;
+    p.objects     = objects;
+    p.numCoords   = numCoords;
+    p.numClusters = numClusters;
+    p.membership  = membership;
+
+    /* pieces of about 16 per worker: small enough to balance, large
+       enough that the range locks stay off the profile */
+    grain = numObjs / (16 * ctx->nthreads);
+    if (grain < 64) grain = 64;
+    kmeans_pool_run(ctx->pool, numObjs, grain, assign_body, &p);
+    kmeans_pool_run(ctx->pool, numClusters, 1, reduce_body, &p);
+
+    for (i=0; i<ctx->nthreads; i++) {
+        delta += ctx->local_stats[i*8];
+        sum   += ctx->local_stats[i*8+1];
+    }
+    *sse = sum;
+    return delta;
+}
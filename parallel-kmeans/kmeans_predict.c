@@ -0,0 +1,106 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_predict.c                                          */
+/*   Description:  nearest-center assignment against a fixed set of centers */
+/*                 (a trained model). The centers are kept resident in the  */
+/*                 context in the transposed layout of omp_new_kmeans.c and */
+/*                 objects go through the same vectorized kernel, without   */
+/*                 any center update.                                        */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+
+/*----< kmeans_set_centers() >-----------------------------------------------*/
+/* copy clusters[numClusters][numCoords] into the context as the model used  */
+/* by kmeans_predict(); returns 1 on success, 0 on failure                   */
+int kmeans_set_centers(kmeans_ctx *ctx,
+                       float     **clusters,    /* [numClusters][numCoords] */
+                       int         numCoords,
+                       int         numClusters)
+{
+    int    i, j, nthreads;
+    size_t padK;
+
+    if (ctx == NULL || clusters == NULL || numCoords <= 0 || numClusters <= 0)
+        return 0;
+
+    nthreads = (ctx->cfg.nthreads > 0) ? ctx->cfg.nthreads
+                                       : omp_get_max_threads();
+    padK     = KMEANS_PAD((size_t)numClusters);
+
+    if (numCoords != ctx->modelCoords || numClusters != ctx->modelClusters ||
+        nthreads > ctx->modelThreads) {
+        kmeans_aligned_free(ctx->modelT);
+        kmeans_aligned_free(ctx->modelDist);
+        ctx->modelT    = (float*) kmeans_aligned_alloc(numCoords * padK * sizeof(float));
+        ctx->modelDist = (float*) kmeans_aligned_alloc(nthreads  * padK * sizeof(float));
+        ctx->stats.num_allocs++;
+        if (ctx->modelT == NULL || ctx->modelDist == NULL) {
+            kmeans_aligned_free(ctx->modelT);
+            kmeans_aligned_free(ctx->modelDist);
+            ctx->modelT = ctx->modelDist = NULL;
+            ctx->modelCoords = ctx->modelClusters = ctx->modelThreads = 0;
+            return 0;
+        }
+        ctx->modelThreads = nthreads;
+    }
+    ctx->modelCoords   = numCoords;
+    ctx->modelClusters = numClusters;
+
+    for (i=0; i<numClusters; i++)
+        for (j=0; j<numCoords; j++)
+            ctx->modelT[j*padK + i] = clusters[i][j];
+    return 1;
+}
+
+/*----< kmeans_predict() >---------------------------------------------------*/
+/* assign each of objects[numObjs][numCoords] to its nearest model center.   */
+/* distances[numObjs], if not NULL, receives the squared distances.          */
+int kmeans_predict(kmeans_ctx *ctx,
+                   float     **objects,     /* in: [numObjs][modelCoords] */
+                   int         numObjs,
+                   int        *membership,  /* out: [numObjs] */
+                   float      *distances)   /* out: [numObjs] or NULL */
+{
+    int    i, nthreads;
+    int    numCoords   = ctx->modelCoords;
+    int    numClusters = ctx->modelClusters;
+    size_t padK        = KMEANS_PAD((size_t)numClusters);
+    float *modelT      = ctx->modelT;
+
+    if (modelT == NULL || objects == NULL || membership == NULL) return 0;
+    if (numObjs <= 0) return 1;
+
+    nthreads = (ctx->cfg.nthreads > 0) ? ctx->cfg.nthreads
+                                       : omp_get_max_threads();
+    if (nthreads > ctx->modelThreads) nthreads = ctx->modelThreads;
+
+    #pragma omp parallel num_threads(nthreads) \
+            firstprivate(numObjs,numClusters,numCoords)
+    {
+        float *distArray = ctx->modelDist + omp_get_thread_num() * padK;
+        float  min_dist;
+
+        #pragma omp for private(i) schedule(static)
+        for (i=0; i<numObjs; i++) {
+            membership[i] = kmeans_nearest_transposed(objects[i], modelT,
+                                                      numCoords, numClusters,
+                                                      padK, distArray,
+                                                      &min_dist);
+            if (distances != NULL) distances[i] = min_dist;
+        }
+    }
+    return 1;
+}
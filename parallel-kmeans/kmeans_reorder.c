@@ -0,0 +1,198 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_reorder.c                                          */
+/*   Description:  reorders the objects along a space-filling curve before  */
+/*                 the fit, so that objects next to each other in memory,   */
+/*                 and so in a thread's static block, are close in space    */
+/*                 and mostly go to the same few clusters. Each coordinate */
+/*                 is quantized over its range and the bits are interleaved */
+/*                 into a 64-bit key, directly (Morton, or Z-order) or after */
+/*                 Skilling's transform (Hilbert, which has no long jumps). */
+/*                 The objects are sorted by key with a radix sort; perm[]  */
+/*                 keeps the original position of every row so results can */
+/*                 be put back in input order (kmeans_restore_order()).     */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+#define MAX_CURVE_DIMS 64   /* coordinates that take part in the key */
+
+/*----< hilbert_transpose() >------------------------------------------------*/
+/* Skilling's AxestoTranspose: n coordinates of b bits each become the       */
+/* Hilbert index, stored transposed across X[] (J. Skilling, "Programming   */
+/* the Hilbert curve", AIP Conf. Proc. 707, 2004)                            */
+static void hilbert_transpose(uint32_t *X, int b, int n)
+{
+    uint32_t M = 1u << (b - 1), P, Q, t;
+    int      i;
+
+    /* inverse undo */
+    for (Q = M; Q > 1; Q >>= 1) {
+        P = Q - 1;
+        for (i=0; i<n; i++) {
+            if (X[i] & Q) X[0] ^= P;
+            else {
+                t = (X[0] ^ X[i]) & P;
+                X[0] ^= t;
+                X[i] ^= t;
+            }
+        }
+    }
+    /* Gray encode */
+    for (i=1; i<n; i++) X[i] ^= X[i-1];
+    t = 0;
+    for (Q = M; Q > 1; Q >>= 1)
+        if (X[n-1] & Q) t ^= Q - 1;
+    for (i=0; i<n; i++) X[i] ^= t;
+}
+
+/*----< radix_sort() >-------------------------------------------------------*/
+/* sort perm[] by key[], 8 bits a pass, stable; passes on a byte that is the */
+/* same in every key are skipped                                             */
+static int radix_sort(uint64_t *key, int *perm, int numObjs)
+{
+    int       i, b, shift;
+    size_t    count[256];
+    uint64_t *key2  = (uint64_t*) malloc((size_t)numObjs * sizeof(uint64_t));
+    int      *perm2 = (int*)      malloc((size_t)numObjs * sizeof(int));
+
+    if (key2 == NULL || perm2 == NULL) {
+        free(key2); free(perm2);
+        return 0;
+    }
+    for (shift=0; shift<64; shift+=8) {
+        size_t pos = 0;
+        memset(count, 0, sizeof(count));
+        for (i=0; i<numObjs; i++) count[(key[i] >> shift) & 255]++;
+        if (count[(key[0] >> shift) & 255] == (size_t)numObjs) continue;
+
+        for (b=0; b<256; b++) {
+            size_t c = count[b];
+            count[b] = pos;
+            pos += c;
+        }
+        for (i=0; i<numObjs; i++) {
+            size_t d = count[(key[i] >> shift) & 255]++;
+            key2[d]  = key[i];
+            perm2[d] = perm[i];
+        }
+        memcpy(key,  key2,  (size_t)numObjs * sizeof(uint64_t));
+        memcpy(perm, perm2, (size_t)numObjs * sizeof(int));
+    }
+    free(perm2);
+    free(key2);
+    return 1;
+}
+
+/*----< kmeans_reorder() >---------------------------------------------------*/
+/* objects[i] becomes the old objects[perm[i]]; rows need not be contiguous  */
+int kmeans_reorder(float      **objects,    /* in/out: [numObjs][numCoords] */
+                   int          numCoords,
+                   int          numObjs,
+                   kmeans_order order,
+                   int         *perm)       /* out: [numObjs] */
+{
+    int       i, j, n, bits;
+    float    *lo, *scale, *tmp;
+    uint64_t *key;
+
+    if (objects == NULL || perm == NULL || numObjs <= 0 || numCoords <= 0)
+        return 0;
+    for (i=0; i<numObjs; i++) perm[i] = i;
+    if (order == KMEANS_ORDER_NONE) return 1;
+    if (order != KMEANS_ORDER_MORTON && order != KMEANS_ORDER_HILBERT)
+        return 0;
+
+    /* the first n coordinates, b bits each, fill at most 64 bits */
+    n    = (numCoords < MAX_CURVE_DIMS) ? numCoords : MAX_CURVE_DIMS;
+    bits = 64 / n;
+    if (bits > 16) bits = 16;
+
+    lo    = (float*)    malloc(n * sizeof(float));
+    scale = (float*)    malloc(n * sizeof(float));
+    key   = (uint64_t*) malloc((size_t)numObjs * sizeof(uint64_t));
+    if (lo == NULL || scale == NULL || key == NULL) {
+        free(lo); free(scale); free(key);
+        return 0;
+    }
+
+    /* range of each coordinate */
+    for (j=0; j<n; j++) {
+        float mn = objects[0][j], mx = objects[0][j];
+        for (i=1; i<numObjs; i++) {
+            if (objects[i][j] < mn) mn = objects[i][j];
+            if (objects[i][j] > mx) mx = objects[i][j];
+        }
+        lo[j]    = mn;
+        scale[j] = (mx > mn) ? (float)((1u << bits) - 1) / (mx - mn) : 0.0f;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (i=0; i<numObjs; i++) {
+        uint32_t X[MAX_CURVE_DIMS];
+        uint64_t k = 0;
+        int      d, b;
+
+        for (d=0; d<n; d++) {
+            X[d] = (uint32_t)((objects[i][d] - lo[d]) * scale[d]);
+            if (X[d] >> bits) X[d] = (1u << bits) - 1;     /* rounding */
+        }
+        if (order == KMEANS_ORDER_HILBERT && bits > 1)
+            hilbert_transpose(X, bits, n);
+
+        /* interleave, most significant bits first */
+        for (b=bits-1; b>=0; b--)
+            for (d=0; d<n; d++)
+                k = (k << 1) | ((X[d] >> b) & 1u);
+        key[i] = k;
+    }
+
+    if (!radix_sort(key, perm, numObjs)) {
+        free(lo); free(scale); free(key);
+        return 0;
+    }
+    free(key);
+    free(scale);
+    free(lo);
+
+    /* move the rows into curve order */
+    tmp = (float*) kmeans_aligned_alloc((size_t)numObjs * numCoords * sizeof(float));
+    if (tmp == NULL) return 0;
+    #pragma omp parallel for schedule(static)
+    for (i=0; i<numObjs; i++)
+        memcpy(tmp + (size_t)i*numCoords, objects[perm[i]],
+               numCoords * sizeof(float));
+    #pragma omp parallel for schedule(static)
+    for (i=0; i<numObjs; i++)
+        memcpy(objects[i], tmp + (size_t)i*numCoords, numCoords * sizeof(float));
+    kmeans_aligned_free(tmp);
+    return 1;
+}
+
+/*----< kmeans_restore_order() >---------------------------------------------*/
+/* put a per-object result of reordered objects back in input order          */
+int kmeans_restore_order(const int *perm,        /* in: from kmeans_reorder() */
+                         int        numObjs,
+                         int       *membership)  /* in/out: [numObjs] */
+{
+    int  i, *tmp;
+
+    tmp = (int*) malloc((size_t)numObjs * sizeof(int));
+    if (tmp == NULL) return 0;
+    for (i=0; i<numObjs; i++) tmp[perm[i]] = membership[i];
+    memcpy(membership, tmp, (size_t)numObjs * sizeof(int));
+    free(tmp);
+    return 1;
+}
@@ -0,0 +1,143 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_repair.c                                           */
+/*   Description:  repair of empty (and singleton) clusters, cfg.repair.    */
+/*                 An empty cluster keeps its old center forever and a      */
+/*                 cluster of one object is rarely of any use. While it     */
+/*                 assigns the objects, every engine keeps per thread the   */
+/*                 KMEANS_FAR objects farthest from their center            */
+/*                 (kmeans_far_offer()), so after the pass such clusters    */
+/*                 are reseeded from the farthest of them without another   */
+/*                 pass over the data: the object is moved from the sums of */
+/*                 its old cluster to those of the reseeded one, which      */
+/*                 kmeans_update_centers() then moves onto it, as with      */
+/*                 cfg.repair every non-empty cluster moves.                */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "kmeans_internal.h"
+
+#define REPAIR_LIMIT 3      /* reseeds of one cluster per fit */
+
+typedef struct {
+    float dist;
+    int   obj;
+} far_obj;
+
+/*----< kmeans_far_reset() >-------------------------------------------------*/
+/* forget the farthest objects of the last pass                              */
+void kmeans_far_reset(kmeans_ctx *ctx)
+{
+    int t;
+
+    if (!ctx->cfg.repair) return;
+    for (t=0; t<ctx->capThreads; t++) ctx->farCount[t*16] = 0;
+}
+
+/*----< kmeans_far_remap() >-------------------------------------------------*/
+/* the pass was over a subset of the objects: idx[] maps them back           */
+void kmeans_far_remap(kmeans_ctx *ctx, const int *idx)
+{
+    int t, j;
+
+    if (!ctx->cfg.repair) return;
+    for (t=0; t<ctx->capThreads; t++)
+        for (j=0; j<ctx->farCount[t*16]; j++)
+            ctx->farObj[t*KMEANS_FAR + j] = idx[ctx->farObj[t*KMEANS_FAR + j]];
+}
+
+/* farthest first, ties by object id so the order does not depend on threads */
+static int far_cmp(const void *a, const void *b)
+{
+    const far_obj *x = (const far_obj*) a, *y = (const far_obj*) b;
+
+    if (x->dist != y->dist) return (x->dist < y->dist) ? 1 : -1;
+    return (x->obj > y->obj) - (x->obj < y->obj);
+}
+
+/*----< kmeans_repair() >----------------------------------------------------*/
+/* after a pass of kmeans_fit(): reseed each empty cluster, and with         */
+/* cfg.repair = 2 each singleton, from the farthest objects of the pass     */
+/* whose cluster keeps more than one (two) objects. A singleton's own       */
+/* object drops out of this update and is reassigned by the next pass.      */
+/* Returns the no. clusters reseeded                                         */
+int kmeans_repair(kmeans_ctx *ctx,
+                  float     **objects,     /* [numObjs][numCoords] */
+                  int         numCoords,
+                  int         numClusters,
+                  int        *membership)  /* in/out: [numObjs] */
+{
+    int      t, j, k, c, n = -1, from = -1, nfar, keep, repairs = 0;
+    int     *size = ctx->newClusterSize;
+    float    scale, *sum, *seed;
+    far_obj *far;
+
+    keep = (ctx->cfg.repair > 1) ? 2 : 1;   /* objects a donor keeps */
+    for (k=0; k<numClusters; k++)
+        if (size[k] < keep && ctx->repaired[k] < REPAIR_LIMIT) break;
+    if (k == numClusters) return 0;
+
+    far = (far_obj*) malloc(ctx->capThreads * KMEANS_FAR * sizeof(far_obj));
+    if (far == NULL) return 0;      /* no repair this pass */
+    for (nfar=0, t=0; t<ctx->capThreads; t++)
+        for (j=0; j<ctx->farCount[t*16]; j++) {
+            far[nfar].dist = ctx->farDist[t*KMEANS_FAR + j];
+            far[nfar].obj  = ctx->farObj [t*KMEANS_FAR + j];
+            nfar++;
+        }
+    qsort(far, nfar, sizeof(far_obj), far_cmp);
+
+    for (c=0; k<numClusters && c<nfar; k++) {
+        float *x;
+
+        if (size[k] >= keep || ctx->repaired[k] >= REPAIR_LIMIT) continue;
+
+        /* the farthest object left that is not on its center, whose
+           cluster stays large enough, and that is not frozen */
+        for (; c<nfar; c++) {
+            n    = far[c].obj;
+            from = membership[n];
+            if (far[c].dist > 0.0f && from >= 0 && from != k &&
+                size[from] > keep &&
+                !(ctx->cfg.freeze_after > 0 && ctx->freezeOn[n]))
+                break;
+        }
+        if (c == nfar) break;
+        c++;
+
+        /* cosine sums are of the normalized objects */
+        x     = objects[n];
+        scale = 1.0f;
+        if (ctx->cfg.metric == KMEANS_METRIC_COSINE) {
+            float norm = 0.0f;
+            for (j=0; j<numCoords; j++) norm += x[j] * x[j];
+            scale = (norm > 0.0f) ? 1.0f / sqrtf(norm) : 0.0f;
+        }
+        sum  = ctx->newClusters + (size_t)from * numCoords;
+        seed = ctx->newClusters + (size_t)k    * numCoords;
+        for (j=0; j<numCoords; j++) {
+            sum[j]  -= x[j] * scale;
+            seed[j]  = x[j] * scale;
+        }
+        size[from]--;
+        size[k]       = 1;
+        membership[n] = k;
+        ctx->repaired[k]++;
+        repairs++;
+    }
+    free(far);
+
+    if (ctx->cfg.debug && repairs > 0)
+        printf("repair: %d clusters reseeded\n", repairs);
+    return repairs;
+}
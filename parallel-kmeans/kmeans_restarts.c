@@ -0,0 +1,260 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_restarts.c                                         */
+/*   Description:  seeded restarts (n_init) of the k-means library. With   */
+/*                 the tasks (or seq) engine the restarts run concurrently  */
+/*                 as OpenMP tasks over the same objects array, so all of   */
+/*                 them share one team; the other engines open a team of    */
+/*                 their own, so their restarts run one after another. A   */
+/*                 monitor compares every pass with the best SSE seen so    */
+/*                 far and abandons restarts that are clearly behind.       */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+typedef struct {
+    const kmeans_restart_config *rc;
+    int      nbest;
+    double  *best_at;      /* [nbest] lowest SSE seen at each pass */
+    double   best_sse;     /* lowest final SSE of a finished restart */
+    int      best;         /* the restart holding best_sse, -1 = none yet */
+    int      abandoned;
+    kmeans_stats best_stats;
+} restart_state;
+
+/*----< kmeans_restart_config_init() >---------------------------------------*/
+void kmeans_restart_config_init(kmeans_restart_config *rc)
+{
+    memset(rc, 0, sizeof(kmeans_restart_config));
+    rc->n_init        = 1;
+    rc->seed          = 1;
+    rc->abandon_after = 5;
+    rc->abandon_ratio = 1.2;
+}
+
+/*----< kmeans_restarts_shared() >-------------------------------------------*/
+/* 1 if restarts with this engine run concurrently on one team               */
+int kmeans_restarts_shared(kmeans_engine engine)
+{
+    return (engine == KMEANS_ENGINE_OMP_TASKS || engine == KMEANS_ENGINE_SEQ);
+}
+
+/*----< restart_monitor() >--------------------------------------------------*/
+/* SSE only decreases along a fit, so a restart whose SSE is well above what */
+/* another restart had at the same pass, or above a finished restart, will  */
+/* rarely end up the best one                                                */
+static int restart_monitor(void *arg, int loop, double sse, float delta,
+                           float **clusters)
+{
+    restart_state *st = (restart_state*) arg;
+    double         ref;
+    int            stop = 0;
+
+    #pragma omp critical (kmeans_restarts)
+    {
+        ref = st->best_sse;
+        if (loop < st->nbest) {
+            if (sse < st->best_at[loop]) st->best_at[loop] = sse;
+            if (st->best_at[loop] < ref) ref = st->best_at[loop];
+        }
+        if (st->rc->abandon_after > 0 && loop >= st->rc->abandon_after &&
+            sse > st->rc->abandon_ratio * ref) {
+            st->abandoned++;
+            stop = 1;
+        }
+    }
+    return stop;
+}
+
+/*----< pick_centers() >-----------------------------------------------------*/
+/* numClusters distinct objects drawn with seed                              */
+static void pick_centers(float   **objects,
+                         int       numCoords,
+                         int       numObjs,
+                         int       numClusters,
+                         unsigned  seed,
+                         int      *picked,     /* scratch [numClusters] */
+                         float   **clusters)
+{
+    int i, j, k;
+
+    for (i=0; i<numClusters; i++) {
+        do {
+            k = (int)(((double)rand_r(&seed) / ((double)RAND_MAX + 1.0)) * numObjs);
+            for (j=0; j<i; j++)
+                if (picked[j] == k) break;
+        } while (j < i);
+        picked[i] = k;
+        memcpy(clusters[i], objects[k], numCoords * sizeof(float));
+    }
+}
+
+/*----< run_restart() >------------------------------------------------------*/
+static void run_restart(kmeans_ctx    *parent,
+                        restart_state *st,
+                        int            r,
+                        float        **objects,
+                        int            numCoords,
+                        int            numObjs,
+                        int            numClusters,
+                        const float   *init,        /* [numClusters*numCoords] or NULL */
+                        int           *membership,  /* out: best so far */
+                        float        **clusters)    /* in/out: best so far */
+{
+    int            i, *mem, *picked;
+    float        **cent;
+    kmeans_ctx    *ctx;
+
+    mem     = (int*)    malloc((size_t)numObjs * sizeof(int));
+    picked  = (int*)    malloc(numClusters * sizeof(int));
+    cent    = (float**) malloc(numClusters * sizeof(float*));
+    ctx     = kmeans_ctx_create(&parent->cfg);
+    if (mem == NULL || picked == NULL || cent == NULL || ctx == NULL ||
+        (cent[0] = (float*) malloc((size_t)numClusters * numCoords *
+                                   sizeof(float))) == NULL) {
+        free(mem); free(picked); free(cent);
+        kmeans_ctx_destroy(ctx);
+        return;
+    }
+    for (i=1; i<numClusters; i++)
+        cent[i] = cent[i-1] + numCoords;
+
+    if (init != NULL)
+        memcpy(cent[0], init, (size_t)numClusters * numCoords * sizeof(float));
+    else
+        pick_centers(objects, numCoords, numObjs, numClusters,
+                     st->rc->seed + r, picked, cent);
+
+    kmeans_ctx_set_monitor(ctx, restart_monitor, st);
+    if (kmeans_fit(ctx, objects, numCoords, numObjs, numClusters, mem, cent) &&
+        ctx->stats.stop_reason != KMEANS_STOP_MONITOR) {
+        #pragma omp critical (kmeans_restarts)
+        {
+            if (ctx->stats.sse < st->best_sse ||
+                (ctx->stats.sse == st->best_sse && r < st->best)) {
+                st->best_sse   = ctx->stats.sse;
+                st->best       = r;
+                st->best_stats = ctx->stats;
+                memcpy(membership, mem, (size_t)numObjs * sizeof(int));
+                for (i=0; i<numClusters; i++)
+                    memcpy(clusters[i], cent[i], numCoords * sizeof(float));
+            }
+        }
+    }
+    if (parent->cfg.debug)
+        printf("restart %2d: nloops = %3d sse = %g%s\n", r,
+               ctx->stats.loops, ctx->stats.sse,
+               ctx->stats.stop_reason == KMEANS_STOP_MONITOR ? " (abandoned)" : "");
+
+    kmeans_ctx_destroy(ctx);
+    free(cent[0]);
+    free(cent);
+    free(picked);
+    free(mem);
+}
+
+/*----< kmeans_fit_restarts() >----------------------------------------------*/
+int kmeans_fit_restarts(kmeans_ctx *ctx,
+                        float     **objects,      /* in: [numObjs][numCoords] */
+                        int         numCoords,
+                        int         numObjs,
+                        int         numClusters,
+                        const kmeans_restart_config *rc,
+                        int        *membership,   /* out: [numObjs] */
+                        float     **clusters)     /* in/out: [numClusters][numCoords] */
+{
+    int           i, r, nthreads, shared;
+    float        *init;
+    double        timing;
+    restart_state st;
+
+    if (ctx == NULL || rc == NULL || objects == NULL || clusters == NULL ||
+        membership == NULL || numObjs < numClusters || numCoords <= 0 ||
+        numClusters <= 0 || rc->abandon_ratio < 1.0)
+        return 0;
+
+    if (rc->n_init <= 1) {
+        if (!kmeans_fit(ctx, objects, numCoords, numObjs, numClusters,
+                        membership, clusters))
+            return 0;
+        ctx->stats.best_restart = 0;
+        ctx->stats.abandoned    = 0;
+        return 1;
+    }
+    if (ctx->cfg.async) return 0;
+
+    st.rc        = rc;
+    st.nbest     = ctx->cfg.max_loops + 2;
+    st.best_at   = (double*) malloc(st.nbest * sizeof(double));
+    st.best_sse  = DBL_MAX;
+    st.best      = -1;
+    st.abandoned = 0;
+    /* clusters[] receives the best result while restart 0 may still run */
+    init = (float*) malloc((size_t)numClusters * numCoords * sizeof(float));
+    if (st.best_at == NULL || init == NULL) {
+        free(st.best_at);
+        free(init);
+        return 0;
+    }
+    for (i=0; i<numClusters; i++)
+        memcpy(init + (size_t)i * numCoords, clusters[i], numCoords * sizeof(float));
+    for (i=0; i<st.nbest; i++) st.best_at[i] = DBL_MAX;
+
+    nthreads = (ctx->cfg.nthreads > 0) ? ctx->cfg.nthreads
+                                       : omp_get_max_threads();
+    shared   = kmeans_restarts_shared(ctx->cfg.engine);
+    timing   = omp_get_wtime();
+
+    if (shared) {
+        #pragma omp parallel num_threads(nthreads)
+        #pragma omp single
+        {
+            for (r=0; r<rc->n_init; r++) {
+                #pragma omp task firstprivate(r)
+                run_restart(ctx, &st, r, objects, numCoords, numObjs,
+                            numClusters, (r == 0) ? init : NULL, membership,
+                            clusters);
+            }
+        }
+    }
+    else {
+        for (r=0; r<rc->n_init; r++)
+            run_restart(ctx, &st, r, objects, numCoords, numObjs,
+                        numClusters, (r == 0) ? init : NULL, membership,
+                        clusters);
+    }
+    free(init);
+    free(st.best_at);
+    if (st.best < 0) return 0;
+
+    ctx->stats.loops        = st.best_stats.loops;
+    ctx->stats.delta        = st.best_stats.delta;
+    ctx->stats.sse          = st.best_stats.sse;
+    ctx->stats.stop_reason  = st.best_stats.stop_reason;
+    ctx->stats.dims_per_dist = st.best_stats.dims_per_dist;
+    ctx->stats.fallback_rate = st.best_stats.fallback_rate;
+    ctx->stats.mismatch_rate = st.best_stats.mismatch_rate;
+    ctx->stats.frozen_rate   = st.best_stats.frozen_rate;
+    ctx->stats.stale_rate    = st.best_stats.stale_rate;
+    ctx->stats.repairs       = st.best_stats.repairs;
+    ctx->stats.timing       = omp_get_wtime() - timing;
+    ctx->stats.best_restart = st.best;
+    ctx->stats.abandoned    = st.abandoned;
+
+    if (ctx->cfg.debug)
+        printf("restarts = %d best = %d abandoned = %d (T = %7.4f)\n",
+               rc->n_init, st.best, st.abandoned, ctx->stats.timing);
+    return 1;
+}
@@ -0,0 +1,75 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_server.h                                           */
+/*   Description:  binary protocol of the nearest-center query server       */
+/*                 (server_main) and its client (query_main) over a Unix    */
+/*                 domain socket. Both ends run on the same host, so all    */
+/*                 fields are in host byte order.                            */
+/*                                                                           */
+/*                 Every message starts with a kmq_header. A client may     */
+/*                 send any number of requests without waiting (pipelining);*/
+/*                 replies on one connection come back in request order and */
+/*                 carry the id of their request.                            */
+/*                                                                           */
+/*                 KMQ_QUERY : count*numCoords floats -> count int ids,     */
+/*                             followed by count float squared distances    */
+/*                             when KMQ_WANT_DIST is or'ed into the type    */
+/*                 KMQ_INFO  : no payload -> kmq_info                        */
+/*                 KMQ_STATS : no payload -> kmq_stats                       */
+/*                 KMQ_RELOAD: no payload -> no payload, re-reads the model */
+/*                 a request that cannot be served is answered by KMQ_ERROR */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _H_KMEANS_SERVER
+#define _H_KMEANS_SERVER
+
+#include <stdint.h>
+
+#define KMQ_MAGIC      0x31514d4bu   /* "KMQ1" */
+#define KMQ_MAX_COUNT  (1 << 20)     /* max objects in one query */
+
+enum {
+    KMQ_QUERY  = 1,
+    KMQ_INFO   = 2,
+    KMQ_STATS  = 3,
+    KMQ_RELOAD = 4,
+    KMQ_ERROR  = 255
+};
+#define KMQ_TYPE_MASK  0xff
+#define KMQ_WANT_DIST  0x100
+
+typedef struct {
+    uint32_t magic;
+    uint32_t type;      /* request type, or'ed with flags */
+    uint32_t id;        /* chosen by the client, echoed in the reply */
+    uint32_t count;     /* no. objects in the payload */
+} kmq_header;
+
+typedef struct {
+    uint32_t numClusters;
+    uint32_t numCoords;
+    uint32_t generation;  /* incremented at each model reload */
+    uint32_t pad;
+} kmq_info;
+
+typedef struct {
+    uint64_t requests;    /* requests served */
+    uint64_t queries;     /* objects assigned */
+    uint64_t batches;     /* calls of the nearest-center kernel */
+    uint64_t reloads;     /* successful model reloads */
+    double   uptime;      /* sec */
+    double   qps;         /* objects/sec over the last full second */
+    double   p50_us;      /* request latency percentiles, over the last */
+    double   p99_us;      /* KMQ_LAT_WINDOW requests */
+    double   mean_batch;  /* objects per kernel call */
+} kmq_stats;
+
+#define KMQ_LAT_WINDOW 65536
+
+#endif
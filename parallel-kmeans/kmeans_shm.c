@@ -0,0 +1,337 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_shm.c                                              */
+/*   Description:  shared-memory single-producer/single-consumer query ring */
+/*                 of the k-means library, see kmeans_shm.h                  */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "kmeans_internal.h"
+#include "kmeans_shm.h"
+
+#define SHM_MAGIC  0x314d4853u   /* "SHM1" */
+#define SPIN_LOOPS 4096          /* polls before sleeping on the futex */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax()
+#endif
+
+/* segment layout: header, counts[nslots], inputs[nslots][slotObjs][numCoords],
+   ids[nslots][slotObjs], each part starting on a cache line */
+typedef struct {
+    uint32_t magic;
+    uint32_t numCoords;
+    uint32_t slotObjs;
+    uint32_t nslots;
+    uint64_t size;              /* bytes of the whole segment */
+    char     pad0[KMEANS_ALIGN - 24];
+
+    uint32_t head;              /* slots submitted, written by the producer */
+    uint32_t prod_waiting;      /* producer sleeps on done */
+    char     pad1[KMEANS_ALIGN - 8];
+
+    uint32_t done;              /* slots served, written by the consumer */
+    uint32_t cons_waiting;      /* consumer sleeps on head */
+    char     pad2[KMEANS_ALIGN - 8];
+} shm_header;
+
+struct kmeans_shm {
+    shm_header *hdr;
+    int        *counts;         /* [nslots] */
+    float      *inputs;         /* [nslots][slotObjs][numCoords] */
+    int        *ids;            /* [nslots][slotObjs] */
+    size_t      size;
+    char        name[256];
+
+    /* producer-local state */
+    uint32_t    head;           /* next slot to submit */
+    uint32_t    consumed;       /* next result to read */
+};
+
+static size_t align_up(size_t n) {
+    return (n + KMEANS_ALIGN - 1) & ~((size_t)KMEANS_ALIGN - 1);
+}
+
+static size_t segment_size(int numCoords, int slotObjs, int nslots,
+                           size_t *off_counts, size_t *off_inputs,
+                           size_t *off_ids)
+{
+    size_t off = align_up(sizeof(shm_header));
+    *off_counts = off;
+    off = align_up(off + (size_t)nslots * sizeof(int));
+    *off_inputs = off;
+    off = align_up(off + (size_t)nslots * slotObjs * numCoords * sizeof(float));
+    *off_ids    = off;
+    off = align_up(off + (size_t)nslots * slotObjs * sizeof(int));
+    return off;
+}
+
+static void shm_setup(kmeans_shm *s) {
+    size_t off_counts, off_inputs, off_ids;
+    segment_size(s->hdr->numCoords, s->hdr->slotObjs, s->hdr->nslots,
+                 &off_counts, &off_inputs, &off_ids);
+    s->counts = (int*)   ((char*)s->hdr + off_counts);
+    s->inputs = (float*) ((char*)s->hdr + off_inputs);
+    s->ids    = (int*)   ((char*)s->hdr + off_ids);
+}
+
+/*----< futex helpers >------------------------------------------------------*/
+/* the segment is shared between processes, so no FUTEX_PRIVATE_FLAG */
+static void futex_wait(uint32_t *addr, uint32_t val, long nsec) {
+    struct timespec ts;
+    ts.tv_sec  = nsec / 1000000000L;
+    ts.tv_nsec = nsec % 1000000000L;
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/* wait until *counter != seen, spinning first; the waiting flag tells the
+   other side that a futex wake is needed. Returns the new counter value,
+   or seen if the timeout expired. */
+static uint32_t wait_change(uint32_t *counter, uint32_t *waiting,
+                            uint32_t seen, long nsec) {
+    uint32_t v;
+    int      i;
+
+    for (i=0; i<SPIN_LOOPS; i++) {
+        v = __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+        if (v != seen) return v;
+        cpu_relax();
+    }
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    v = __atomic_load_n(counter, __ATOMIC_SEQ_CST);
+    if (v == seen) {
+        futex_wait(counter, seen, nsec);
+        v = __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+    return v;
+}
+
+/* publish a new counter value and wake the other side if it sleeps */
+static void publish(uint32_t *counter, uint32_t *waiting, uint32_t v) {
+    __atomic_store_n(counter, v, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+        futex_wake(counter);
+}
+
+/*----< kmeans_shm_create() >------------------------------------------------*/
+kmeans_shm* kmeans_shm_create(const char *name,
+                              int         numCoords,
+                              int         slotObjs,
+                              int         nslots)
+{
+    int         fd;
+    size_t      size, off_counts, off_inputs, off_ids;
+    kmeans_shm *s;
+
+    if (numCoords <= 0 || slotObjs <= 0 || nslots <= 0) return NULL;
+    size = segment_size(numCoords, slotObjs, nslots, &off_counts, &off_inputs,
+                        &off_ids);
+
+    shm_unlink(name);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    s = (kmeans_shm*) calloc(1, sizeof(kmeans_shm));
+    if (s == NULL) { close(fd); return NULL; }
+    s->hdr = (shm_header*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                fd, 0);
+    close(fd);
+    if (s->hdr == MAP_FAILED) {
+        shm_unlink(name);
+        free(s);
+        return NULL;
+    }
+    s->size = size;
+    strncpy(s->name, name, sizeof(s->name) - 1);
+
+    s->hdr->numCoords = numCoords;
+    s->hdr->slotObjs  = slotObjs;
+    s->hdr->nslots    = nslots;
+    s->hdr->size      = size;
+    s->hdr->head      = 0;
+    s->hdr->done      = 0;
+    shm_setup(s);
+    /* magic last: a client attaching early sees an unusable segment */
+    __atomic_store_n(&s->hdr->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    return s;
+}
+
+/*----< kmeans_shm_attach() >------------------------------------------------*/
+kmeans_shm* kmeans_shm_attach(const char *name)
+{
+    int         fd;
+    struct stat sb;
+    kmeans_shm *s;
+
+    fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(shm_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    s = (kmeans_shm*) calloc(1, sizeof(kmeans_shm));
+    if (s == NULL) { close(fd); return NULL; }
+    s->hdr = (shm_header*) mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED, fd, 0);
+    close(fd);
+    if (s->hdr == MAP_FAILED ||
+        __atomic_load_n(&s->hdr->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC ||
+        s->hdr->size != (uint64_t)sb.st_size) {
+        if (s->hdr != MAP_FAILED) munmap(s->hdr, sb.st_size);
+        free(s);
+        return NULL;
+    }
+    s->size = sb.st_size;
+    strncpy(s->name, name, sizeof(s->name) - 1);
+    shm_setup(s);
+
+    /* a new producer continues after whatever the previous one left, once
+       the server has finished the slots still in flight */
+    s->head     = __atomic_load_n(&s->hdr->head, __ATOMIC_ACQUIRE);
+    s->consumed = s->head;
+    {
+        uint32_t done = __atomic_load_n(&s->hdr->done, __ATOMIC_ACQUIRE);
+        while (done != s->head)
+            done = wait_change(&s->hdr->done, &s->hdr->prod_waiting, done,
+                               100000000L);
+    }
+    return s;
+}
+
+/*----< kmeans_shm_close() >-------------------------------------------------*/
+void kmeans_shm_close(kmeans_shm *s, int do_unlink)
+{
+    if (s == NULL) return;
+    munmap(s->hdr, s->size);
+    if (do_unlink) shm_unlink(s->name);
+    free(s);
+}
+
+int kmeans_shm_coords   (const kmeans_shm *s) { return s->hdr->numCoords; }
+int kmeans_shm_slot_objs(const kmeans_shm *s) { return s->hdr->slotObjs;  }
+int kmeans_shm_slots    (const kmeans_shm *s) { return s->hdr->nslots;    }
+
+/*----< kmeans_shm_acquire() >-----------------------------------------------*/
+float* kmeans_shm_acquire(kmeans_shm *s)
+{
+    uint32_t slot;
+    if (s->head - s->consumed >= s->hdr->nslots) return NULL;
+    slot = s->head % s->hdr->nslots;
+    return s->inputs + (size_t)slot * s->hdr->slotObjs * s->hdr->numCoords;
+}
+
+/*----< kmeans_shm_submit() >------------------------------------------------*/
+void kmeans_shm_submit(kmeans_shm *s, int count)
+{
+    uint32_t slot = s->head % s->hdr->nslots;
+
+    if (count < 0) count = 0;
+    if (count > (int)s->hdr->slotObjs) count = s->hdr->slotObjs;
+    s->counts[slot] = count;
+    s->head++;
+    publish(&s->hdr->head, &s->hdr->cons_waiting, s->head);
+}
+
+/*----< kmeans_shm_result() >------------------------------------------------*/
+int kmeans_shm_result(kmeans_shm *s, const int **ids)
+{
+    uint32_t slot, done;
+
+    if (s->consumed == s->head) return -1;
+
+    done = __atomic_load_n(&s->hdr->done, __ATOMIC_ACQUIRE);
+    while ((int32_t)(done - s->consumed) <= 0)
+        done = wait_change(&s->hdr->done, &s->hdr->prod_waiting, done,
+                           100000000L);
+
+    slot = s->consumed % s->hdr->nslots;
+    *ids = s->ids + (size_t)slot * s->hdr->slotObjs;
+    s->consumed++;
+    return s->counts[slot];
+}
+
+/*----< kmeans_shm_serve() >-------------------------------------------------*/
+long kmeans_shm_serve(kmeans_shm *s,
+                      kmeans_ctx *ctx,
+                      volatile int *stop)
+{
+    uint32_t nslots   = s->hdr->nslots;
+    int      slotObjs = s->hdr->slotObjs;
+    int      numCoords = s->hdr->numCoords;
+    uint32_t done, head, i;
+    long     total = 0;
+    float  **rows;
+
+    if (ctx->modelT == NULL || ctx->modelCoords != numCoords) return -1;
+
+    /* row pointers into the shared inputs, fixed for the life of the ring */
+    rows = (float**) malloc((size_t)nslots * slotObjs * sizeof(float*));
+    if (rows == NULL) return -1;
+    for (i=0; i<nslots * (uint32_t)slotObjs; i++)
+        rows[i] = s->inputs + (size_t)i * numCoords;
+
+    done = __atomic_load_n(&s->hdr->done, __ATOMIC_ACQUIRE);
+    head = done;
+    while (!*stop) {
+        uint32_t first, last;
+
+        head = __atomic_load_n(&s->hdr->head, __ATOMIC_ACQUIRE);
+        if (head == done) {
+            head = wait_change(&s->hdr->head, &s->hdr->cons_waiting, done,
+                               100000000L);
+            if (head == done) continue;
+        }
+
+        /* serve the submitted slots in runs that do not wrap around; a run
+           of full slots, possibly ending with a partial one, is one kernel
+           call whose rows and ids are contiguous in the segment */
+        while (done != head) {
+            int n = 0;
+            first = done % nslots;
+            last  = first;
+            while (done + (last - first) != head && last < nslots) {
+                n += s->counts[last];
+                last++;
+                if (s->counts[last-1] != slotObjs) break;
+            }
+            if (n > 0)
+                kmeans_predict(ctx, rows + (size_t)first * slotObjs, n,
+                               s->ids + (size_t)first * slotObjs, NULL);
+            total += n;
+            done  += last - first;
+            publish(&s->hdr->done, &s->hdr->prod_waiting, done);
+        }
+    }
+    free(rows);
+    return total;
+}
@@ -0,0 +1,67 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_shm.h                                              */
+/*   Description:  zero-copy shared-memory query ring of the k-means        */
+/*                 library, for clients running on the same host as the     */
+/*                 server. A ring is a POSIX shared memory segment holding  */
+/*                 nslots slots; each slot has room for slotObjs query      */
+/*                 vectors and their cluster ids. One client (the producer) */
+/*                 writes vectors in place and submits the slot, one server */
+/*                 thread (the consumer) runs kmeans_predict() directly on  */
+/*                 the slot and writes the ids back in place.               */
+/*                                                                           */
+/*                 The head (submitted) and done (served) slot counters are */
+/*                 lock-free; a side that finds nothing to do spins briefly */
+/*                 and then sleeps on the counter with a futex.             */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _H_KMEANS_SHM
+#define _H_KMEANS_SHM
+
+#include "kmeans_lib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct kmeans_shm kmeans_shm;
+
+/* server side: create the segment /name; returns NULL on failure */
+kmeans_shm* kmeans_shm_create(const char *name, int numCoords, int slotObjs,
+                              int nslots);
+/* client side: map an existing segment; returns NULL on failure */
+kmeans_shm* kmeans_shm_attach(const char *name);
+/* unmap, and remove the segment name when do_unlink is set */
+void        kmeans_shm_close(kmeans_shm*, int do_unlink);
+
+int kmeans_shm_coords(const kmeans_shm*);
+int kmeans_shm_slot_objs(const kmeans_shm*);
+int kmeans_shm_slots(const kmeans_shm*);
+
+/* producer ----------------------------------------------------------------*/
+/* input area [slotObjs][numCoords] of the next free slot, or NULL when all
+   slots hold results not yet read with kmeans_shm_result() */
+float* kmeans_shm_acquire(kmeans_shm*);
+/* hand the acquired slot, holding count vectors, to the server */
+void   kmeans_shm_submit(kmeans_shm*, int count);
+/* wait for the oldest submitted slot; *ids points to its count cluster ids
+   and stays valid until that slot is acquired again. Returns the count, or
+   -1 when nothing is in flight. */
+int    kmeans_shm_result(kmeans_shm*, const int **ids);
+
+/* consumer ----------------------------------------------------------------*/
+/* serve the ring with the model of ctx until *stop becomes non-zero;
+   returns the number of vectors assigned */
+long   kmeans_shm_serve(kmeans_shm*, kmeans_ctx *ctx, volatile int *stop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,315 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_sketch.c                                           */
+/*   Description:  the "sketch" engine, for objects with many coordinates.  */
+/*                 Objects and centers are projected on a few orthonormal   */
+/*                 random directions (the objects once per fit, the centers */
+/*                 once per pass), plus the length of the rest. A           */
+/*                 projection never makes a distance longer, so the         */
+/*                 distance between sketches is a lower bound of the true   */
+/*                 one. Each object takes the few centers */
+/*                 nearest in sketch space and computes their exact         */
+/*                 distances; any other center whose sketch distance is not */
+/*                 above the best exact one (the margin is too small) is    */
+/*                 checked exactly as well. The membership is the one of    */
+/*                 the full scan of find_nearest_cluster().                 */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+#define SKETCH_SEED     20050101u   /* the directions are the same every fit */
+
+/*----< kmeans_sketch_shape() >----------------------------------------------*/
+/* sketch dimensions and shortlist length of the configuration, for data of  */
+/* this shape                                                                */
+void kmeans_sketch_shape(const kmeans_ctx *ctx,
+                         int               numCoords,
+                         int               numClusters,
+                         int              *dims,
+                         int              *cands)
+{
+    *dims  = (ctx->cfg.sketch_dims > 0) ? ctx->cfg.sketch_dims
+                                        : (numCoords / 4 < 16 ? numCoords / 4 : 16);
+    if (*dims < 1)         *dims = 1;
+    if (*dims > numCoords) *dims = numCoords;
+
+    *cands = (ctx->cfg.sketch_cands > 0) ? ctx->cfg.sketch_cands : 4;
+    if (*cands > KMEANS_SKETCH_MAX_CANDS) *cands = KMEANS_SKETCH_MAX_CANDS;
+    if (*cands > numClusters)             *cands = numClusters;
+}
+
+/*----< gauss() >------------------------------------------------------------*/
+static double gauss(unsigned *seed)
+{
+    double u = ((double)rand_r(seed) + 1.0) / ((double)RAND_MAX + 2.0);
+    double v = ((double)rand_r(seed) + 1.0) / ((double)RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/*----< reserve_sketch() >---------------------------------------------------*/
+static int reserve_sketch(kmeans_ctx *ctx, int numCoords, int numObjs,
+                          int numClusters, int dims)
+{
+    if ((size_t)dims * numCoords > ctx->capSketchP) {
+        kmeans_aligned_free(ctx->sketchP);
+        ctx->capSketchP = (size_t)dims * numCoords;
+        ctx->sketchP    = (double*) kmeans_aligned_alloc(ctx->capSketchP * sizeof(double));
+        ctx->stats.num_allocs++;
+    }
+    if (numCoords > ctx->capSketchCoords) {
+        kmeans_aligned_free(ctx->sketchMean);
+        ctx->capSketchCoords = numCoords;
+        ctx->sketchMean = (double*) kmeans_aligned_alloc(numCoords * sizeof(double));
+        ctx->stats.num_allocs++;
+    }
+    if ((size_t)(dims + 1) * numObjs > ctx->capSketchObjs) {
+        kmeans_aligned_free(ctx->sketchObjs);
+        ctx->capSketchObjs = (size_t)(dims + 1) * numObjs;
+        ctx->sketchObjs = (float*) kmeans_aligned_alloc(ctx->capSketchObjs * sizeof(float));
+        ctx->stats.num_allocs++;
+    }
+    if ((size_t)(dims + 1) * numClusters > ctx->capSketchC) {
+        kmeans_aligned_free(ctx->sketchC);
+        ctx->capSketchC = (size_t)(dims + 1) * numClusters;
+        ctx->sketchC    = (float*) kmeans_aligned_alloc(ctx->capSketchC * sizeof(float));
+        ctx->stats.num_allocs++;
+    }
+    if (ctx->sketchP == NULL || ctx->sketchMean == NULL ||
+        ctx->sketchObjs == NULL || ctx->sketchC == NULL) {
+        ctx->capSketchP = ctx->capSketchObjs = ctx->capSketchC = 0;
+        ctx->capSketchCoords = 0;
+        return 0;
+    }
+    return 1;
+}
+
+/*----< sketch_one() >-------------------------------------------------------*/
+/* x - mean on the directions, and last the length of what the directions    */
+/* miss; any two such sketches are no further apart than the points, as the  */
+/* missed parts are at least as far apart as their lengths differ            */
+static double sketch_one(const kmeans_ctx *ctx,
+                         const float      *x,         /* [numCoords] */
+                         int               numCoords,
+                         int               dims,
+                         float            *sk)        /* out: [dims+1] */
+{
+    int    j, r;
+    double n2 = 0.0, p2 = 0.0;
+
+    for (j=0; j<numCoords; j++)
+        n2 += (x[j] - ctx->sketchMean[j]) * (x[j] - ctx->sketchMean[j]);
+    for (r=0; r<dims; r++) {
+        const double *p = ctx->sketchP + (size_t)r * numCoords;
+        double v = 0.0;
+        for (j=0; j<numCoords; j++) v += p[j] * (x[j] - ctx->sketchMean[j]);
+        sk[r] = (float)v;
+        p2   += v * v;
+    }
+    sk[dims] = (float)sqrt(n2 > p2 ? n2 - p2 : 0.0);
+    return n2;
+}
+
+/*----< sketch_objects() >---------------------------------------------------*/
+/* the directions (Gram-Schmidt on Gaussian rows), the mean the sketches are */
+/* taken from, and the sketches of the objects                               */
+static int sketch_objects(kmeans_ctx *ctx,
+                          float     **objects,
+                          int         numCoords,
+                          int         numObjs,
+                          int         dims)
+{
+    int      i, j, r, s;
+    unsigned seed = SKETCH_SEED;
+    double   norm2 = 0.0;
+
+    for (r=0; r<dims; r++) {
+        double *row = ctx->sketchP + (size_t)r * numCoords;
+        double  len;
+        do {
+            for (j=0; j<numCoords; j++) row[j] = gauss(&seed);
+            for (s=0; s<r; s++) {
+                double *prev = ctx->sketchP + (size_t)s * numCoords, dot = 0.0;
+                for (j=0; j<numCoords; j++) dot += row[j] * prev[j];
+                for (j=0; j<numCoords; j++) row[j] -= dot * prev[j];
+            }
+            for (len=0.0, j=0; j<numCoords; j++) len += row[j] * row[j];
+            len = sqrt(len);
+        } while (len < 1e-6);
+        for (j=0; j<numCoords; j++) row[j] /= len;
+    }
+
+    for (j=0; j<numCoords; j++) ctx->sketchMean[j] = 0.0;
+    for (i=0; i<numObjs; i++)
+        for (j=0; j<numCoords; j++) ctx->sketchMean[j] += objects[i][j];
+    for (j=0; j<numCoords; j++) ctx->sketchMean[j] /= numObjs;
+
+    #pragma omp parallel for num_threads(ctx->nthreads) schedule(static) \
+            reduction(max:norm2)
+    for (i=0; i<numObjs; i++) {
+        double n2 = sketch_one(ctx, objects[i], numCoords, dims,
+                               ctx->sketchObjs + (size_t)i * (dims + 1));
+        if (n2 > norm2) norm2 = n2;
+    }
+
+    /* the sketches are rounded to float: each of the dims+1 values is off by
+       at most eps |x|, and |x - c| <= 2 max |x|, so a sketch distance can be
+       too long by at most this much */
+    ctx->sketchSlack = (float)(8.0 * sqrt(dims + 1.0) * FLT_EPSILON * norm2);
+    return 1;
+}
+
+/*----< euclid_dist_2() >----------------------------------------------------*/
+/* as in kmeans_engine.c, so the exact distances are the same                */
+static inline
+float euclid_dist_2(int numdims, const float *coord1, const float *coord2)
+{
+    int i;
+    float ans=0.0;
+
+    for (i=0; i<numdims; i++)
+        ans += (coord1[i]-coord2[i]) * (coord1[i]-coord2[i]);
+
+    return(ans);
+}
+
+/*----< kmeans_pass_sketch() >-----------------------------------------------*/
+float kmeans_pass_sketch(kmeans_ctx *ctx,
+                         float     **objects,     /* [numObjs][numCoords] */
+                         int         numCoords,
+                         int         numObjs,
+                         int         numClusters,
+                         int        *membership,  /* in/out: [numObjs] */
+                         float     **clusters,    /* [numClusters][numCoords] */
+                         double     *sse)
+{
+    int    i, dims, cands;
+    size_t padK  = KMEANS_PAD((size_t)ctx->capClusters);
+    size_t padKD = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);
+    float  delta = 0.0;
+    double sum   = 0.0, coords = 0.0, fallbacks = 0.0;
+
+    kmeans_sketch_shape(ctx, numCoords, numClusters, &dims, &cands);
+    if (!reserve_sketch(ctx, numCoords, numObjs, numClusters, dims)) return -1;
+
+    /* the objects once per fit */
+    if (ctx->sketchKey != objects || ctx->sketchN != numObjs ||
+        ctx->sketchDims != dims) {
+        if (!sketch_objects(ctx, objects, numCoords, numObjs, dims)) return -1;
+        ctx->sketchKey  = objects;
+        ctx->sketchN    = numObjs;
+        ctx->sketchDims = dims;
+    }
+
+    /* the centers every pass */
+    for (i=0; i<numClusters; i++)
+        sketch_one(ctx, clusters[i], numCoords, dims,
+                   ctx->sketchC + (size_t)i * (dims + 1));
+
+    #pragma omp parallel num_threads(ctx->nthreads) \
+            shared(objects,clusters,membership)
+    {
+        int    n, k, c, d, nlist, index;
+        int    list[KMEANS_SKETCH_MAX_CANDS];
+        float  list_d[KMEANS_SKETCH_MAX_CANDS];
+        int    tid        = omp_get_thread_num();
+        int   *local_size = ctx->local_newClusterSize + tid * padK;
+        float *local_sum  = ctx->local_newClusters    + tid * padKD;
+        float *skDist     = ctx->distArray            + tid * padK;
+        float  slack      = ctx->sketchSlack;
+        /* the exact distances and the sketch sums round too */
+        float  tol        = 1.0f + 4.0f * FLT_EPSILON * (numCoords + dims + 1);
+
+        #pragma omp for schedule(static) reduction(+:delta,sum,coords,fallbacks)
+        for (n=0; n<numObjs; n++) {
+            const float *sk = ctx->sketchObjs + (size_t)n * (dims + 1);
+            float  rest = FLT_MAX, min_dist, dist;
+
+            /* sketch distances, and the cands nearest in sorted order */
+            nlist = 0;
+            for (k=0; k<numClusters; k++) {
+                const float *skc = ctx->sketchC + (size_t)k * (dims + 1);
+                dist = 0.0;
+                for (d=0; d<=dims; d++)
+                    dist += (sk[d] - skc[d]) * (sk[d] - skc[d]);
+                skDist[k] = dist;
+
+                if (nlist == cands) {
+                    if (dist >= list_d[nlist-1]) {
+                        if (dist < rest) rest = dist;
+                        continue;
+                    }
+                    if (list_d[nlist-1] < rest) rest = list_d[nlist-1];
+                    nlist--;
+                }
+                for (c=nlist; c>0 && list_d[c-1] > dist; c--) {
+                    list[c]   = list[c-1];
+                    list_d[c] = list_d[c-1];
+                }
+                list[c]   = k;
+                list_d[c] = dist;
+                nlist++;
+            }
+            coords += (double)numClusters * (dims + 1);
+
+            /* exact distances of the shortlist; ties to the lowest index */
+            index    = list[0];
+            min_dist = euclid_dist_2(numCoords, objects[n], clusters[index]);
+            skDist[index] = -1.0;
+            for (c=1; c<nlist; c++) {
+                k    = list[c];
+                dist = euclid_dist_2(numCoords, objects[n], clusters[k]);
+                if (dist < min_dist || (dist == min_dist && k < index)) {
+                    min_dist = dist;
+                    index    = k;
+                }
+                skDist[k] = -1.0;
+            }
+            coords += (double)nlist * numCoords;
+
+            /* margin too small: every center that may still be as near */
+            if (rest <= min_dist * tol + slack) {
+                fallbacks += 1.0;
+                for (k=0; k<numClusters; k++) {
+                    if (skDist[k] < 0.0 ||
+                        skDist[k] > min_dist * tol + slack)
+                        continue;
+                    dist = euclid_dist_2(numCoords, objects[n], clusters[k]);
+                    coords += numCoords;
+                    if (dist < min_dist || (dist == min_dist && k < index)) {
+                        min_dist = dist;
+                        index    = k;
+                    }
+                }
+            }
+
+            sum += min_dist;
+            kmeans_far_offer(ctx, tid, n, min_dist);
+            if (membership[n] != index) delta += 1.0;
+            membership[n] = index;
+
+            local_size[index]++;
+            for (d=0; d<numCoords; d++)
+                local_sum[(size_t)index*numCoords + d] += objects[n][d];
+        }
+
+        kmeans_reduce_local(ctx, numCoords, numClusters);
+    }
+
+    ctx->partialDims     += coords;
+    ctx->sketchFallbacks += fallbacks;
+    *sse = sum;
+    return delta;
+}
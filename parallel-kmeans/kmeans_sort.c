@@ -0,0 +1,184 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_sort.c                                             */
+/*   Description:  the "sorted" engine: the update step without atomics.    */
+/*                 After the assignment the objects are grouped by cluster  */
+/*                 with a parallel counting sort on membership[], and every */
+/*                 cluster then sums its own contiguous list of objects.    */
+/*                 Nothing is shared between threads while summing, and     */
+/*                 each list is in object order, so the centers are the     */
+/*                 same whatever the number of threads. The grouping is     */
+/*                 kept in the context as a cluster -> objects index        */
+/*                 (kmeans_cluster_index()).                                 */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+/*----< reserve_index() >----------------------------------------------------*/
+static int reserve_index(kmeans_ctx *ctx, int numObjs, int numClusters)
+{
+    if (numObjs > ctx->capObjs) {
+        kmeans_aligned_free(ctx->order);
+        ctx->order   = (int*) kmeans_aligned_alloc((size_t)numObjs * sizeof(int));
+        ctx->capObjs = (ctx->order != NULL) ? numObjs : 0;
+        ctx->stats.num_allocs++;
+    }
+    if (numClusters + 1 > ctx->capOffsets) {
+        kmeans_aligned_free(ctx->offsets);
+        ctx->offsets    = (int*) kmeans_aligned_alloc((numClusters + 1) * sizeof(int));
+        ctx->capOffsets = (ctx->offsets != NULL) ? numClusters + 1 : 0;
+        ctx->stats.num_allocs++;
+    }
+    return (ctx->order != NULL && ctx->offsets != NULL);
+}
+
+/*----< kmeans_pass_sorted() >-----------------------------------------------*/
+float kmeans_pass_sorted(kmeans_ctx *ctx,
+                         float     **objects,     /* [numObjs][numCoords] */
+                         int         numCoords,
+                         int         numObjs,
+                         int         numClusters,
+                         int        *membership,  /* in/out: [numObjs] */
+                         float     **clusters,    /* [numClusters][numCoords] */
+                         double     *sse)
+{
+    int    i, j, nthreads = ctx->nthreads;
+    size_t padK  = KMEANS_PAD((size_t)ctx->capClusters);
+    float  delta = 0.0;
+    double sum   = 0.0;
+    int   *order, *offsets;
+
+    ctx->indexObjs = ctx->indexClusters = 0;
+    if (!reserve_index(ctx, numObjs, numClusters)) return -1;
+    order   = ctx->order;
+    offsets = ctx->offsets;
+
+    for (i=0; i<numClusters; i++)
+        for (j=0; j<numCoords; j++)
+            ctx->clustersT[(size_t)j*numClusters + i] = clusters[i][j];
+
+    #pragma omp parallel num_threads(nthreads) reduction(+:delta,sum)
+    {
+        int    n, k, d, t;
+        int    tid  = omp_get_thread_num();
+        int    team = omp_get_num_threads();    /* may be < nthreads */
+        int    lo   = (int)((long long)numObjs *  tid    / team);
+        int    hi   = (int)((long long)numObjs * (tid+1) / team);
+        int   *hist = ctx->local_newClusterSize + tid * padK;   /* [numClusters] */
+        float *distArray = ctx->distArray + tid * padK;
+
+        /* assignment of the thread's block, and its cluster histogram */
+        for (n=lo; n<hi; n++) {
+            float dist;
+            k = kmeans_nearest_transposed(objects[n], ctx->clustersT, numCoords,
+                                          numClusters, numClusters, distArray,
+                                          &dist);
+            sum += dist;
+            kmeans_far_offer(ctx, tid, n, dist);
+            if (membership[n] != k) delta += 1.0;
+            membership[n] = k;
+            hist[k]++;
+        }
+        #pragma omp barrier
+
+        /* where each (cluster, thread) run starts: clusters in order, and the
+           blocks of a cluster in thread order, which is object order */
+        #pragma omp single
+        {
+            int pos = 0;
+            for (k=0; k<numClusters; k++) {
+                offsets[k] = pos;
+                for (t=0; t<team; t++) {
+                    int *h = ctx->local_newClusterSize + t * padK;
+                    int  c = h[k];
+                    h[k] = pos;
+                    pos += c;
+                }
+            }
+            offsets[numClusters] = pos;
+        }   /* implicit barrier */
+
+        for (n=lo; n<hi; n++)
+            order[hist[membership[n]]++] = n;
+        #pragma omp barrier
+
+        /* segmented sums, one cluster per iteration; the hist[] space is
+           left zeroed for the other engines */
+        for (k=0; k<numClusters; k++) hist[k] = 0;
+        #pragma omp for schedule(dynamic, 1)
+        for (k=0; k<numClusters; k++) {
+            float *c = ctx->newClusters + (size_t)k * numCoords;
+            for (n=offsets[k]; n<offsets[k+1]; n++) {
+                const float *object = objects[order[n]];
+                for (d=0; d<numCoords; d++)
+                    c[d] += object[d];
+            }
+            ctx->newClusterSize[k] = offsets[k+1] - offsets[k];
+        }
+    }
+
+    ctx->indexObjs     = numObjs;
+    ctx->indexClusters = numClusters;
+
+    *sse = sum;
+    return delta;
+}
+
+/*----< kmeans_cluster_index() >---------------------------------------------*/
+/* the objects of cluster k are order[offsets[k] .. offsets[k+1]-1], in      */
+/* ascending order; returns 0 if the last pass was not of the sorted engine  */
+int kmeans_cluster_index(const kmeans_ctx *ctx,
+                         int              *numObjs,
+                         int              *numClusters,
+                         const int       **offsets,   /* out: [numClusters+1] */
+                         const int       **order)     /* out: [numObjs] */
+{
+    if (ctx->indexClusters == 0) return 0;
+    *numObjs     = ctx->indexObjs;
+    *numClusters = ctx->indexClusters;
+    *offsets     = ctx->offsets;
+    *order       = ctx->order;
+    return 1;
+}
+
+/*----< kmeans_build_index() >-----------------------------------------------*/
+/* the same index from any membership, by a sequential counting sort         */
+int kmeans_build_index(const int *membership,   /* in: [numObjs] */
+                       int        numObjs,
+                       int        numClusters,
+                       int       *offsets,      /* out: [numClusters+1] */
+                       int       *order)        /* out: [numObjs] */
+{
+    int i, k, pos, *next;
+
+    next = (int*) calloc(numClusters + 1, sizeof(int));
+    if (next == NULL) return 0;
+    for (i=0; i<numObjs; i++) {
+        if (membership[i] < 0 || membership[i] >= numClusters) {
+            free(next);
+            return 0;
+        }
+        next[membership[i]]++;
+    }
+    for (pos=0, k=0; k<numClusters; k++) {
+        int c = next[k];
+        offsets[k] = next[k] = pos;
+        pos += c;
+    }
+    offsets[numClusters] = pos;
+    for (i=0; i<numObjs; i++)
+        order[next[membership[i]]++] = i;
+    free(next);
+    return 1;
+}
@@ -0,0 +1,147 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_split.c                                            */
+/*   Description:  warm start of a larger K from a finished solution: the   */
+/*                 cluster with the largest SSE is split in two along its   */
+/*                 per-coordinate spread until there are enough centers;    */
+/*                 when no cluster can be split, the new centers are        */
+/*                 objects that are not on a center already                 */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+/*----< nearest_dist() >-----------------------------------------------------*/
+/* squared distance from x to the nearest of the first k centers             */
+static double nearest_dist(const float *x, int numCoords, int k,
+                           float **clusters)
+{
+    int    i, j;
+    double best = -1.0;
+
+    for (i=0; i<k; i++) {
+        double d = 0.0;
+        for (j=0; j<numCoords; j++) {
+            double t = x[j] - clusters[i][j];
+            d += t * t;
+        }
+        if (best < 0.0 || d < best) best = d;
+    }
+    return best;
+}
+
+/*----< kmeans_split_centers() >---------------------------------------------*/
+int kmeans_split_centers(float     **objects,     /* in: [numObjs][numCoords] */
+                         int         numCoords,
+                         int         numObjs,
+                         const int  *membership,  /* in: [numObjs] */
+                         int         numClusters, /* no. centers in clusters */
+                         int         newClusters, /* no. centers wanted */
+                         float     **clusters)    /* in/out: [newClusters][numCoords] */
+{
+    int     i, j, k, best;
+    int    *size;
+    double *sse, *var;      /* [newClusters], [newClusters][numCoords] */
+
+    if (objects == NULL || membership == NULL || clusters == NULL ||
+        numClusters <= 0 || newClusters < numClusters ||
+        newClusters > numObjs)
+        return 0;
+    if (newClusters == numClusters) return 1;
+
+    size = (int*)    calloc(newClusters, sizeof(int));
+    sse  = (double*) calloc(newClusters, sizeof(double));
+    var  = (double*) calloc((size_t)newClusters * numCoords, sizeof(double));
+    if (size == NULL || sse == NULL || var == NULL) {
+        free(size); free(sse); free(var);
+        return 0;
+    }
+
+    /* per-cluster size and per-coordinate sum of squared deviations */
+    #pragma omp parallel private(i,j,k)
+    {
+        int    *my_size = (int*)    calloc(numClusters, sizeof(int));
+        double *my_var  = (double*) calloc((size_t)numClusters * numCoords,
+                                           sizeof(double));
+        #pragma omp for schedule(static)
+        for (i=0; i<numObjs; i++) {
+            k = membership[i];
+            if (k < 0 || k >= numClusters) continue;
+            my_size[k]++;
+            for (j=0; j<numCoords; j++) {
+                double d = objects[i][j] - clusters[k][j];
+                my_var[(size_t)k*numCoords + j] += d * d;
+            }
+        }
+        #pragma omp critical
+        {
+            for (k=0; k<numClusters; k++) {
+                size[k] += my_size[k];
+                for (j=0; j<numCoords; j++)
+                    var[(size_t)k*numCoords + j] += my_var[(size_t)k*numCoords + j];
+            }
+        }
+        free(my_var);
+        free(my_size);
+    }
+    for (k=0; k<numClusters; k++)
+        for (j=0; j<numCoords; j++)
+            sse[k] += var[(size_t)k*numCoords + j];
+
+    for (k=numClusters; k<newClusters; k++) {
+        best = 0;
+        for (i=1; i<k; i++)
+            if (sse[i] > sse[best]) best = i;
+
+        if (sse[best] <= 0.0 || size[best] < 2) {
+            /* nothing left to split: take evenly spaced objects, but not
+               one on a center, which would stay empty as ties go to the
+               lowest index; then the object farthest from the centers */
+            float *x = objects[(size_t)k * (numObjs-1) / (newClusters-1)];
+            if (nearest_dist(x, numCoords, k, clusters) <= 0.0) {
+                double d, far = 0.0;
+                x = NULL;
+                for (i=0; i<numObjs; i++) {
+                    d = nearest_dist(objects[i], numCoords, k, clusters);
+                    if (d > far) {
+                        far = d;
+                        x   = objects[i];
+                    }
+                }
+            }
+            if (x == NULL) break;   /* fewer distinct objects than centers */
+            memcpy(clusters[k], x, numCoords * sizeof(float));
+            continue;
+        }
+
+        /* move the two halves half a standard deviation apart from the
+           old center; each half is assumed to keep half of the SSE */
+        for (j=0; j<numCoords; j++) {
+            float s = (float) sqrt(var[(size_t)best*numCoords + j] / size[best]);
+            clusters[k][j]     = clusters[best][j] + 0.5f * s;
+            clusters[best][j] -= 0.5f * s;
+            var[(size_t)best*numCoords + j] *= 0.5;
+            var[(size_t)k*numCoords + j]     = var[(size_t)best*numCoords + j];
+        }
+        sse[best] *= 0.5;
+        sse[k]     = sse[best];
+        size[k]    = size[best] - size[best] / 2;
+        size[best] = size[best] / 2;
+    }
+
+    free(var);
+    free(sse);
+    free(size);
+    return (k == newClusters);
+}
@@ -0,0 +1,132 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         kmeans_tile.c                                             */
+/*   Description:  the "tiled" engine, for a large number of clusters. When */
+/*                 the transposed centers no longer fit in the L2 cache,    */
+/*                 every object of the transposed engine streams all of     */
+/*                 them from L3 or memory. Here the centers are cut into    */
+/*                 tiles that fit in half of the L2 cache, each stored as   */
+/*                 its own [numCoords][tile] block, and a block of objects  */
+/*                 is run against one tile after the other, keeping the     */
+/*                 running min distance and its center for each object.    */
+/*                 A tile is then read from memory once per block of        */
+/*                 objects instead of once per object. Distances and ties   */
+/*                 come out as in the transposed engine.                    */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>     /* sysconf() */
+
+#include <omp.h>
+#include "kmeans_internal.h"
+
+#define TILE_OBJS     256           /* objects in a block */
+#define TILE_L2_BYTES (256 * 1024)  /* when the L2 size is not known */
+
+/*----< kmeans_tile_clusters() >---------------------------------------------*/
+/* no. centers in a tile: cfg.tile_clusters, or half the L2 cache worth of   */
+/* numCoords floats, in whole cache lines                                    */
+int kmeans_tile_clusters(const kmeans_ctx *ctx, int numCoords, int numClusters)
+{
+    long l2 = 0;
+    int  tileK;
+
+    if (ctx->cfg.tile_clusters > 0)
+        tileK = ctx->cfg.tile_clusters;
+    else {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        if (l2 <= 0) l2 = TILE_L2_BYTES;
+        tileK = (int)(l2 / 2 / ((long)numCoords * sizeof(float)));
+        tileK &= ~15;
+        if (tileK < 16) tileK = 16;
+    }
+    return (tileK < numClusters) ? tileK : numClusters;
+}
+
+/*----< kmeans_pass_tiled() >------------------------------------------------*/
+float kmeans_pass_tiled(kmeans_ctx *ctx,
+                        float     **objects,     /* [numObjs][numCoords] */
+                        int         numCoords,
+                        int         numObjs,
+                        int         numClusters,
+                        int        *membership,  /* in/out: [numObjs] */
+                        float     **clusters,    /* [numClusters][numCoords] */
+                        double     *sse)
+{
+    int    i, j, nblocks;
+    int    tileK = kmeans_tile_clusters(ctx, numCoords, numClusters);
+    size_t padK  = KMEANS_PAD((size_t)ctx->capClusters);
+    size_t padKD = KMEANS_PAD((size_t)ctx->capClusters * ctx->capCoords);
+    float  delta = 0.0;
+    double sum   = 0.0;
+    float *tiles = ctx->clustersT;  /* tile at k0: [numCoords][width] at k0*numCoords */
+
+    for (i=0; i<numClusters; i++) {
+        int    k0    = i - i % tileK;
+        int    width = (k0 + tileK <= numClusters) ? tileK : numClusters - k0;
+        float *tile  = tiles + (size_t)k0 * numCoords;
+        for (j=0; j<numCoords; j++)
+            tile[(size_t)j*width + i - k0] = clusters[i][j];
+    }
+    nblocks = (numObjs + TILE_OBJS - 1) / TILE_OBJS;
+
+    #pragma omp parallel num_threads(ctx->nthreads) \
+            shared(objects,clusters,membership)
+    {
+        int    b, n, k, k0, d, index[TILE_OBJS];
+        float  min_dist[TILE_OBJS];
+        int    tid        = omp_get_thread_num();
+        int   *local_size = ctx->local_newClusterSize + tid * padK;
+        float *local_sum  = ctx->local_newClusters    + tid * padKD;
+        float *distArray  = ctx->distArray            + tid * padK;
+
+        #pragma omp for schedule(static) reduction(+:delta,sum)
+        for (b=0; b<nblocks; b++) {
+            int lo = b * TILE_OBJS;
+            int hi = (lo + TILE_OBJS < numObjs) ? lo + TILE_OBJS : numObjs;
+
+            /* the block against every tile, in order: a later tile wins
+               only if strictly nearer, as in a scan over all centers */
+            for (k0=0; k0<numClusters; k0+=tileK) {
+                int    width = (k0 + tileK <= numClusters) ? tileK : numClusters - k0;
+                float *tile  = tiles + (size_t)k0 * numCoords;
+                for (n=lo; n<hi; n++) {
+                    float dist;
+                    k = kmeans_nearest_transposed(objects[n], tile, numCoords,
+                                                  width, width, distArray,
+                                                  &dist);
+                    if (k0 == 0 || dist < min_dist[n-lo]) {
+                        min_dist[n-lo] = dist;
+                        index[n-lo]    = k0 + k;
+                    }
+                }
+            }
+
+            for (n=lo; n<hi; n++) {
+                k    = index[n-lo];
+                sum += min_dist[n-lo];
+                kmeans_far_offer(ctx, tid, n, min_dist[n-lo]);
+                if (membership[n] != k) delta += 1.0;
+                membership[n] = k;
+
+                local_size[k]++;
+                for (d=0; d<numCoords; d++)
+                    local_sum[(size_t)k*numCoords + d] += objects[n][d];
+            }
+        }
+
+        kmeans_reduce_local(ctx, numCoords, numClusters);
+    }
+
+    *sse = sum;
+    return delta;
+}
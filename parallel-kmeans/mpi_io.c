@@ -0,0 +1,172 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         mpi_io.c                                                  */
+/*   Description:  distributed input and output of the MPI version. A binary */
+/*                 file is read with MPI-IO, every process reading its own  */
+/*                 block of rows by offset; an ASCII file is read by process */
+/*                 0 and scattered. The membership is gathered to process 0 */
+/*                 for the output files.                                     */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mpi.h>
+#include "kmeans.h"
+
+/*---< mpi_block() >----------------------------------------------------------*/
+/* rows [start, start+count) of totalObjs owned by process rank of nproc      */
+static void mpi_block(int totalObjs, int rank, int nproc, int *start, int *count)
+{
+    int base = totalObjs / nproc;
+    int rem  = totalObjs % nproc;
+
+    *count = base + (rank < rem ? 1 : 0);
+    *start = rank * base + (rank < rem ? rank : rem);
+}
+
+/*---< mpi_read() >-----------------------------------------------------------*/
+float** mpi_read(int       isBinaryFile,  /* flag: 0 or 1 */
+                 char     *filename,      /* input file name */
+                 int      *numObjs,       /* no. data objects (local) */
+                 int      *numCoords,     /* no. coordinates */
+                 int      *totalObjs,     /* no. data objects (all processes) */
+                 MPI_Comm  comm)
+{
+    float    **objects;
+    int        i, j, len, rank, nproc, start;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nproc);
+
+    if (isBinaryFile) {  /* using MPI-IO to read file concurrently ----------*/
+        int          err, header[2];
+        MPI_File     fh;
+        MPI_Status   status;
+        MPI_Datatype row;
+
+        err = MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+        if (err != MPI_SUCCESS) {
+            if (rank == 0) fprintf(stderr, "Error: no such file (%s)\n", filename);
+            return NULL;
+        }
+
+        /* every process reads the header: numObjs and numCoords */
+        MPI_File_read_at_all(fh, 0, header, 2, MPI_INT, &status);
+        *totalObjs = header[0];
+        *numCoords = header[1];
+        if (_debug && rank == 0) {
+            printf("File %s numObjs   = %d\n",filename,*totalObjs);
+            printf("File %s numCoords = %d\n",filename,*numCoords);
+        }
+
+        mpi_block(*totalObjs, rank, nproc, &start, numObjs);
+
+        /* allocate space for the local objects[][] */
+        len = (*numObjs) * (*numCoords);
+        objects    = (float**)malloc(((*numObjs) > 0 ? (*numObjs) : 1) * sizeof(float*));
+        assert(objects != NULL);
+        objects[0] = (float*) malloc((len > 0 ? len : 1) * sizeof(float));
+        assert(objects[0] != NULL);
+        for (i=1; i<(*numObjs); i++)
+            objects[i] = objects[i-1] + (*numCoords);
+
+        /* one row is numCoords floats: the count stays small for large files */
+        MPI_Type_contiguous(*numCoords, MPI_FLOAT, &row);
+        MPI_Type_commit(&row);
+        MPI_File_read_at_all(fh, 2 * sizeof(int) +
+                             (MPI_Offset)start * (*numCoords) * sizeof(float),
+                             objects[0], *numObjs, row, &status);
+        MPI_Type_free(&row);
+
+        MPI_File_close(&fh);
+    }
+    else {  /* input file is in ASCII format: read by 0 and scattered ------*/
+        float **all = NULL;
+        int    *counts, *displs, header[2];
+
+        if (rank == 0) {
+            all = file_read(0, filename, &header[0], &header[1]);
+            if (all == NULL) header[0] = -1;
+        }
+        MPI_Bcast(header, 2, MPI_INT, 0, comm);
+        if (header[0] < 0) return NULL;
+        *totalObjs = header[0];
+        *numCoords = header[1];
+
+        counts = (int*) malloc(2 * nproc * sizeof(int));
+        assert(counts != NULL);
+        displs = counts + nproc;
+        for (j=0; j<nproc; j++) {
+            mpi_block(*totalObjs, j, nproc, &displs[j], &counts[j]);
+            counts[j] *= (*numCoords);
+            displs[j] *= (*numCoords);
+        }
+        *numObjs = counts[rank] / ((*numCoords) > 0 ? (*numCoords) : 1);
+
+        len = counts[rank];
+        objects    = (float**)malloc(((*numObjs) > 0 ? (*numObjs) : 1) * sizeof(float*));
+        assert(objects != NULL);
+        objects[0] = (float*) malloc((len > 0 ? len : 1) * sizeof(float));
+        assert(objects[0] != NULL);
+        for (i=1; i<(*numObjs); i++)
+            objects[i] = objects[i-1] + (*numCoords);
+
+        MPI_Scatterv(rank == 0 ? all[0] : NULL, counts, displs, MPI_FLOAT,
+                     objects[0], len, MPI_FLOAT, 0, comm);
+
+        free(counts);
+        if (rank == 0) {
+            free(all[0]);
+            free(all);
+        }
+    }
+
+    return objects;
+}
+
+/*---< mpi_write() >----------------------------------------------------------*/
+/* gather the membership to process 0, which writes the usual output files   */
+int mpi_write(char      *filename,     /* input file name */
+              int        numClusters,  /* no. clusters */
+              int        numObjs,      /* no. data objects (local) */
+              int        totalObjs,    /* no. data objects (all processes) */
+              int        numCoords,    /* no. coordinates */
+              float    **clusters,     /* [numClusters][numCoords] centers */
+              int       *membership,   /* [numObjs] */
+              int        verbose,
+              MPI_Comm   comm)
+{
+    int  j, rank, nproc, *counts, *displs, *all = NULL;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nproc);
+
+    counts = (int*) malloc(2 * nproc * sizeof(int));
+    assert(counts != NULL);
+    displs = counts + nproc;
+    for (j=0; j<nproc; j++)
+        mpi_block(totalObjs, j, nproc, &displs[j], &counts[j]);
+
+    if (rank == 0) {
+        all = (int*) malloc(totalObjs * sizeof(int));
+        assert(all != NULL);
+    }
+    MPI_Gatherv(membership, numObjs, MPI_INT, all, counts, displs, MPI_INT,
+                0, comm);
+
+    if (rank == 0) {
+        file_write(filename, numClusters, totalObjs, numCoords, clusters, all,
+                   verbose);
+        free(all);
+    }
+    free(counts);
+    return 1;
+}
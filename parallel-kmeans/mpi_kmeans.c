@@ -0,0 +1,166 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         mpi_kmeans.c                                              */
+/*   Description:  data-parallel k-means over MPI processes. Every process  */
+/*                 assigns its own block of objects with the OpenMP engine  */
+/*                 of the context, and the new center sums and sizes are    */
+/*                 combined with an allreduce, so all processes hold the    */
+/*                 same centers after each update.                           */
+/*                 The local objects are assigned in numChunks chunks: the  */
+/*                 partial sums of a chunk go into a non-blocking allreduce */
+/*                 as soon as the chunk is done, and its communication      */
+/*                 proceeds while the next chunk is assigned. Only the last */
+/*                 chunk's allreduce is not overlapped.                      */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mpi.h>
+#include <omp.h>
+#include "kmeans.h"
+#include "kmeans_internal.h"
+
+/*----< mpi_kmeans() >-------------------------------------------------------*/
+/* return 1 on success, with the centers and the local membership; the      */
+/* stats of ctx are the same on all processes                                */
+int mpi_kmeans(kmeans_ctx *ctx,
+               float     **objects,      /* in: [numObjs][numCoords] */
+               int         numCoords,    /* no. coordinates */
+               int         numObjs,      /* no. objects (local) */
+               int         totalObjs,    /* no. objects (all processes) */
+               int         numClusters,  /* no. clusters */
+               int         numChunks,    /* no. allreduce per pass, >= 1 and
+                                            the same on all processes */
+               int        *membership,   /* out: [numObjs] */
+               float     **clusters,     /* in/out: [numClusters][numCoords] */
+               MPI_Comm    comm)
+{
+    int          i, j, c, loop = 0, len, lo, hi;
+    float        delta;
+    double       sse, timing, *sums, *buf;
+    MPI_Request *reqs;
+    kmeans_stop  reason = KMEANS_STOP_CONVERGED;
+
+    if (ctx == NULL || objects == NULL || clusters == NULL ||
+        membership == NULL || numObjs < 0 || totalObjs <= 0 ||
+        numCoords <= 0 || numClusters <= 0 || numChunks <= 0 ||
+        ctx->cfg.metric != KMEANS_METRIC_L2)
+        return 0;
+
+    if (!kmeans_fit_prepare(ctx, numCoords, numClusters)) return 0;
+
+    /* per chunk: center sums [numClusters][numCoords], sizes [numClusters],
+       no. changed memberships and SSE */
+    len  = numClusters * numCoords + numClusters + 2;
+    sums = (double*) malloc((size_t)numChunks * len * sizeof(double));
+    reqs = (MPI_Request*) malloc(numChunks * sizeof(MPI_Request));
+    if (sums == NULL || reqs == NULL) {
+        free(sums); free(reqs);
+        return 0;
+    }
+
+    /* initialize membership[] */
+    for (i=0; i<numObjs; i++) membership[i] = -1;
+
+    MPI_Barrier(comm);
+    timing = MPI_Wtime();
+    do {
+        for (c=0; c<numChunks; c++) {
+            double csse = 0.0;
+
+            lo  = (int)((long long)numObjs *  c    / numChunks);
+            hi  = (int)((long long)numObjs * (c+1) / numChunks);
+            buf = sums + (size_t)c * len;
+
+            buf[len-2] = (hi > lo) ? kmeans_pass(ctx, objects + lo, numCoords,
+                                                 hi - lo, numClusters,
+                                                 membership + lo, clusters,
+                                                 &csse)
+                                   : 0.0;
+            buf[len-1] = csse;
+
+            /* move the chunk's sums out of ctx, which the next chunk reuses */
+            for (i=0; i<numClusters; i++) {
+                for (j=0; j<numCoords; j++) {
+                    buf[i*numCoords + j] = ctx->newClusters[(size_t)i*numCoords + j];
+                    ctx->newClusters[(size_t)i*numCoords + j] = 0.0;
+                }
+                buf[numClusters*numCoords + i] = ctx->newClusterSize[i];
+                ctx->newClusterSize[i] = 0;
+            }
+
+            if (c < numChunks - 1) {
+                MPI_Iallreduce(MPI_IN_PLACE, buf, len, MPI_DOUBLE, MPI_SUM,
+                               comm, &reqs[c]);
+                /* let the earlier reductions progress */
+                if (c > 0) {
+                    int flag;
+                    MPI_Testall(c, reqs, &flag, MPI_STATUSES_IGNORE);
+                }
+            }
+            else
+                MPI_Allreduce(MPI_IN_PLACE, buf, len, MPI_DOUBLE, MPI_SUM, comm);
+        }
+        if (numChunks > 1)
+            MPI_Waitall(numChunks - 1, reqs, MPI_STATUSES_IGNORE);
+
+        /* combine the chunks in a fixed order: every process gets the same
+           centers to the last bit */
+        for (c=1; c<numChunks; c++) {
+            buf = sums + (size_t)c * len;
+            for (i=0; i<len; i++) sums[i] += buf[i];
+        }
+
+        /* average the sum and replace old cluster centers with new ones */
+        for (i=0; i<numClusters; i++) {
+            double size = sums[numClusters*numCoords + i];
+            if (size > 1) {
+                for (j=0; j<numCoords; j++)
+                    clusters[i][j] = (float)(sums[i*numCoords + j] / size);
+            }
+        }
+        delta = (float)(sums[len-2] / totalObjs);
+        sse   = sums[len-1];
+
+        if (delta <= ctx->cfg.threshold) break;
+    } while (loop++ < ctx->cfg.max_loops);
+
+    if (loop > ctx->cfg.max_loops) reason = KMEANS_STOP_MAX_LOOPS;
+
+    ctx->stats.loops       = loop;
+    ctx->stats.delta       = delta;
+    ctx->stats.sse         = sse;
+    ctx->stats.timing      = MPI_Wtime() - timing;
+    ctx->stats.stop_reason = reason;
+    ctx->stats.dist_calcs  = (double)(loop + (reason == KMEANS_STOP_MAX_LOOPS ? 0 : 1))
+                             * totalObjs * numClusters;
+    /* of the local objects */
+    ctx->stats.dims_per_dist = ((ctx->cfg.partial ||
+                                 ctx->cfg.engine == KMEANS_ENGINE_SKETCH ||
+                                 ctx->cfg.engine == KMEANS_ENGINE_IVF) &&
+                                numObjs > 0)
+                             ? ctx->partialDims / (ctx->stats.dist_calcs /
+                                                   totalObjs * numObjs)
+                             : numCoords;
+
+    if (ctx->cfg.debug) {
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        if (rank == 0)
+            printf("engine = %s (MPI, %d chunks) nloops = %2d (T = %7.4f) stop = %s\n",
+                   kmeans_engine_name(ctx->cfg.engine), numChunks, loop,
+                   ctx->stats.timing, kmeans_stop_name(reason));
+    }
+
+    free(reqs);
+    free(sums);
+    return 1;
+}
@@ -0,0 +1,261 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         mpi_main.c   (an MPI+OpenMP version)                      */
+/*   Description:  This program shows an example on how to call a subroutine */
+/*                 that implements a simple k-means clustering algorithm     */
+/*                 based on Euclid distance, distributed over MPI processes */
+/*                 with OpenMP threads in each (mpi_kmeans)                  */
+/*   Input file format:                                                      */
+/*                 ASCII  file: each line contains 1 data object             */
+/*                 binary file: first 4-byte integer is the number of data   */
+/*                 objects and 2nd integer is the no. of features (or        */
+/*                 coordinates) of each object                               */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt() */
+
+#include <mpi.h>
+#include <omp.h>
+int      _debug;
+#include "kmeans.h"
+
+/*---< usage() >------------------------------------------------------------*/
+static void usage(char *argv0, float threshold) {
+    char *help =
+        "Usage: %s [switches] -i filename -n num_clusters\n"
+        "       -i filename    : file containing data to be clustered\n"
+        "       -c centers     : file containing initial centers. default: filename\n"
+        "       -b             : input file is in binary format (default no)\n"
+        "       -n num_clusters: number of clusters (K must > 1)\n"
+        "       -t threshold   : threshold value (default %.4f)\n"
+        "       -p nproc       : number of threads per process (default system\n"
+        "                        allocated)\n"
+        "       -e engine      : seq, atomic, reduction, transposed, tasks\n"
+        "                        pool, sorted, tiled, sketch or ivf (default\n"
+        "                        transposed)\n"
+        "       -P chunks      : no. allreduce per pass overlapped with the\n"
+        "                        assignment, 1 = none (default 4)\n"
+        "       -o             : output timing results (default no)\n"
+        "       -q             : quiet mode\n"
+        "       -d             : enable debug mode\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0, threshold);
+    MPI_Finalize();
+    exit(-1);
+}
+
+/*---< main() >---------------------------------------------------------------*/
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+           int     i, j, nthreads, verbose, rank, nproc, numChunks;
+           int     isBinaryFile, is_output_timing, ok;
+           int     numClusters, numCoords, numObjs, totalObjs;
+           int    *membership;    /* [numObjs] */
+           char   *filename, *center_filename, *engine_name;
+           float **objects;       /* [numObjs][numCoords] data objects */
+           float **clusters;      /* [numClusters][numCoords] cluster center */
+           float   threshold;
+           double  timing, io_timing, clustering_timing;
+           kmeans_config cfg;
+           kmeans_ctx   *ctx;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nproc);
+
+    /* some default values */
+    _debug           = 0;
+    verbose          = 1;
+    nthreads         = 0;
+    numChunks        = 4;
+    threshold        = 0.001;
+    numClusters      = 0;
+    isBinaryFile     = 0;
+    is_output_timing = 0;
+    filename         = NULL;
+    center_filename  = NULL;
+    engine_name      = NULL;
+
+    while ( (opt=getopt(argc,argv,"p:i:n:t:c:e:P:boqdh"))!= EOF) {
+        switch (opt) {
+            case 'i': filename = optarg;
+                      break;
+            case 'c': center_filename = optarg;
+                      break;
+            case 'b': isBinaryFile = 1;
+                      break;
+            case 't': threshold = atof(optarg);
+                      break;
+            case 'n': numClusters = atoi(optarg);
+                      break;
+            case 'p': nthreads = atoi(optarg);
+                      break;
+            case 'e': engine_name = optarg;
+                      break;
+            case 'P': numChunks = atoi(optarg);
+                      break;
+            case 'o': is_output_timing = 1;
+                      break;
+            case 'q': verbose = 0;
+                      break;
+            case 'd': _debug = 1;
+                      break;
+            case 'h':
+            default: if (rank == 0) usage(argv[0], threshold);
+                     MPI_Finalize();
+                     exit(-1);
+                      break;
+        }
+    }
+    if (center_filename == NULL)
+        center_filename = filename;
+
+    if (filename == 0 || numClusters <= 1 || numChunks < 1) {
+        if (rank == 0) usage(argv[0], threshold);
+        MPI_Finalize();
+        exit(-1);
+    }
+
+    kmeans_config_init(&cfg);
+    cfg.nthreads  = nthreads;
+    cfg.threshold = threshold;
+    cfg.debug     = _debug;
+    if (engine_name != NULL && !kmeans_engine_parse(engine_name, &cfg.engine)) {
+        if (rank == 0) printf("Error: unknown engine \"%s\"\n", engine_name);
+        MPI_Finalize();
+        exit(1);
+    }
+    if (nthreads > 0)
+        omp_set_num_threads(nthreads);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    io_timing = MPI_Wtime();
+
+    /* read data points from file ------------------------------------------*/
+    if (verbose && rank == 0) printf("reading data points from file %s\n",filename);
+
+    objects = mpi_read(isBinaryFile, filename, &numObjs, &numCoords,
+                       &totalObjs, MPI_COMM_WORLD);
+    if (objects == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+
+    if (totalObjs < numClusters) {
+        if (rank == 0)
+            printf("Error: number of clusters must be larger than the number of data points to be clustered.\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    /* allocate a 2D space for clusters[] (coordinates of cluster centers)
+       this array should be the same across all processes                  */
+    clusters    = (float**) malloc(numClusters *             sizeof(float*));
+    assert(clusters != NULL);
+    clusters[0] = (float*)  malloc(numClusters * numCoords * sizeof(float));
+    assert(clusters[0] != NULL);
+    for (i=1; i<numClusters; i++)
+        clusters[i] = clusters[i-1] + numCoords;
+
+    /* process 0 reads the first numClusters objects of center_filename as
+       the initial cluster centers and broadcasts them */
+    ok = 1;
+    if (rank == 0) {
+        if (verbose) printf("reading initial %d centers from file %s\n",
+                            numClusters, center_filename);
+        ok = read_n_objects(isBinaryFile, center_filename, numClusters,
+                            numCoords, clusters);
+        /* check initial cluster centers for repeatition */
+        if (ok && check_repeated_clusters(numClusters, numCoords, clusters) == 0) {
+            printf("Error: some initial clusters are repeated. Please select distinct initial centers\n");
+            ok = 0;
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) {
+        MPI_Finalize();
+        return 1;
+    }
+    MPI_Bcast(clusters[0], numClusters*numCoords, MPI_FLOAT, 0, MPI_COMM_WORLD);
+
+    if (_debug && rank == 0) {
+        printf("Sorted initial cluster centers:\n");
+        for (i=0; i<numClusters; i++) {
+            printf("clusters[%d]=",i);
+            for (j=0; j<numCoords; j++)
+                printf(" %6.2f", clusters[i][j]);
+            printf("\n");
+        }
+    }
+
+    timing            = MPI_Wtime();
+    io_timing         = timing - io_timing;
+
+    /* start the core computation -------------------------------------------*/
+    /* membership: the cluster id for each data object */
+    membership = (int*) malloc((numObjs > 0 ? numObjs : 1) * sizeof(int));
+    assert(membership != NULL);
+
+    ctx = kmeans_ctx_create(&cfg);
+    assert(ctx != NULL);
+    if (!mpi_kmeans(ctx, objects, numCoords, numObjs, totalObjs, numClusters,
+                    numChunks, membership, clusters, MPI_COMM_WORLD)) {
+        if (rank == 0) printf("Error: clustering failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    free(objects[0]);
+    free(objects);
+
+    clustering_timing = MPI_Wtime() - timing;
+
+    /* output: the coordinates of the cluster centres ----------------------*/
+    timing = MPI_Wtime();
+    mpi_write(filename, numClusters, numObjs, totalObjs, numCoords, clusters,
+              membership, verbose && rank == 0, MPI_COMM_WORLD);
+    io_timing += MPI_Wtime() - timing;
+
+    /*---- output performance numbers ---------------------------------------*/
+    if (is_output_timing) {
+        double max_io_timing, max_clustering_timing;
+
+        /* the slowest process is the time of the run */
+        MPI_Reduce(&io_timing, &max_io_timing, 1, MPI_DOUBLE, MPI_MAX, 0,
+                   MPI_COMM_WORLD);
+        MPI_Reduce(&clustering_timing, &max_clustering_timing, 1, MPI_DOUBLE,
+                   MPI_MAX, 0, MPI_COMM_WORLD);
+
+        if (rank == 0) {
+            printf("\nPerforming **** Simple Kmeans  (MPI) ----");
+            printf(" using %s engine ******\n", kmeans_engine_name(cfg.engine));
+            printf("Number of processes = %d\n", nproc);
+            printf("Number of threads   = %d\n", omp_get_max_threads());
+            printf("Input file:     %s\n", filename);
+            printf("numObjs       = %d\n", totalObjs);
+            printf("numCoords     = %d\n", numCoords);
+            printf("numClusters   = %d\n", numClusters);
+            printf("threshold     = %.4f\n", threshold);
+            printf("chunks        = %d\n", numChunks);
+
+            printf("I/O time           = %10.4f sec\n", max_io_timing);
+            printf("Computation timing = %10.4f sec\n", max_clustering_timing);
+            printf("nloops             = %10d\n", kmeans_ctx_stats(ctx)->loops);
+            printf("SSE                = %10g\n", kmeans_ctx_stats(ctx)->sse);
+        }
+    }
+
+    kmeans_ctx_destroy(ctx);
+    free(membership);
+    free(clusters[0]);
+    free(clusters);
+
+    MPI_Finalize();
+    return(0);
+}
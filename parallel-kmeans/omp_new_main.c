@@ -25,10 +25,13 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>     /* getopt() */
+#include <pthread.h>
+#include <signal.h>
 
 #include <omp.h>
 int      _debug;
 #include "kmeans.h"
+#include "kmeans_lib.h"
 
 #ifdef _PNETCDF_BUILT
 #include <mpi.h>
@@ -38,6 +41,98 @@ int     pnetcdf_write(char*, int, int, int, int, float**, int*, int, MPI_Comm,
                       int verbose);
 #endif
 
+#define MAX_LADDER 16
+
+/* SIGTERM/SIGINT: finish the current pass and write the output */
+static volatile sig_atomic_t stop_flag = 0;
+
+static void on_signal(int sig) {
+    stop_flag = 1;
+}
+
+/* one snapshot of the threshold ladder, written by its own thread (or in   */
+/* the monitor when no thread can be started)                                */
+typedef struct {
+    char       name[1024];
+    float      threshold;
+    int        loop, numClusters, numObjs, numCoords, verbose;
+    double     timing;
+    float    **clusters;
+    int       *membership;
+    pthread_t  thread;
+    int        joinable;            /* the thread was started */
+} snapshot_t;
+
+typedef struct {
+    int        nlevels, next;       /* levels[next] is the next to reach */
+    float      levels[MAX_LADDER];  /* descending */
+    snapshot_t snaps[MAX_LADDER];
+    char      *filename;
+    int        numObjs, numCoords, numClusters, verbose;
+    int       *membership;          /* the array being clustered */
+    int       *perm;                /* NULL or the reordering of objects */
+    double     start;
+} ladder_t;
+
+static void* snapshot_main(void *arg) {
+    snapshot_t *s = (snapshot_t*) arg;
+    file_write(s->name, s->numClusters, s->numObjs, s->numCoords, s->clusters,
+               s->membership, s->verbose);
+    free(s->membership);
+    free(s->clusters[0]);
+    free(s->clusters);
+    return NULL;
+}
+
+/*---< ladder_monitor() >---------------------------------------------------*/
+/* copy centers and membership when delta reaches the next threshold and   */
+/* leave the writing to a thread, so the iterations go on meanwhile. The   */
+/* last threshold ends the run and is written as the usual output.        */
+static int ladder_monitor(void *arg, int loop, double sse, float delta,
+                          float **clusters) {
+    ladder_t *l = (ladder_t*) arg;
+    int       i;
+
+    while (l->next < l->nlevels - 1 && delta <= l->levels[l->next]) {
+        snapshot_t *s = &l->snaps[l->next];
+        s->threshold   = l->levels[l->next];
+        s->loop        = loop;
+        s->timing      = omp_get_wtime() - l->start;
+        s->numClusters = l->numClusters;
+        s->numObjs     = l->numObjs;
+        s->numCoords   = l->numCoords;
+        s->verbose     = l->verbose;
+        snprintf(s->name, sizeof(s->name), "%s.t%g", l->filename, s->threshold);
+
+        s->clusters    = (float**) malloc(l->numClusters * sizeof(float*));
+        assert(s->clusters != NULL);
+        s->clusters[0] = (float*)  malloc(l->numClusters * l->numCoords * sizeof(float));
+        assert(s->clusters[0] != NULL);
+        for (i=0; i<l->numClusters; i++) {
+            if (i > 0) s->clusters[i] = s->clusters[i-1] + l->numCoords;
+            memcpy(s->clusters[i], clusters[i], l->numCoords * sizeof(float));
+        }
+        s->membership = (int*) malloc(l->numObjs * sizeof(int));
+        assert(s->membership != NULL);
+        if (l->perm != NULL)        /* back to input order */
+            for (i=0; i<l->numObjs; i++)
+                s->membership[l->perm[i]] = l->membership[i];
+        else
+            memcpy(s->membership, l->membership, l->numObjs * sizeof(int));
+
+        /* without a thread the snapshot is written here */
+        s->joinable = (pthread_create(&s->thread, NULL, snapshot_main, s) == 0);
+        if (!s->joinable) snapshot_main(s);
+        l->next++;
+    }
+    return 0;
+}
+
+static int cmp_desc(const void *a, const void *b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x < y) - (x > y);
+}
+
 /*---< usage() >------------------------------------------------------------*/
 static void usage(char *argv0, float threshold) {
     char *help =
@@ -46,9 +141,56 @@ static void usage(char *argv0, float threshold) {
         "       -c centers     : file containing initial centers. default: filename\n"
         "       -b             : input file is in binary format (default no)\n"
         "       -n num_clusters: number of clusters (K must > 1)\n"
-        "       -t threshold   : threshold value (default %.4f)\n"
+        "       -t threshold   : threshold value (default %.4f); a comma separated\n"
+        "                        list runs once down to the smallest and writes\n"
+        "                        a snapshot filename.t<threshold>.* at each other\n"
         "       -p nproc       : number of threads (default system allocated)\n"
-        "       -a             : perform atomic OpenMP pragma (default no)\n"
+        "       -a             : perform atomic OpenMP pragma, same as -e atomic\n"
+        "       -e engine      : seq, atomic, reduction, transposed, tasks\n"
+        "                      : pool, sorted, tiled, sketch or ivf (default\n"
+        "                        transposed, which is always atomic); auto\n"
+        "                        lets the planner choose the engine and, without\n"
+        "                        -p, the no. threads\n"
+        "       -G pages       : backing of large buffers: small, thp or\n"
+        "                        explicit (reserved huge pages, else thp)\n"
+        "                        (default thp)\n"
+        "       -u file        : tuning file of -e auto (default\n"
+        "                        $HOME/.kmeans_tuning.<host>)\n"
+        "       -R n_init      : no. seeded restarts run concurrently, keep the\n"
+        "                        lowest SSE (default 1)\n"
+        "       -s seed        : seed of the restarts (default 1)\n"
+        "       -A loops       : abandon restarts clearly behind after this no.\n"
+        "                        passes, 0 = never (default 5)\n"
+        "       -T seconds     : wall time budget of the whole run, output\n"
+        "                        included (default no limit)\n"
+        "       -Z curve       : reorder the objects along a space-filling\n"
+        "                        curve before the fit, morton or hilbert; the\n"
+        "                        output stays in input order (default none)\n"
+        "       -x             : also write the objects of each cluster to\n"
+        "                        filename.cluster_index (free with -e sorted)\n"
+        "       -E             : early abandon: sum the distances coordinate\n"
+        "                        block by block, most varying first, and drop\n"
+        "                        a center once it is further than the best\n"
+        "       -P dims[,cands]: sketch engine: random directions and centers\n"
+        "                        shortlisted per object (default numCoords/4\n"
+        "                        up to 16, and 4)\n"
+        "       -I probes[,lists]: ivf engine: coarse lists searched per object\n"
+        "                        and lists of the index (default 4, and\n"
+        "                        sqrt(num_clusters)); more probes, fewer misses\n"
+        "       -F after[,every]: freeze objects unchanged for this no. passes\n"
+        "                        and far from their cluster boundary, with a\n"
+        "                        full pass every this no. passes (default 5)\n"
+        "       -H branch[,refine]: top-down fit, splitting clusters by fits of\n"
+        "                        branch centers (2 = bisecting), then at most\n"
+        "                        refine flat passes (default 0)\n"
+        "       -M metric      : l2, cosine (spherical k-means) or l1\n"
+        "                        (k-medians) (default l2)\n"
+        "       -r level       : reseed empty clusters (1), or empty and\n"
+        "                        singleton ones (2), from the objects farthest\n"
+        "                        from their center in each pass (default 0)\n"
+        "       -S             : asynchronous updates, a pass may use centers\n"
+        "                        one update old; with -o the synchronous fit\n"
+        "                        is also run for comparison\n"
         "       -o             : output timing results (default no)\n"
         "       -c var_name    : using PnetCDF for file input and output and var_name\n"
         "                      : is variable name in the netCDF file to be clustered\n"
@@ -60,24 +202,6 @@ static void usage(char *argv0, float threshold) {
 }
 
 
-static void transpose(float*** array, int xdim, int ydim){
-    float** newArray = (float**) malloc(xdim * sizeof(float*));
-    newArray[0] = (float*) malloc(xdim * ydim * sizeof(float));
-    for(int i = 1; i < xdim; i++)
-        newArray[i] = newArray[i-1] + ydim;
-
-    float** oldArray = *array;
-    for(int i = 0; i < ydim; i++){
-        for(int j = 0; j < xdim; j++){
-            newArray[j][i] = oldArray[i][j];
-        }
-    }
-
-    free(oldArray[0]);
-    free(oldArray);
-    *array = newArray;
-}
-
 
 /*---< main() >---------------------------------------------------------------*/
 int main(int argc, char **argv) {
@@ -86,7 +210,25 @@ int main(int argc, char **argv) {
     extern int     optind;
            int     i, j, nthreads, verbose;
            int     isBinaryFile, is_perform_atomic, is_output_timing;
+           int     is_async, is_index, is_partial, sync_loops = 0;
+           int    *perm;          /* [numObjs] input row of each object */
+           char   *curve_name, *sketch_shape, *ivf_shape, *freeze;
+           int     hier_branch = 0, hier_refine = 0, repair = 0;
+           char   *metric_name;
+           kmeans_order curve;
+           double  reorder_timing = 0.0;
+           double  sync_sse = 0.0, sync_timing = 0.0;
            int     do_pnetcdf;
+           char   *engine_name, *tuning_file, *pages_name;
+           kmeans_pages     pages;
+           kmeans_mem_stats mem_start, mem_end;
+           int     is_plan;
+           kmeans_plan_result plan;
+           kmeans_config cfg;
+           kmeans_restart_config rc;
+           ladder_t ladder;
+           char   *tok, *save;
+           kmeans_ctx   *ctx;
 
            int     numClusters, numCoords, numObjs;
            int    *membership;    /* [numObjs] */
@@ -96,6 +238,8 @@ int main(int argc, char **argv) {
            float **clusters;      /* [numClusters][numCoords] cluster center */
            float   threshold;
            double  timing, io_timing, clustering_timing;
+           double  budget, start_time, read_timing;
+           struct sigaction sa;
 
 #ifdef _PNETCDF_BUILT
     MPI_Init(&argc, &argv);
@@ -111,12 +255,31 @@ int main(int argc, char **argv) {
     isBinaryFile      = 0;
     is_output_timing  = 0;
     is_perform_atomic = 0;
+    is_async          = 0;
+    is_partial        = 0;
+    is_index          = 0;
+    curve_name        = NULL;
+    sketch_shape      = NULL;
+    ivf_shape         = NULL;
+    freeze            = NULL;
+    metric_name       = NULL;
+    curve             = KMEANS_ORDER_NONE;
+    perm              = NULL;
     filename          = NULL;
     do_pnetcdf        = 0;
     var_name          = NULL;
     center_filename   = NULL;
-
-    while ( (opt=getopt(argc,argv,"p:i:n:t:c:v:abdohq"))!= EOF) {
+    engine_name       = NULL;
+    tuning_file       = NULL;
+    pages_name        = NULL;
+    pages             = KMEANS_PAGES_THP;
+    is_plan           = 0;
+    kmeans_restart_config_init(&rc);
+    memset(&ladder, 0, sizeof(ladder));
+    budget            = 0.0;
+    start_time        = omp_get_wtime();
+
+    while ( (opt=getopt(argc,argv,"p:i:n:t:c:v:e:R:s:A:T:Z:P:I:F:H:M:r:u:G:ESxabdohq"))!= EOF) {
         switch (opt) {
             case 'i': filename=optarg;
                       break;
@@ -124,7 +287,12 @@ int main(int argc, char **argv) {
                       break;
             case 'b': isBinaryFile = 1;
                       break;
-            case 't': threshold=atof(optarg);
+            case 't': ladder.nlevels = 0;
+                      for (tok = strtok_r(optarg, ",", &save); tok != NULL;
+                           tok = strtok_r(NULL, ",", &save)) {
+                          if (ladder.nlevels == MAX_LADDER) usage(argv[0], threshold);
+                          ladder.levels[ladder.nlevels++] = atof(tok);
+                      }
                       break;
             case 'n': numClusters = atoi(optarg);
                       break;
@@ -132,6 +300,42 @@ int main(int argc, char **argv) {
                       break;
             case 'a': is_perform_atomic = 1;
                       break;
+            case 'e': engine_name = optarg;
+                      break;
+            case 'R': rc.n_init = atoi(optarg);
+                      break;
+            case 's': rc.seed = (unsigned) atoi(optarg);
+                      break;
+            case 'A': rc.abandon_after = atoi(optarg);
+                      break;
+            case 'T': budget = atof(optarg);
+                      break;
+            case 'E': is_partial = 1;
+                      break;
+            case 'S': is_async = 1;
+                      break;
+            case 'x': is_index = 1;
+                      break;
+            case 'P': sketch_shape = optarg;
+                      break;
+            case 'I': ivf_shape = optarg;
+                      break;
+            case 'F': freeze = optarg;
+                      break;
+            case 'M': metric_name = optarg;
+                      break;
+            case 'r': repair = atoi(optarg);
+                      break;
+            case 'u': tuning_file = optarg;
+                      break;
+            case 'G': pages_name = optarg;
+                      break;
+            case 'H': hier_branch = atoi(optarg);
+                      if (strchr(optarg, ',') != NULL)
+                          hier_refine = atoi(strchr(optarg, ',') + 1);
+                      break;
+            case 'Z': curve_name = optarg;
+                      break;
             case 'o': is_output_timing = 1;
                       break;
             case 'q': verbose = 0;
@@ -151,6 +355,101 @@ int main(int argc, char **argv) {
 
     if (filename == 0 || numClusters <= 1) usage(argv[0], threshold);
 
+    /* the run stops at the smallest threshold */
+    if (ladder.nlevels > 0) {
+        qsort(ladder.levels, ladder.nlevels, sizeof(float), cmp_desc);
+        threshold = ladder.levels[ladder.nlevels-1];
+    }
+    if (ladder.nlevels > 1 && rc.n_init > 1) {
+        printf("Error: a threshold list cannot be combined with restarts\n");
+        exit(1);
+    }
+    if (is_async && (ladder.nlevels > 1 || rc.n_init > 1)) {
+        printf("Error: -S cannot be combined with restarts or a threshold list\n");
+        exit(1);
+    }
+    if (hier_branch != 0 && (hier_branch < 2 || hier_refine < 0)) {
+        printf("Error: -H needs a branch of at least 2\n");
+        exit(1);
+    }
+    if (hier_branch > 0 && (ladder.nlevels > 1 || rc.n_init > 1 || is_async)) {
+        printf("Error: -H cannot be combined with restarts, -S or a threshold list\n");
+        exit(1);
+    }
+
+    if (repair < 0 || repair > 2) {
+        printf("Error: -r needs a level of 0, 1 or 2\n");
+        exit(1);
+    }
+    if (repair > 0 && is_async) {
+        printf("Error: -r cannot be combined with -S\n");
+        exit(1);
+    }
+
+    kmeans_config_init(&cfg);
+    cfg.nthreads  = nthreads;
+    cfg.threshold = threshold;
+    cfg.debug     = _debug;
+    cfg.async     = is_async;
+    cfg.partial   = is_partial;
+    cfg.repair    = repair;
+    if (sketch_shape != NULL) {
+        char *comma = strchr(sketch_shape, ',');
+        cfg.sketch_dims = atoi(sketch_shape);
+        if (comma != NULL) cfg.sketch_cands = atoi(comma + 1);
+    }
+    if (ivf_shape != NULL) {
+        char *comma = strchr(ivf_shape, ',');
+        cfg.ivf_nprobe = atoi(ivf_shape);
+        if (comma != NULL) cfg.ivf_lists = atoi(comma + 1);
+    }
+    if (freeze != NULL) {
+        char *comma = strchr(freeze, ',');
+        cfg.freeze_after = atoi(freeze);
+        if (comma != NULL) cfg.freeze_verify = atoi(comma + 1);
+    }
+    if (curve_name != NULL) {
+        if      (strcmp(curve_name, "morton")  == 0) curve = KMEANS_ORDER_MORTON;
+        else if (strcmp(curve_name, "hilbert") == 0) curve = KMEANS_ORDER_HILBERT;
+        else if (strcmp(curve_name, "none")    != 0) {
+            printf("Error: unknown curve \"%s\"\n", curve_name);
+            exit(1);
+        }
+    }
+    if (engine_name != NULL && strcmp(engine_name, "auto") == 0) {
+        if (is_async || hier_branch > 0) {
+            printf("Error: -e auto cannot be combined with -S or -H\n");
+            exit(1);
+        }
+        is_plan = 1;
+    }
+    else if (engine_name != NULL) {
+        if (!kmeans_engine_parse(engine_name, &cfg.engine)) {
+            printf("Error: unknown engine \"%s\"\n", engine_name);
+            exit(1);
+        }
+    }
+    else if (is_perform_atomic)
+        cfg.engine = KMEANS_ENGINE_OMP_ATOMIC;
+    else if (rc.n_init > 1)
+        cfg.engine = KMEANS_ENGINE_OMP_TASKS;   /* restarts share one team */
+    if (pages_name != NULL && !kmeans_pages_parse(pages_name, &pages)) {
+        printf("Error: unknown pages \"%s\"\n", pages_name);
+        exit(1);
+    }
+    if (metric_name != NULL) {
+        if (!kmeans_metric_parse(metric_name, &cfg.metric)) {
+            printf("Error: unknown metric \"%s\"\n", metric_name);
+            exit(1);
+        }
+        if (cfg.metric != KMEANS_METRIC_L2 &&
+            (is_async || cfg.freeze_after > 0)) {
+            printf("Error: -M %s cannot be combined with -S or -F\n",
+                   metric_name);
+            exit(1);
+        }
+    }
+
 #ifndef _PNETCDF_BUILT
     if (do_pnetcdf) {
         printf("Error: PnetCDF feature is not built\n");
@@ -158,6 +457,12 @@ int main(int argc, char **argv) {
     }
 #endif
 
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT,  &sa, NULL);
+    cfg.stop = (volatile int*) &stop_flag;
+
     /* set the no. threads if specified in command line, else use all
        threads allocated by run-time system */
     if (nthreads > 0)
@@ -165,6 +470,11 @@ int main(int argc, char **argv) {
 
     if (is_output_timing) io_timing = omp_get_wtime();
 
+    /* the objects, the membership and the scratch of the fit stay until
+       the end: large ones go on huge pages */
+    kmeans_arena_set_pages(pages);
+    if (!do_pnetcdf) file_set_allocator(kmeans_arena_alloc, kmeans_arena_free);
+
     /* read data points from file ------------------------------------------*/
     printf("reading data points from file %s\n",filename);
 
@@ -176,11 +486,12 @@ int main(int argc, char **argv) {
 #endif
     objects = file_read(isBinaryFile, filename, &numObjs, &numCoords);
     if (objects == NULL) exit(1);
+    read_timing = omp_get_wtime() - start_time;
 
     if (numObjs < numClusters) {
         printf("Error: number of clusters must be larger than the number of data points to be clustered.\n");
-        free(objects[0]);
-        free(objects);
+        if (do_pnetcdf) { free(objects[0]); free(objects); }
+        else            file_free_objects(objects);
         return 1;
     }
 
@@ -227,15 +538,6 @@ int main(int argc, char **argv) {
         }
     }
 
-    // Added code -----------------------------------------------------
-    // TRANSPOSE THE CLUSTERS MATRIX
-    // Allows accessing the elements along rows instead of down columns.
-    // Better cache locality and allows vectorization
-
-    transpose(&clusters, numCoords, numClusters);
-
-    // ----------------------------------------------------------------
-
     if (is_output_timing) {
         timing            = omp_get_wtime();
         io_timing         = timing - io_timing;
@@ -244,20 +546,117 @@ int main(int argc, char **argv) {
 
     /* start the core computation -------------------------------------------*/
     /* membership: the cluster id for each data object */
-    membership = (int*) malloc(numObjs * sizeof(int));
+    membership = (int*) kmeans_arena_alloc(numObjs * sizeof(int));
     assert(membership != NULL);
 
-    omp_kmeans(is_perform_atomic, objects, numCoords, numObjs,
-               numClusters, threshold, membership, clusters);
+    /* the initial centers are taken, now the objects may move */
+    if (curve != KMEANS_ORDER_NONE) {
+        reorder_timing = omp_get_wtime();
+        perm = (int*) malloc(numObjs * sizeof(int));
+        assert(perm != NULL);
+        if (!kmeans_reorder(objects, numCoords, numObjs, curve, perm)) {
+            printf("Error: reordering failed\n");
+            exit(1);
+        }
+        reorder_timing = omp_get_wtime() - reorder_timing;
+    }
+
+    /* engine and no. threads from the tuning file or from probes */
+    if (is_plan) {
+        if (!kmeans_plan(&cfg, objects, numCoords, numObjs, numClusters,
+                         clusters, tuning_file, &plan)) {
+            printf("Error: planning failed\n");
+            exit(1);
+        }
+        omp_set_num_threads(cfg.nthreads);
+    }
+    if (rc.n_init > 1 && !kmeans_restarts_shared(cfg.engine))
+        printf("Warning: restarts with the %s engine cannot share a team, "
+               "they run one after another\n", kmeans_engine_name(cfg.engine));
+
+    /* what is left of the budget, less the time to write the output; the
+       output is smaller than the input, so reading it is a safe bound */
+    if (budget > 0.0) {
+        cfg.time_budget = budget - (omp_get_wtime() - start_time) - read_timing;
+        if (cfg.time_budget <= 0.0) cfg.time_budget = 1e-9;   /* one pass */
+    }
+
+    /* the synchronous fit from the same centers, to compare with */
+    if (is_async && is_output_timing) {
+        kmeans_config sync_cfg = cfg;
+        int    *sync_membership = (int*)    malloc(numObjs * sizeof(int));
+        float **sync_clusters   = (float**) malloc(numClusters * sizeof(float*));
+        assert(sync_membership != NULL && sync_clusters != NULL);
+        sync_clusters[0] = (float*) malloc(numClusters * numCoords * sizeof(float));
+        assert(sync_clusters[0] != NULL);
+        for (i=0; i<numClusters; i++) {
+            if (i > 0) sync_clusters[i] = sync_clusters[i-1] + numCoords;
+            memcpy(sync_clusters[i], clusters[i], numCoords * sizeof(float));
+        }
+        sync_cfg.async = 0;
+        ctx = kmeans_ctx_create(&sync_cfg);
+        assert(ctx != NULL);
+        kmeans_fit(ctx, objects, numCoords, numObjs, numClusters,
+                   sync_membership, sync_clusters);
+        sync_loops  = kmeans_ctx_stats(ctx)->loops;
+        sync_sse    = kmeans_ctx_stats(ctx)->sse;
+        sync_timing = kmeans_ctx_stats(ctx)->timing;
+        kmeans_ctx_destroy(ctx);
+        free(sync_clusters[0]);
+        free(sync_clusters);
+        free(sync_membership);
+        clustering_timing = omp_get_wtime();
+    }
+
+    kmeans_arena_stats(&mem_start);
+    ctx = kmeans_ctx_create(&cfg);
+    if (ctx != NULL && ladder.nlevels > 1) {
+        ladder.filename    = filename;
+        ladder.numObjs     = numObjs;
+        ladder.numCoords   = numCoords;
+        ladder.numClusters = numClusters;
+        ladder.verbose     = verbose;
+        ladder.membership  = membership;
+        ladder.perm        = perm;
+        ladder.start       = omp_get_wtime();
+        kmeans_ctx_set_monitor(ctx, ladder_monitor, &ladder);
+    }
+    if (ctx == NULL ||
+        (hier_branch > 0
+         ? !kmeans_fit_hierarchical(ctx, objects, numCoords, numObjs,
+                                    numClusters, hier_branch, hier_refine,
+                                    membership, clusters)
+         : !kmeans_fit_restarts(ctx, objects, numCoords, numObjs,
+                                numClusters, &rc, membership, clusters))) {
+        printf("Error: clustering failed\n");
+        exit(1);
+    }
 
-    free(objects[0]);
-    free(objects);
+    kmeans_arena_stats(&mem_end);
+    if (do_pnetcdf) { free(objects[0]); free(objects); }
+    else            file_free_objects(objects);
 
     if (is_output_timing) {
         timing            = omp_get_wtime();
         clustering_timing = timing - clustering_timing;
     }       
 
+    if (kmeans_ctx_stats(ctx)->stop_reason == KMEANS_STOP_BUDGET ||
+        kmeans_ctx_stats(ctx)->stop_reason == KMEANS_STOP_SIGNAL)
+        printf("Stopped by %s after %d loops at delta %.4f, writing the current solution\n",
+               kmeans_stop_name(kmeans_ctx_stats(ctx)->stop_reason),
+               kmeans_ctx_stats(ctx)->loops, kmeans_ctx_stats(ctx)->delta);
+
+    /* snapshots still being written */
+    for (i=0; i<ladder.next; i++)
+        if (ladder.snaps[i].joinable)
+            pthread_join(ladder.snaps[i].thread, NULL);
+    if (ladder.nlevels > 1 && ladder.next < ladder.nlevels - 1)
+        printf("Warning: threshold %g not reached in %d loops, no snapshot\n",
+               ladder.levels[ladder.next], kmeans_ctx_stats(ctx)->loops);
+
+    if (perm != NULL) kmeans_restore_order(perm, numObjs, membership);
+
     /* output: the coordinates of the cluster centres ----------------------*/
 #ifdef _PNETCDF_BUILT
     if (do_pnetcdf)
@@ -268,7 +667,26 @@ int main(int argc, char **argv) {
     file_write(filename, numClusters, numObjs, numCoords, clusters, membership,
                verbose);
 
-    free(membership);
+    /* the sorted engine leaves the index in the context, others build it */
+    if (is_index) {
+        int        n, k;
+        const int *offsets, *order;
+        if (perm == NULL &&
+            kmeans_cluster_index(ctx, &n, &k, &offsets, &order))
+            index_write(filename, numClusters, offsets, order, verbose);
+        else {
+            int *off = (int*) malloc((numClusters + 1) * sizeof(int));
+            int *ord = (int*) malloc(numObjs * sizeof(int));
+            assert(off != NULL && ord != NULL);
+            if (kmeans_build_index(membership, numObjs, numClusters, off, ord))
+                index_write(filename, numClusters, off, ord, verbose);
+            free(ord);
+            free(off);
+        }
+    }
+
+    free(perm);
+    kmeans_arena_free(membership);
     free(clusters[0]);
     free(clusters);
 
@@ -277,10 +695,8 @@ int main(int argc, char **argv) {
         io_timing += omp_get_wtime() - timing;
 
         printf("\nPerforming **** Regular Kmeans  (OpenMP) ----");
-        if (is_perform_atomic)
-            printf(" using atomic pragma ******\n");
-        else
-            printf(" using array reduction ******\n");
+        printf(" using %s engine ******\n",
+               is_async ? "async" : kmeans_engine_name(cfg.engine));
 
         printf("Number of threads = %d\n", omp_get_max_threads());
         printf("Input file:     %s\n", filename);
@@ -290,8 +706,80 @@ int main(int argc, char **argv) {
         printf("threshold     = %.4f\n", threshold);
 
         printf("I/O time           = %10.4f sec\n", io_timing);
+        printf("memory regions     = %10ld (%ld explicit huge, %ld thp), peak %.1f MB\n",
+               mem_end.regions, mem_end.huge_explicit, mem_end.huge_thp,
+               mem_end.peak_bytes / 1048576.0);
+        printf("page faults        = %10ld minor, %ld major (fit %ld minor)\n",
+               mem_end.minor_faults, mem_end.major_faults,
+               mem_end.minor_faults - mem_start.minor_faults);
         printf("Computation timing = %10.4f sec\n", clustering_timing);
+        if (perm != NULL)
+            printf("%-7s reordering  = %10.4f sec\n", curve_name,
+                   reorder_timing);
+        if (is_plan)
+            printf("planned            = %10s%s, %d threads (%s, %.4f sec)\n",
+                   kmeans_engine_name(cfg.engine), cfg.partial ? " -E" : "",
+                   cfg.nthreads, plan.probes > 0 ? "probed"
+                   : plan.pass_time > 0.0 ? "tuning file" : "small fit",
+                   plan.probe_time);
+        printf("nloops             = %10d\n", kmeans_ctx_stats(ctx)->loops);
+        if ((is_partial || cfg.engine == KMEANS_ENGINE_SKETCH ||
+             cfg.engine == KMEANS_ENGINE_IVF) && !is_async)
+            printf("coords/distance    = %10.2f of %d\n",
+                   kmeans_ctx_stats(ctx)->dims_per_dist, numCoords);
+        if (cfg.engine == KMEANS_ENGINE_SKETCH && !is_async)
+            printf("sketch fallbacks   = %10.4f of objects\n",
+                   kmeans_ctx_stats(ctx)->fallback_rate);
+        if (cfg.engine == KMEANS_ENGINE_IVF && !is_async)
+            printf("ivf mismatches     = %10.4f of sampled objects\n",
+                   kmeans_ctx_stats(ctx)->mismatch_rate);
+        if (cfg.freeze_after > 0 && !is_async) {
+            printf("frozen             = %10.4f of object-passes\n",
+                   kmeans_ctx_stats(ctx)->frozen_rate);
+            printf("stale when frozen  = %10.4f of objects\n",
+                   kmeans_ctx_stats(ctx)->stale_rate);
+        }
+        if (repair > 0)
+            printf("repaired clusters  = %10d\n",
+                   kmeans_ctx_stats(ctx)->repairs);
+        printf("stopped by         = %10s\n",
+               kmeans_stop_name(kmeans_ctx_stats(ctx)->stop_reason));
+        if (!is_async)      /* with the synchronous SSE below */
+            printf("SSE                = %10g\n", kmeans_ctx_stats(ctx)->sse);
+        if (budget > 0.0)
+            printf("Total time         = %10.4f sec of %.4f\n",
+                   omp_get_wtime() - start_time, budget);
+        for (i=0; i<ladder.next; i++)
+            printf("threshold %-8g = %10d loops %10.4f sec\n",
+                   ladder.snaps[i].threshold, ladder.snaps[i].loop,
+                   ladder.snaps[i].timing);
+        if (rc.n_init > 1) {
+            printf("restarts           = %10d\n", rc.n_init);
+            printf("best restart       = %10d\n", kmeans_ctx_stats(ctx)->best_restart);
+            printf("abandoned          = %10d\n", kmeans_ctx_stats(ctx)->abandoned);
+        }
+        if (hier_branch > 0) {
+            printf("distances          = %10.4g (tree %g, one flat pass %g)\n",
+                   kmeans_ctx_stats(ctx)->dist_calcs,
+                   kmeans_ctx_stats(ctx)->tree_dist_calcs,
+                   (double)numObjs * numClusters);
+        }
+        if (is_async) {
+            printf("SSE                = %10g (synchronous %g, %+.3f%%)\n",
+                   kmeans_ctx_stats(ctx)->sse, sync_sse,
+                   100.0 * (kmeans_ctx_stats(ctx)->sse - sync_sse) / sync_sse);
+            printf("synchronous fit    = %10.4f sec, %d loops\n", sync_timing,
+                   sync_loops);
+            printf("wall time difference=%+10.4f sec (async - synchronous)\n",
+                   kmeans_ctx_stats(ctx)->timing - sync_timing);
+            printf("waiting for centers= %10.4f thread-sec\n",
+                   kmeans_ctx_stats(ctx)->wait_time);
+            printf("stale passes       = %10d of %d\n",
+                   kmeans_ctx_stats(ctx)->stale_passes,
+                   (kmeans_ctx_stats(ctx)->loops + 1) * omp_get_max_threads());
+        }
     }
+    kmeans_ctx_destroy(ctx);
 
 #ifdef _PNETCDF_BUILT
     MPI_Finalize();
@@ -0,0 +1,287 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         predict_main.c                                            */
+/*   Description:  Batch prediction: assign new data objects to the centers */
+/*                 of a trained model, without any center update. Objects   */
+/*                 are streamed through the library in chunks, so files     */
+/*                 larger than memory can be processed.                     */
+/*   Model file format:                                                      */
+/*                 ascii : a ".cluster_centres" file written by the other   */
+/*                         executables (cluster id, then the coordinates)   */
+/*                 binary: the same layout as a binary input file, i.e. no. */
+/*                         centers, no. coordinates, then the coordinates   */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt() */
+
+#include <omp.h>
+int      _debug;
+#include "kmeans.h"
+#include "kmeans_lib.h"
+
+#define DEFAULT_CHUNK 65536
+
+/*---< usage() >------------------------------------------------------------*/
+static void usage(char *argv0) {
+    char *help =
+        "Usage: %s [switches] -i filename -m model\n"
+        "       -i filename    : file containing data to be assigned\n"
+        "       -m model       : file containing the cluster centers\n"
+        "       -b             : input file is in binary format (default no)\n"
+        "       -M             : model file is in binary format (default no)\n"
+        "       -r             : output files in binary format (default no)\n"
+        "       -s             : also write the squared distances (default no)\n"
+        "       -k chunk       : no. objects per chunk (default %d)\n"
+        "       -p nproc       : number of threads (default system allocated)\n"
+        "       -o             : output timing results (default no)\n"
+        "       -q             : quiet mode\n"
+        "       -d             : enable debug mode\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0, DEFAULT_CHUNK);
+    exit(-1);
+}
+
+/*---< put_int() >-----------------------------------------------------------*/
+/* append the decimal digits of a non-negative value, faster than fprintf   */
+static char* put_int(char *p, int value) {
+    char tmp[12];
+    int  n = 0;
+    do {
+        tmp[n++] = '0' + value % 10;
+        value   /= 10;
+    } while (value > 0);
+    while (n > 0) *p++ = tmp[--n];
+    return p;
+}
+
+/*---< write_chunk() >-------------------------------------------------------*/
+static void write_chunk(FILE  *mfp,
+                        FILE  *dfp,
+                        int    isBinaryOut,
+                        int    first,       /* index of the first object */
+                        int    numObjs,
+                        int   *membership,
+                        float *distances,
+                        char  *textBuf)     /* [numObjs * 24] */
+{
+    int   i;
+    char *p;
+
+    if (isBinaryOut) {
+        fwrite(membership, sizeof(int), numObjs, mfp);
+        if (dfp != NULL) fwrite(distances, sizeof(float), numObjs, dfp);
+        return;
+    }
+
+    p = textBuf;
+    for (i=0; i<numObjs; i++) {
+        p = put_int(p, first + i);
+        *p++ = ' ';
+        p = put_int(p, membership[i]);
+        *p++ = '\n';
+    }
+    fwrite(textBuf, 1, p - textBuf, mfp);
+
+    if (dfp != NULL)
+        for (i=0; i<numObjs; i++)
+            fprintf(dfp, "%d %f\n", first + i, distances[i]);
+}
+
+/*---< main() >---------------------------------------------------------------*/
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+           int     i, nthreads, verbose, chunk, total, n;
+           int     isBinaryFile, isBinaryModel, isBinaryOut, is_output_timing;
+           int     write_distances;
+           int     numClusters, numCoords, modelCoords, numObjs;
+           int    *membership;    /* [chunk] */
+           float  *distances;     /* [chunk] */
+           char   *filename, *model_filename, *textBuf;
+           char    outFileName[1024];
+           float **objects;       /* [chunk][numCoords] data objects */
+           float **clusters;      /* [numClusters][numCoords] model centers */
+           double  timing, io_timing, predict_timing, t;
+           FILE   *mfp, *dfp;
+           obj_stream   *stream;
+           kmeans_config cfg;
+           kmeans_ctx   *ctx;
+
+    /* some default values */
+    _debug           = 0;
+    verbose          = 1;
+    nthreads         = 0;
+    chunk            = DEFAULT_CHUNK;
+    isBinaryFile     = 0;
+    isBinaryModel    = 0;
+    isBinaryOut      = 0;
+    is_output_timing = 0;
+    write_distances  = 0;
+    filename         = NULL;
+    model_filename   = NULL;
+
+    while ( (opt=getopt(argc,argv,"i:m:k:p:bMrsodqh"))!= EOF) {
+        switch (opt) {
+            case 'i': filename=optarg;
+                      break;
+            case 'm': model_filename=optarg;
+                      break;
+            case 'b': isBinaryFile = 1;
+                      break;
+            case 'M': isBinaryModel = 1;
+                      break;
+            case 'r': isBinaryOut = 1;
+                      break;
+            case 's': write_distances = 1;
+                      break;
+            case 'k': chunk = atoi(optarg);
+                      break;
+            case 'p': nthreads = atoi(optarg);
+                      break;
+            case 'o': is_output_timing = 1;
+                      break;
+            case 'q': verbose = 0;
+                      break;
+            case 'd': _debug = 1;
+                      break;
+            case 'h':
+            default: usage(argv[0]);
+                      break;
+        }
+    }
+    if (filename == NULL || model_filename == NULL || chunk <= 0)
+        usage(argv[0]);
+
+    if (nthreads > 0)
+        omp_set_num_threads(nthreads);
+
+    io_timing      = omp_get_wtime();
+    predict_timing = 0.0;
+
+    /* read the model ------------------------------------------------------*/
+    if (verbose) printf("reading model centers from file %s\n", model_filename);
+    clusters = file_read(isBinaryModel, model_filename, &numClusters,
+                         &modelCoords);
+    if (clusters == NULL) exit(1);
+
+    stream = stream_open(isBinaryFile, filename, &numObjs, &numCoords);
+    if (stream == NULL) exit(1);
+    if (numCoords != modelCoords) {
+        printf("Error: data has %d coordinates but the model has %d\n",
+               numCoords, modelCoords);
+        exit(1);
+    }
+
+    kmeans_config_init(&cfg);
+    cfg.nthreads = nthreads;
+    cfg.debug    = _debug;
+    ctx = kmeans_ctx_create(&cfg);
+    if (ctx == NULL || !kmeans_set_centers(ctx, clusters, numCoords,
+                                           numClusters)) {
+        printf("Error: cannot load the model\n");
+        exit(1);
+    }
+
+    /* chunk buffers -------------------------------------------------------*/
+    objects    = (float**) malloc(chunk * sizeof(float*));
+    assert(objects != NULL);
+    objects[0] = (float*)  malloc((size_t)chunk * numCoords * sizeof(float));
+    assert(objects[0] != NULL);
+    for (i=1; i<chunk; i++)
+        objects[i] = objects[i-1] + numCoords;
+
+    membership = (int*)   malloc(chunk * sizeof(int));
+    distances  = (float*) malloc(chunk * sizeof(float));
+    textBuf    = (char*)  malloc((size_t)chunk * 24);
+    assert(membership != NULL && distances != NULL && textBuf != NULL);
+
+    /* output files, the same names as file_write() ------------------------*/
+    sprintf(outFileName, "%s.membership", filename);
+    mfp = fopen(outFileName, isBinaryOut ? "wb" : "w");
+    if (mfp == NULL) {
+        printf("Error: cannot create file %s\n", outFileName);
+        exit(1);
+    }
+    dfp = NULL;
+    if (write_distances) {
+        sprintf(outFileName, "%s.distances", filename);
+        dfp = fopen(outFileName, isBinaryOut ? "wb" : "w");
+        if (dfp == NULL) {
+            printf("Error: cannot create file %s\n", outFileName);
+            exit(1);
+        }
+    }
+    if (isBinaryOut) {
+        /* header: no. objects, patched once the stream has been read */
+        total = 0;
+        fwrite(&total, sizeof(int), 1, mfp);
+        if (dfp != NULL) fwrite(&total, sizeof(int), 1, dfp);
+    }
+
+    /* stream the objects through the model --------------------------------*/
+    total = 0;
+    while ((n = stream_read(stream, chunk, objects)) > 0) {
+        t = omp_get_wtime();
+        kmeans_predict(ctx, objects, n, membership,
+                       write_distances ? distances : NULL);
+        predict_timing += omp_get_wtime() - t;
+
+        write_chunk(mfp, dfp, isBinaryOut, total, n, membership, distances,
+                    textBuf);
+        total += n;
+    }
+    stream_close(stream);
+
+    if (isBinaryOut) {
+        fseek(mfp, 0, SEEK_SET);
+        fwrite(&total, sizeof(int), 1, mfp);
+        if (dfp != NULL) {
+            fseek(dfp, 0, SEEK_SET);
+            fwrite(&total, sizeof(int), 1, dfp);
+        }
+    }
+    fclose(mfp);
+    if (dfp != NULL) fclose(dfp);
+
+    if (verbose) printf("Wrote membership of N=%d data objects to file \"%s.membership\"\n",
+                        total, filename);
+
+    timing    = omp_get_wtime();
+    io_timing = timing - io_timing - predict_timing;
+
+    free(textBuf);
+    free(distances);
+    free(membership);
+    free(objects[0]);
+    free(objects);
+    free(clusters[0]);
+    free(clusters);
+    kmeans_ctx_destroy(ctx);
+
+    /*---- output performance numbers ---------------------------------------*/
+    if (is_output_timing) {
+        printf("\nPerforming **** Kmeans prediction (OpenMP) ****\n");
+        printf("Number of threads = %d\n", omp_get_max_threads());
+        printf("Input file:     %s\n", filename);
+        printf("Model file:     %s\n", model_filename);
+        printf("numObjs       = %d\n", total);
+        printf("numCoords     = %d\n", numCoords);
+        printf("numClusters   = %d\n", numClusters);
+
+        printf("I/O time           = %10.4f sec\n", io_timing);
+        printf("Computation timing = %10.4f sec\n", predict_timing);
+        if (predict_timing > 0)
+            printf("Throughput         = %10.0f objects/sec\n",
+                   total / predict_timing);
+    }
+    return(0);
+}
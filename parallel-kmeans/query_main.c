@@ -0,0 +1,256 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         query_main.c                                              */
+/*   Description:  client of server_main. Sends the objects of a data file  */
+/*                 as pipelined batched queries over the Unix domain socket,*/
+/*                 writes the returned membership and reports the client    */
+/*                 side latency and throughput. Also used to read the       */
+/*                 server counters (-s) and to trigger a model reload (-R). */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt(), read(), write() */
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <omp.h>
+int      _debug;
+#include "kmeans.h"
+#include "kmeans_server.h"
+
+/*---< usage() >------------------------------------------------------------*/
+static void usage(char *argv0) {
+    char *help =
+        "Usage: %s [switches] -S socket [-i filename]\n"
+        "       -S socket      : path of the server socket\n"
+        "       -i filename    : file containing data to be assigned\n"
+        "       -b             : input file is in binary format (default no)\n"
+        "       -k batch       : no. objects per query (default 64)\n"
+        "       -W depth       : max queries in flight (default 8)\n"
+        "       -n passes      : send the file this many times (default 1)\n"
+        "       -s             : print the server counters\n"
+        "       -R             : ask the server to reload its model\n"
+        "       -o             : output timing results (default no)\n"
+        "       -q             : quiet mode\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0);
+    exit(-1);
+}
+
+static void write_all(int fd, const void *buf, size_t len) {
+    const char *p = (const char*) buf;
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) { perror("write"); exit(1); }
+        p += w; len -= w;
+    }
+}
+
+static void read_all(int fd, void *buf, size_t len) {
+    char *p = (char*) buf;
+    while (len > 0) {
+        ssize_t r = read(fd, p, len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) { fprintf(stderr, "Error: server closed the connection\n"); exit(1); }
+        p += r; len -= r;
+    }
+}
+
+static void send_request(int fd, uint32_t type, uint32_t id, uint32_t count,
+                         const void *payload, size_t len) {
+    kmq_header h;
+    h.magic = KMQ_MAGIC;
+    h.type  = type;
+    h.id    = id;
+    h.count = count;
+    write_all(fd, &h, sizeof(h));
+    if (len > 0) write_all(fd, payload, len);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/*---< main() >---------------------------------------------------------------*/
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+           int     i, fd, verbose, isBinaryFile, is_output_timing;
+           int     batch, depth, passes, do_stats, do_reload;
+           int     numObjs, numCoords, numQueries, sent, recvd, inflight;
+           int    *membership;
+           char   *filename, *socket_path;
+           char    outFileName[1024];
+           float **objects;
+           double *sendTime, *lat, timing;
+           kmq_header h;
+           kmq_info   info;
+           struct sockaddr_un addr;
+
+    _debug           = 0;
+    verbose          = 1;
+    isBinaryFile     = 0;
+    is_output_timing = 0;
+    batch            = 64;
+    depth            = 8;
+    passes           = 1;
+    do_stats         = 0;
+    do_reload        = 0;
+    filename         = NULL;
+    socket_path      = NULL;
+
+    while ( (opt=getopt(argc,argv,"S:i:k:W:n:bsRoqh"))!= EOF) {
+        switch (opt) {
+            case 'S': socket_path = optarg;
+                      break;
+            case 'i': filename = optarg;
+                      break;
+            case 'b': isBinaryFile = 1;
+                      break;
+            case 'k': batch = atoi(optarg);
+                      break;
+            case 'W': depth = atoi(optarg);
+                      break;
+            case 'n': passes = atoi(optarg);
+                      break;
+            case 's': do_stats = 1;
+                      break;
+            case 'R': do_reload = 1;
+                      break;
+            case 'o': is_output_timing = 1;
+                      break;
+            case 'q': verbose = 0;
+                      break;
+            case 'h':
+            default: usage(argv[0]);
+                      break;
+        }
+    }
+    if (socket_path == NULL || batch <= 0 || depth <= 0 || passes <= 0)
+        usage(argv[0]);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Error: cannot connect to %s (%s)\n", socket_path,
+                strerror(errno));
+        exit(1);
+    }
+
+    if (do_reload) {
+        send_request(fd, KMQ_RELOAD, 0, 0, NULL, 0);
+        read_all(fd, &h, sizeof(h));
+        if (verbose) printf("model reload requested\n");
+    }
+
+    if (filename != NULL) {
+        objects = file_read(isBinaryFile, filename, &numObjs, &numCoords);
+        if (objects == NULL) exit(1);
+
+        send_request(fd, KMQ_INFO, 0, 0, NULL, 0);
+        read_all(fd, &h, sizeof(h));
+        read_all(fd, &info, sizeof(info));
+        if ((int)info.numCoords != numCoords) {
+            printf("Error: data has %d coordinates but the model has %u\n",
+                   numCoords, info.numCoords);
+            exit(1);
+        }
+
+        numQueries = passes * ((numObjs + batch - 1) / batch);
+        membership = (int*)    malloc(numObjs * sizeof(int));
+        sendTime   = (double*) malloc(numQueries * sizeof(double));
+        lat        = (double*) malloc(numQueries * sizeof(double));
+        assert(membership != NULL && sendTime != NULL && lat != NULL);
+
+        /* keep up to depth queries in flight ------------------------------*/
+        timing = omp_get_wtime();
+        sent = recvd = inflight = 0;
+        while (recvd < numQueries) {
+            while (sent < numQueries && inflight < depth) {
+                int first = (sent % ((numObjs + batch - 1) / batch)) * batch;
+                int count = (first + batch <= numObjs) ? batch : numObjs - first;
+                sendTime[sent] = omp_get_wtime();
+                send_request(fd, KMQ_QUERY, sent, count, objects[first],
+                             (size_t)count * numCoords * sizeof(float));
+                sent++;
+                inflight++;
+            }
+            read_all(fd, &h, sizeof(h));
+            if ((h.type & KMQ_TYPE_MASK) != KMQ_QUERY) {
+                fprintf(stderr, "Error: query %u failed\n", h.id);
+                exit(1);
+            }
+            {
+                int first = (h.id % ((numObjs + batch - 1) / batch)) * batch;
+                read_all(fd, membership + first, h.count * sizeof(int));
+            }
+            lat[recvd] = (omp_get_wtime() - sendTime[h.id]) * 1e6;
+            recvd++;
+            inflight--;
+        }
+        timing = omp_get_wtime() - timing;
+
+        sprintf(outFileName, "%s.membership", filename);
+        if (verbose) printf("Writing membership of N=%d data objects to file \"%s\"\n",
+                            numObjs, outFileName);
+        {
+            FILE *fptr = fopen(outFileName, "w");
+            for (i=0; i<numObjs; i++)
+                fprintf(fptr, "%d %d\n", i, membership[i]);
+            fclose(fptr);
+        }
+
+        if (is_output_timing) {
+            qsort(lat, numQueries, sizeof(double), cmp_double);
+            printf("\nQueries to %s ****\n", socket_path);
+            printf("numObjs       = %d\n", numObjs);
+            printf("numCoords     = %d\n", numCoords);
+            printf("numClusters   = %u\n", info.numClusters);
+            printf("objects/query = %d\n", batch);
+            printf("queries       = %d (depth %d)\n", numQueries, depth);
+            printf("Query time         = %10.4f sec\n", timing);
+            printf("Throughput         = %10.0f objects/sec\n",
+                   (double)passes * numObjs / timing);
+            printf("Latency p50        = %10.1f usec\n", lat[(numQueries-1)/2]);
+            printf("Latency p99        = %10.1f usec\n",
+                   lat[(int)((numQueries-1)*0.99)]);
+        }
+
+        free(lat);
+        free(sendTime);
+        free(membership);
+        free(objects[0]);
+        free(objects);
+    }
+
+    if (do_stats) {
+        kmq_stats st;
+        send_request(fd, KMQ_STATS, 0, 0, NULL, 0);
+        read_all(fd, &h, sizeof(h));
+        read_all(fd, &st, sizeof(st));
+        printf("server: requests=%llu queries=%llu batches=%llu "
+               "mean batch=%.1f qps=%.0f p50=%.1fus p99=%.1fus "
+               "reloads=%llu uptime=%.1fs\n",
+               (unsigned long long)st.requests,
+               (unsigned long long)st.queries,
+               (unsigned long long)st.batches, st.mean_batch, st.qps,
+               st.p50_us, st.p99_us, (unsigned long long)st.reloads,
+               st.uptime);
+    }
+
+    close(fd);
+    return(0);
+}
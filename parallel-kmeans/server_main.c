@@ -0,0 +1,577 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         server_main.c                                             */
+/*   Description:  long-running nearest-center query server. The model      */
+/*                 centers stay resident in a kmeans_ctx and batched        */
+/*                 queries arrive over a Unix domain socket using the       */
+/*                 protocol of kmeans_server.h. Requests from all clients   */
+/*                 are coalesced into one call of kmeans_predict(). SIGHUP  */
+/*                 (or a KMQ_RELOAD request) re-reads the model file in a   */
+/*                 background thread; the new centers are swapped in        */
+/*                 between two batches, so no request is dropped.           */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt(), read(), write() */
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <omp.h>
+int      _debug;
+#include "kmeans.h"
+#include "kmeans_lib.h"
+#include "kmeans_server.h"
+
+#define MAX_CONNS       1024
+#define DEFAULT_BATCH   8192     /* objects */
+#define DEFAULT_WAIT    200      /* usec */
+
+typedef struct {
+    int     fd;
+    char   *in;                 /* received bytes not yet consumed */
+    size_t  inLen, inCap;
+    size_t  inParsed;           /* bytes already turned into requests */
+    char   *out;                /* replies not yet sent */
+    size_t  outLen, outOff, outCap;
+    int     closing;
+} conn_t;
+
+typedef struct {
+    int      conn;              /* index in conns[] */
+    int      fd;                /* to detect a reused slot */
+    uint32_t type, id, count;
+    size_t   offset;            /* payload offset in conn->in */
+    int      first;             /* first row in the coalesced batch */
+    double   arrival;
+} request_t;
+
+/* the model, replaced on reload */
+typedef struct {
+    kmeans_ctx *ctx;
+    int         numClusters, numCoords;
+} model_t;
+
+static volatile sig_atomic_t stop_flag   = 0;
+static volatile sig_atomic_t reload_flag = 0;
+
+static char   *model_filename;
+static int     isBinaryModel, nthreads;
+
+/* background reload */
+static pthread_t reload_thread;
+static int       reload_running = 0;
+static int       reload_done    = 0;   /* set by the thread, atomic */
+static model_t   reload_model;
+
+static void on_signal(int sig) {
+    if (sig == SIGHUP) reload_flag = 1;
+    else               stop_flag   = 1;
+}
+
+/*---< usage() >------------------------------------------------------------*/
+static void usage(char *argv0) {
+    char *help =
+        "Usage: %s [switches] -S socket -m model\n"
+        "       -S socket      : path of the Unix domain socket\n"
+        "       -m model       : file containing the cluster centers\n"
+        "       -M             : model file is in binary format (default no)\n"
+        "       -B batch       : max objects per coalesced batch (default %d)\n"
+        "       -w usec        : max wait to coalesce a small batch (default %d)\n"
+        "       -I sec         : print stats every sec seconds with -o (default 10)\n"
+        "       -p nproc       : number of threads (default system allocated)\n"
+        "       -o             : print stats periodically (default no)\n"
+        "       -q             : quiet mode\n"
+        "       -d             : enable debug mode\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0, DEFAULT_BATCH, DEFAULT_WAIT);
+    exit(-1);
+}
+
+/*---< load_model() >--------------------------------------------------------*/
+static int load_model(model_t *m) {
+    float       **clusters;
+    kmeans_config cfg;
+
+    clusters = file_read(isBinaryModel, model_filename, &m->numClusters,
+                         &m->numCoords);
+    if (clusters == NULL) return 0;
+
+    kmeans_config_init(&cfg);
+    cfg.nthreads = nthreads;
+    m->ctx = kmeans_ctx_create(&cfg);
+    if (m->ctx == NULL || !kmeans_set_centers(m->ctx, clusters, m->numCoords,
+                                              m->numClusters)) {
+        kmeans_ctx_destroy(m->ctx);
+        m->ctx = NULL;
+    }
+    free(clusters[0]);
+    free(clusters);
+    return (m->ctx != NULL);
+}
+
+static void* reload_main(void *arg) {
+    if (!load_model(&reload_model)) reload_model.ctx = NULL;
+    __atomic_store_n(&reload_done, 1, __ATOMIC_RELEASE);
+    return arg;
+}
+
+/*---< buffer helpers >------------------------------------------------------*/
+static void reserve(char **buf, size_t *cap, size_t need) {
+    if (need <= *cap) return;
+    while (*cap < need) *cap = (*cap == 0) ? 65536 : 2 * (*cap);
+    *buf = (char*) realloc(*buf, *cap);
+    assert(*buf != NULL);
+}
+
+static char* out_append(conn_t *c, size_t len) {
+    char *p;
+    reserve(&c->out, &c->outCap, c->outLen + len);
+    p = c->out + c->outLen;
+    c->outLen += len;
+    return p;
+}
+
+static void put_header(conn_t *c, uint32_t type, uint32_t id, uint32_t count) {
+    kmq_header h;
+    h.magic = KMQ_MAGIC;
+    h.type  = type;
+    h.id    = id;
+    h.count = count;
+    memcpy(out_append(c, sizeof(h)), &h, sizeof(h));
+}
+
+static void conn_close(conn_t *c) {
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    memset(c, 0, sizeof(conn_t));
+    c->fd = -1;
+}
+
+/*---< latency percentiles >-------------------------------------------------*/
+static double  lat[KMQ_LAT_WINDOW];     /* usec, ring buffer */
+static long    lat_count = 0;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void percentiles(double *p50, double *p99) {
+    static double sorted[KMQ_LAT_WINDOW];
+    long n = (lat_count < KMQ_LAT_WINDOW) ? lat_count : KMQ_LAT_WINDOW;
+    *p50 = *p99 = 0.0;
+    if (n == 0) return;
+    memcpy(sorted, lat, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+    *p50 = sorted[(n - 1) / 2];
+    *p99 = sorted[(long)((n - 1) * 0.99)];
+}
+
+/*---< main() >---------------------------------------------------------------*/
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+           int     i, n, verbose, is_output_timing, maxBatch, waitUsec;
+           int     listenfd, nconns, npending, nrows, capRows;
+           double  interval, start, now, last_print, sec_start;
+           long    sec_queries;
+           char   *socket_path;
+           conn_t *conns;
+           request_t *pending;
+           int       *membership;
+           float     *distances;
+           float    **rows;
+           struct pollfd     *pfds;
+           struct sockaddr_un addr;
+           struct sigaction   sa;
+           model_t  model;
+           uint32_t generation;
+           kmq_stats st;
+
+    /* some default values */
+    _debug           = 0;
+    verbose          = 1;
+    nthreads         = 0;
+    isBinaryModel    = 0;
+    is_output_timing = 0;
+    maxBatch         = DEFAULT_BATCH;
+    waitUsec         = DEFAULT_WAIT;
+    interval         = 10.0;
+    socket_path      = NULL;
+    model_filename   = NULL;
+
+    while ( (opt=getopt(argc,argv,"S:m:B:w:I:p:Modqh"))!= EOF) {
+        switch (opt) {
+            case 'S': socket_path = optarg;
+                      break;
+            case 'm': model_filename = optarg;
+                      break;
+            case 'M': isBinaryModel = 1;
+                      break;
+            case 'B': maxBatch = atoi(optarg);
+                      break;
+            case 'w': waitUsec = atoi(optarg);
+                      break;
+            case 'I': interval = atof(optarg);
+                      break;
+            case 'p': nthreads = atoi(optarg);
+                      break;
+            case 'o': is_output_timing = 1;
+                      break;
+            case 'q': verbose = 0;
+                      break;
+            case 'd': _debug = 1;
+                      break;
+            case 'h':
+            default: usage(argv[0]);
+                      break;
+        }
+    }
+    if (socket_path == NULL || model_filename == NULL || maxBatch <= 0)
+        usage(argv[0]);
+
+    if (nthreads > 0)
+        omp_set_num_threads(nthreads);
+
+    if (!load_model(&model)) {
+        printf("Error: cannot load the model from %s\n", model_filename);
+        exit(1);
+    }
+    generation = 1;
+
+    /* signals: SIGHUP reloads, SIGINT/SIGTERM stop, SIGPIPE is ignored */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGHUP,  &sa, NULL);
+    sigaction(SIGINT,  &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* listening socket ----------------------------------------------------*/
+    listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenfd < 0) { perror("socket"); exit(1); }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    unlink(socket_path);
+    if (bind(listenfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(listenfd, 128) < 0) {
+        fprintf(stderr, "Error: cannot listen on %s (%s)\n", socket_path,
+                strerror(errno));
+        exit(1);
+    }
+    fcntl(listenfd, F_SETFL, O_NONBLOCK);
+
+    if (verbose)
+        printf("serving K=%d centers of %d coordinates on %s\n",
+               model.numClusters, model.numCoords, socket_path);
+
+    conns   = (conn_t*)        calloc(MAX_CONNS, sizeof(conn_t));
+    pfds    = (struct pollfd*) calloc(MAX_CONNS + 1, sizeof(struct pollfd));
+    pending = (request_t*)     malloc(MAX_CONNS * 64 * sizeof(request_t));
+    assert(conns != NULL && pfds != NULL && pending != NULL);
+    for (i=0; i<MAX_CONNS; i++) conns[i].fd = -1;
+    nconns = 0;
+
+    capRows    = 0;
+    rows       = NULL;
+    membership = NULL;
+    distances  = NULL;
+
+    memset(&st, 0, sizeof(st));
+    start = last_print = sec_start = omp_get_wtime();
+    sec_queries = 0;
+    npending = 0;
+    nrows    = 0;
+
+    while (!stop_flag) {
+        int    timeout, flush;
+        double oldest;
+
+        /* hot reload: start a loader thread, swap when it is done ---------*/
+        if (reload_flag && !reload_running) {
+            reload_flag = 0;
+            reload_done = 0;
+            if (pthread_create(&reload_thread, NULL, reload_main, NULL) == 0)
+                reload_running = 1;
+        }
+
+        /* poll: wait for input, bounded by the coalescing window ----------*/
+        n = 0;
+        pfds[n].fd = listenfd; pfds[n].events = POLLIN; n++;
+        for (i=0; i<nconns; i++) {
+            pfds[n].fd     = conns[i].fd;
+            pfds[n].events = POLLIN;
+            if (conns[i].outLen > conns[i].outOff) pfds[n].events |= POLLOUT;
+            n++;
+        }
+        if (npending > 0) {
+            oldest  = pending[0].arrival;
+            timeout = (int)((oldest + waitUsec * 1e-6 - omp_get_wtime()) * 1e3);
+            if (timeout < 0) timeout = 0;
+        }
+        else
+            timeout = reload_running ? 10 : 1000;
+
+        if (poll(pfds, n, timeout) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+
+        /* new connections */
+        if (pfds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = accept(listenfd, NULL, NULL)) >= 0) {
+                if (nconns == MAX_CONNS) { close(fd); continue; }
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+                memset(&conns[nconns], 0, sizeof(conn_t));
+                conns[nconns].fd = fd;
+                nconns++;
+            }
+        }
+
+        /* read and parse requests ------------------------------------------*/
+        for (i=0; i<nconns; i++) {
+            conn_t *c = &conns[i];
+            if (c->fd < 0 || c->closing) continue;
+
+            for (;;) {
+                ssize_t r;
+                reserve(&c->in, &c->inCap, c->inLen + 65536);
+                r = read(c->fd, c->in + c->inLen, c->inCap - c->inLen);
+                if (r > 0) { c->inLen += r; continue; }
+                if (r == 0) c->closing = 1;
+                else if (errno != EAGAIN && errno != EWOULDBLOCK &&
+                         errno != EINTR) c->closing = 1;
+                break;
+            }
+
+            /* turn complete messages into pending requests */
+            while (c->inLen - c->inParsed >= sizeof(kmq_header)) {
+                kmq_header h;
+                size_t     payload = 0;
+                uint32_t   type;
+
+                memcpy(&h, c->in + c->inParsed, sizeof(h));
+                type = h.type & KMQ_TYPE_MASK;
+                if (h.magic != KMQ_MAGIC ||
+                    (type == KMQ_QUERY && h.count > KMQ_MAX_COUNT)) {
+                    c->closing = 1;     /* protocol error */
+                    break;
+                }
+                if (type == KMQ_QUERY)
+                    payload = (size_t)h.count * model.numCoords * sizeof(float);
+                if (c->inLen - c->inParsed < sizeof(h) + payload) break;
+
+                if (npending == MAX_CONNS * 64) break;  /* flush first */
+                pending[npending].conn    = i;
+                pending[npending].fd      = c->fd;
+                pending[npending].type    = h.type;
+                pending[npending].id      = h.id;
+                pending[npending].count   = (type == KMQ_QUERY) ? h.count : 0;
+                pending[npending].offset  = c->inParsed + sizeof(h);
+                pending[npending].first   = nrows;
+                pending[npending].arrival = omp_get_wtime();
+                nrows += pending[npending].count;
+                npending++;
+                c->inParsed += sizeof(h) + payload;
+            }
+        }
+
+        /* flush when the batch is full or the oldest request waited enough */
+        now   = omp_get_wtime();
+        flush = (npending > 0) &&
+                (nrows >= maxBatch || npending == MAX_CONNS * 64 ||
+                 now - pending[0].arrival >= waitUsec * 1e-6);
+
+        if (flush) {
+            int want_dist = 0;
+
+            /* gather the rows of all pending queries -----------------------*/
+            if (nrows > capRows) {
+                capRows    = nrows;
+                rows       = (float**) realloc(rows, capRows * sizeof(float*));
+                membership = (int*)    realloc(membership, capRows * sizeof(int));
+                distances  = (float*)  realloc(distances,  capRows * sizeof(float));
+                assert(rows != NULL && membership != NULL && distances != NULL);
+            }
+            for (n=0; n<npending; n++) {
+                request_t *r = &pending[n];
+                float     *p = (float*)(conns[r->conn].in + r->offset);
+                for (i=0; i<(int)r->count; i++)
+                    rows[r->first + i] = p + (size_t)i * model.numCoords;
+                if (r->type & KMQ_WANT_DIST) want_dist = 1;
+            }
+            if (nrows > 0) {
+                kmeans_predict(model.ctx, rows, nrows, membership,
+                               want_dist ? distances : NULL);
+                st.batches++;
+                st.queries  += nrows;
+                sec_queries += nrows;
+            }
+
+            /* replies, in request order ------------------------------------*/
+            now = omp_get_wtime();
+            for (n=0; n<npending; n++) {
+                request_t *r    = &pending[n];
+                conn_t    *c    = &conns[r->conn];
+                uint32_t   type = r->type & KMQ_TYPE_MASK;
+
+                if (c->fd != r->fd) continue;   /* connection went away */
+
+                if (type == KMQ_QUERY) {
+                    put_header(c, r->type, r->id, r->count);
+                    memcpy(out_append(c, r->count * sizeof(int)),
+                           membership + r->first, r->count * sizeof(int));
+                    if (r->type & KMQ_WANT_DIST)
+                        memcpy(out_append(c, r->count * sizeof(float)),
+                               distances + r->first, r->count * sizeof(float));
+                }
+                else if (type == KMQ_INFO) {
+                    kmq_info info;
+                    info.numClusters = model.numClusters;
+                    info.numCoords   = model.numCoords;
+                    info.generation  = generation;
+                    info.pad         = 0;
+                    put_header(c, r->type, r->id, 0);
+                    memcpy(out_append(c, sizeof(info)), &info, sizeof(info));
+                }
+                else if (type == KMQ_STATS) {
+                    st.uptime     = now - start;
+                    st.mean_batch = st.batches ? (double)st.queries / st.batches
+                                               : 0.0;
+                    percentiles(&st.p50_us, &st.p99_us);
+                    put_header(c, r->type, r->id, 0);
+                    memcpy(out_append(c, sizeof(st)), &st, sizeof(st));
+                }
+                else if (type == KMQ_RELOAD) {
+                    reload_flag = 1;
+                    put_header(c, r->type, r->id, 0);
+                }
+                else
+                    put_header(c, KMQ_ERROR, r->id, 0);
+
+                st.requests++;
+                lat[lat_count++ % KMQ_LAT_WINDOW] = (now - r->arrival) * 1e6;
+            }
+
+            /* drop the consumed input */
+            for (i=0; i<nconns; i++) {
+                conn_t *c = &conns[i];
+                if (c->fd < 0 || c->inParsed == 0) continue;
+                memmove(c->in, c->in + c->inParsed, c->inLen - c->inParsed);
+                c->inLen   -= c->inParsed;
+                c->inParsed = 0;
+            }
+            npending = 0;
+            nrows    = 0;
+        }
+
+        /* swap in a reloaded model between two batches */
+        if (reload_running && npending == 0 &&
+            __atomic_load_n(&reload_done, __ATOMIC_ACQUIRE)) {
+            pthread_join(reload_thread, NULL);
+            reload_running = 0;
+            if (reload_model.ctx != NULL &&
+                reload_model.numCoords == model.numCoords) {
+                kmeans_ctx_destroy(model.ctx);
+                model = reload_model;
+                generation++;
+                st.reloads++;
+                if (verbose)
+                    printf("reloaded K=%d centers from %s\n",
+                           model.numClusters, model_filename);
+            }
+            else {
+                if (reload_model.ctx != NULL)
+                    kmeans_ctx_destroy(reload_model.ctx);
+                fprintf(stderr, "Error: reload of %s failed, keeping the old model\n",
+                        model_filename);
+            }
+        }
+
+        /* send replies -----------------------------------------------------*/
+        for (i=0; i<nconns; i++) {
+            conn_t *c = &conns[i];
+            while (c->fd >= 0 && c->outLen > c->outOff) {
+                ssize_t w = write(c->fd, c->out + c->outOff,
+                                  c->outLen - c->outOff);
+                if (w > 0) { c->outOff += w; continue; }
+                if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                    errno != EINTR) c->closing = 1, c->outOff = c->outLen;
+                break;
+            }
+            if (c->outOff == c->outLen) c->outOff = c->outLen = 0;
+        }
+
+        /* close finished connections, only between batches so the indices
+           of pending requests stay valid */
+        if (npending == 0) {
+            for (i=0; i<nconns; ) {
+                if (conns[i].closing && conns[i].outLen == 0) {
+                    conn_close(&conns[i]);
+                    conns[i] = conns[nconns-1];
+                    memset(&conns[nconns-1], 0, sizeof(conn_t));
+                    conns[nconns-1].fd = -1;
+                    nconns--;
+                }
+                else i++;
+            }
+        }
+
+        /* counters ---------------------------------------------------------*/
+        now = omp_get_wtime();
+        if (now - sec_start >= 1.0) {
+            st.qps      = sec_queries / (now - sec_start);
+            sec_queries = 0;
+            sec_start   = now;
+        }
+        if (is_output_timing && now - last_print >= interval) {
+            percentiles(&st.p50_us, &st.p99_us);
+            printf("requests=%llu queries=%llu batches=%llu qps=%.0f "
+                   "p50=%.1fus p99=%.1fus reloads=%llu\n",
+                   (unsigned long long)st.requests,
+                   (unsigned long long)st.queries,
+                   (unsigned long long)st.batches, st.qps,
+                   st.p50_us, st.p99_us, (unsigned long long)st.reloads);
+            fflush(stdout);
+            last_print = now;
+        }
+    }
+
+    if (reload_running) {
+        pthread_join(reload_thread, NULL);
+        if (reload_model.ctx != NULL) kmeans_ctx_destroy(reload_model.ctx);
+    }
+    for (i=0; i<nconns; i++) conn_close(&conns[i]);
+    close(listenfd);
+    unlink(socket_path);
+
+    if (verbose)
+        printf("served %llu requests, %llu queries\n",
+               (unsigned long long)st.requests,
+               (unsigned long long)st.queries);
+
+    free(rows);
+    free(membership);
+    free(distances);
+    free(pending);
+    free(pfds);
+    free(conns);
+    kmeans_ctx_destroy(model.ctx);
+    return(0);
+}
@@ -0,0 +1,215 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         shm_loadgen.c                                             */
+/*   Description:  local load generator for shm_main. Attaches to a ring as */
+/*                 its producer, keeps a number of slots in flight and      */
+/*                 reports throughput and per-slot latency. With -m the     */
+/*                 returned ids are checked against kmeans_predict() run    */
+/*                 in-process on the same model.                             */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt() */
+
+#include <omp.h>
+int      _debug;
+#include "kmeans.h"
+#include "kmeans_lib.h"
+#include "kmeans_shm.h"
+
+/*---< usage() >------------------------------------------------------------*/
+static void usage(char *argv0) {
+    char *help =
+        "Usage: %s [switches] -N name\n"
+        "       -N name        : shared memory name of the ring\n"
+        "       -i filename    : take the query vectors from this file\n"
+        "                        (default uniform random in [-1,1])\n"
+        "       -b             : input file is in binary format (default no)\n"
+        "       -n queries     : total no. query vectors (default 1000000)\n"
+        "       -W depth       : slots in flight (default: all slots)\n"
+        "       -m model       : verify the ids against this model file\n"
+        "       -M             : model file is in binary format (default no)\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0);
+    exit(-1);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/*---< main() >---------------------------------------------------------------*/
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+           int     i, j, isBinaryFile, isBinaryModel, depth, inflight;
+           int     numCoords, slotObjs, nslots, numObjs, dataCoords;
+           int     numClusters, modelCoords, nsent, nrecvd, nslotsTotal;
+           long    numQueries, next, mismatches;
+           char   *name, *filename, *model_filename;
+           float **data, **clusters;
+           int    *expect;
+           double *sendTime, *lat, timing;
+           long   *slotFirst;
+           kmeans_shm *ring;
+           kmeans_ctx *ctx;
+
+    _debug         = 0;
+    isBinaryFile   = 0;
+    isBinaryModel  = 0;
+    depth          = 0;
+    numQueries     = 1000000;
+    name           = NULL;
+    filename       = NULL;
+    model_filename = NULL;
+
+    while ( (opt=getopt(argc,argv,"N:i:n:W:m:bMh"))!= EOF) {
+        switch (opt) {
+            case 'N': name = optarg;
+                      break;
+            case 'i': filename = optarg;
+                      break;
+            case 'b': isBinaryFile = 1;
+                      break;
+            case 'n': numQueries = atol(optarg);
+                      break;
+            case 'W': depth = atoi(optarg);
+                      break;
+            case 'm': model_filename = optarg;
+                      break;
+            case 'M': isBinaryModel = 1;
+                      break;
+            case 'h':
+            default: usage(argv[0]);
+                      break;
+        }
+    }
+    if (name == NULL || numQueries <= 0) usage(argv[0]);
+
+    ring = kmeans_shm_attach(name);
+    if (ring == NULL) {
+        fprintf(stderr, "Error: cannot attach to ring %s\n", name);
+        exit(1);
+    }
+    numCoords = kmeans_shm_coords(ring);
+    slotObjs  = kmeans_shm_slot_objs(ring);
+    nslots    = kmeans_shm_slots(ring);
+    if (depth <= 0 || depth > nslots) depth = nslots;
+
+    /* the query vectors: a data file or random values */
+    if (filename != NULL) {
+        data = file_read(isBinaryFile, filename, &numObjs, &dataCoords);
+        if (data == NULL) exit(1);
+        if (dataCoords != numCoords) {
+            printf("Error: data has %d coordinates but the ring has %d\n",
+                   dataCoords, numCoords);
+            exit(1);
+        }
+    }
+    else {
+        numObjs = 65536;
+        data    = (float**) malloc(numObjs * sizeof(float*));
+        data[0] = (float*)  malloc((size_t)numObjs * numCoords * sizeof(float));
+        assert(data != NULL && data[0] != NULL);
+        srand(1);
+        for (i=0; i<numObjs; i++) {
+            if (i > 0) data[i] = data[i-1] + numCoords;
+            for (j=0; j<numCoords; j++)
+                data[i][j] = 2.0f * rand() / RAND_MAX - 1.0f;
+        }
+    }
+
+    /* expected ids, computed in-process */
+    expect = NULL;
+    if (model_filename != NULL) {
+        clusters = file_read(isBinaryModel, model_filename, &numClusters,
+                             &modelCoords);
+        if (clusters == NULL || modelCoords != numCoords) {
+            printf("Error: model does not match the ring\n");
+            exit(1);
+        }
+        expect = (int*) malloc(numObjs * sizeof(int));
+        ctx    = kmeans_ctx_create(NULL);
+        assert(expect != NULL && ctx != NULL);
+        kmeans_set_centers(ctx, clusters, numCoords, numClusters);
+        kmeans_predict(ctx, data, numObjs, expect, NULL);
+        kmeans_ctx_destroy(ctx);
+        free(clusters[0]);
+        free(clusters);
+    }
+
+    nslotsTotal = (int)((numQueries + slotObjs - 1) / slotObjs);
+    sendTime  = (double*) malloc(nslotsTotal * sizeof(double));
+    lat       = (double*) malloc(nslotsTotal * sizeof(double));
+    slotFirst = (long*)   malloc(nslotsTotal * sizeof(long));
+    assert(sendTime != NULL && lat != NULL && slotFirst != NULL);
+
+    /* keep depth slots in flight ------------------------------------------*/
+    mismatches = 0;
+    next = 0;
+    nsent = nrecvd = inflight = 0;
+    timing = omp_get_wtime();
+    while (nrecvd < nslotsTotal) {
+        while (nsent < nslotsTotal && inflight < depth) {
+            float *in = kmeans_shm_acquire(ring);
+            int    count;
+            if (in == NULL) break;
+            count = (numQueries - (long)nsent * slotObjs < slotObjs)
+                  ? (int)(numQueries - (long)nsent * slotObjs) : slotObjs;
+            /* write the query vectors in place */
+            slotFirst[nsent] = next;
+            for (i=0; i<count; i++) {
+                memcpy(in + (size_t)i * numCoords, data[next], numCoords * sizeof(float));
+                next = (next + 1) % numObjs;
+            }
+            sendTime[nsent] = omp_get_wtime();
+            kmeans_shm_submit(ring, count);
+            nsent++;
+            inflight++;
+        }
+        {
+            const int *ids;
+            int        count = kmeans_shm_result(ring, &ids);
+            lat[nrecvd] = (omp_get_wtime() - sendTime[nrecvd]) * 1e6;
+            if (expect != NULL) {
+                long k = slotFirst[nrecvd];
+                for (i=0; i<count; i++) {
+                    if (ids[i] != expect[k]) mismatches++;
+                    k = (k + 1) % numObjs;
+                }
+            }
+            nrecvd++;
+            inflight--;
+        }
+    }
+    timing = omp_get_wtime() - timing;
+
+    qsort(lat, nslotsTotal, sizeof(double), cmp_double);
+    printf("ring %s: %d slots of %d objects, %d in flight\n", name, nslots,
+           slotObjs, depth);
+    printf("queries            = %10ld\n", numQueries);
+    printf("Query time         = %10.4f sec\n", timing);
+    printf("Throughput         = %10.0f objects/sec\n", numQueries / timing);
+    printf("Slot latency p50   = %10.1f usec\n", lat[(nslotsTotal-1)/2]);
+    printf("Slot latency p99   = %10.1f usec\n", lat[(int)((nslotsTotal-1)*0.99)]);
+    if (expect != NULL)
+        printf("mismatches         = %10ld\n", mismatches);
+
+    kmeans_shm_close(ring, 0);
+    free(slotFirst);
+    free(lat);
+    free(sendTime);
+    free(expect);
+    free(data[0]);
+    free(data);
+    return (mismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         shm_main.c                                                */
+/*   Description:  serves nearest-center queries of co-located clients over */
+/*                 shared-memory rings (kmeans_shm.h). Each ring has one    */
+/*                 producer client and is served by its own thread with    */
+/*                 its own copy of the model.                                */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt() */
+#include <signal.h>
+#include <pthread.h>
+
+#include <omp.h>
+int      _debug;
+#include "kmeans.h"
+#include "kmeans_lib.h"
+#include "kmeans_shm.h"
+
+static volatile sig_atomic_t stop_flag = 0;
+
+static void on_signal(int sig) {
+    stop_flag = 1;
+}
+
+typedef struct {
+    kmeans_shm *ring;
+    kmeans_ctx *ctx;
+    long        served;
+} ring_t;
+
+static void* serve_main(void *arg) {
+    ring_t *r = (ring_t*) arg;
+    r->served = kmeans_shm_serve(r->ring, r->ctx, (volatile int*)&stop_flag);
+    return NULL;
+}
+
+/*---< usage() >------------------------------------------------------------*/
+static void usage(char *argv0) {
+    char *help =
+        "Usage: %s [switches] -N name -m model\n"
+        "       -N name        : shared memory name, e.g. /kmeans\n"
+        "       -m model       : file containing the cluster centers\n"
+        "       -M             : model file is in binary format (default no)\n"
+        "       -r rings       : no. rings, named name.0, name.1, ... when > 1\n"
+        "                        (default 1)\n"
+        "       -k objs        : objects per slot (default 256)\n"
+        "       -s slots       : slots per ring (default 16)\n"
+        "       -p nproc       : threads per ring (default system allocated / rings)\n"
+        "       -q             : quiet mode\n"
+        "       -d             : enable debug mode\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0);
+    exit(-1);
+}
+
+/*---< main() >---------------------------------------------------------------*/
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+           int     i, verbose, isBinaryModel, nrings, slotObjs, nslots;
+           int     nthreads, numClusters, numCoords;
+           long    total;
+           char   *name, *model_filename;
+           char    ringName[256];
+           float **clusters;
+           double  timing;
+           ring_t *rings;
+           pthread_t *threads;
+           struct sigaction sa;
+           kmeans_config cfg;
+
+    _debug         = 0;
+    verbose        = 1;
+    isBinaryModel  = 0;
+    nrings         = 1;
+    slotObjs       = 256;
+    nslots         = 16;
+    nthreads       = 0;
+    name           = NULL;
+    model_filename = NULL;
+
+    while ( (opt=getopt(argc,argv,"N:m:r:k:s:p:Mqdh"))!= EOF) {
+        switch (opt) {
+            case 'N': name = optarg;
+                      break;
+            case 'm': model_filename = optarg;
+                      break;
+            case 'M': isBinaryModel = 1;
+                      break;
+            case 'r': nrings = atoi(optarg);
+                      break;
+            case 'k': slotObjs = atoi(optarg);
+                      break;
+            case 's': nslots = atoi(optarg);
+                      break;
+            case 'p': nthreads = atoi(optarg);
+                      break;
+            case 'q': verbose = 0;
+                      break;
+            case 'd': _debug = 1;
+                      break;
+            case 'h':
+            default: usage(argv[0]);
+                      break;
+        }
+    }
+    if (name == NULL || model_filename == NULL || nrings <= 0 ||
+        slotObjs <= 0 || nslots <= 0)
+        usage(argv[0]);
+
+    clusters = file_read(isBinaryModel, model_filename, &numClusters,
+                         &numCoords);
+    if (clusters == NULL) exit(1);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT,  &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    /* split the cores among the rings unless told otherwise */
+    if (nthreads <= 0) {
+        nthreads = omp_get_max_threads() / nrings;
+        if (nthreads < 1) nthreads = 1;
+    }
+    kmeans_config_init(&cfg);
+    cfg.nthreads = nthreads;
+
+    rings   = (ring_t*)    calloc(nrings, sizeof(ring_t));
+    threads = (pthread_t*) calloc(nrings, sizeof(pthread_t));
+    assert(rings != NULL && threads != NULL);
+
+    for (i=0; i<nrings; i++) {
+        if (nrings > 1) snprintf(ringName, sizeof(ringName), "%s.%d", name, i);
+        else            snprintf(ringName, sizeof(ringName), "%s", name);
+
+        rings[i].ring = kmeans_shm_create(ringName, numCoords, slotObjs,
+                                          nslots);
+        rings[i].ctx  = kmeans_ctx_create(&cfg);
+        if (rings[i].ring == NULL || rings[i].ctx == NULL ||
+            !kmeans_set_centers(rings[i].ctx, clusters, numCoords,
+                                numClusters)) {
+            fprintf(stderr, "Error: cannot create ring %s\n", ringName);
+            exit(1);
+        }
+        if (verbose)
+            printf("ring %s: %d slots of %d objects, K=%d centers of %d coordinates\n",
+                   ringName, nslots, slotObjs, numClusters, numCoords);
+    }
+    fflush(stdout);
+
+    timing = omp_get_wtime();
+    for (i=0; i<nrings; i++)
+        pthread_create(&threads[i], NULL, serve_main, &rings[i]);
+
+    total = 0;
+    for (i=0; i<nrings; i++) {
+        pthread_join(threads[i], NULL);
+        total += rings[i].served;
+        kmeans_shm_close(rings[i].ring, 1);
+        kmeans_ctx_destroy(rings[i].ctx);
+    }
+    timing = omp_get_wtime() - timing;
+
+    if (verbose)
+        printf("served %ld queries in %.2f sec\n", total, timing);
+
+    free(threads);
+    free(rings);
+    free(clusters[0]);
+    free(clusters);
+    return(0);
+}
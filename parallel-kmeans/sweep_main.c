@@ -0,0 +1,268 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+/*   File:         sweep_main.c                                              */
+/*   Description:  clusters one data set for a list of K values and prints */
+/*                 an SSE/K table for elbow analysis. The data is read      */
+/*                 once; each K after the smallest starts from the previous */
+/*                 solution with its largest clusters split in two          */
+/*                 (kmeans_split_centers), so it needs far fewer loops than */
+/*                 a run from scratch.                                       */
+/*                                                                           */
+/*   Author:  Tyson O'Leary, Blake Davis, Chris LaBerge                      */
+/*            Computer Science Department, Colorado State University        */
+/*                                                                           */
+/*   Copyright (C) 2005, Northwestern University                             */
+/*   See COPYRIGHT notice in top-level directory.                            */
+/*                                                                           */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     /* getopt() */
+
+#include <omp.h>
+int      _debug;
+#include "kmeans.h"
+#include "kmeans_lib.h"
+
+/*---< usage() >------------------------------------------------------------*/
+static void usage(char *argv0, float threshold) {
+    char *help =
+        "Usage: %s [switches] -i filename -k K1,K2,...\n"
+        "       -i filename    : file containing data to be clustered\n"
+        "       -b             : input file is in binary format (default no)\n"
+        "       -k K1,K2,...   : comma separated list of no. clusters (K > 1)\n"
+        "       -t threshold   : threshold value (default %.4f)\n"
+        "       -p nproc       : number of threads (default system allocated)\n"
+        "       -e engine      : seq, atomic, reduction, transposed, tasks\n"
+        "                        pool, sorted, tiled, sketch or ivf (default\n"
+        "                        transposed)\n"
+        "       -L tile        : centers per tile of the tiled engine (default\n"
+        "                        half the L2 cache worth)\n"
+        "       -C             : cold starts, every K from its first K objects\n"
+        "       -w             : write centers and membership of every K to\n"
+        "                        filename.K<k>.cluster_centres/.membership\n"
+        "       -o             : output timing results (default no)\n"
+        "       -q             : quiet mode\n"
+        "       -d             : enable debug mode\n"
+        "       -h             : print this help information\n";
+    fprintf(stderr, help, argv0, threshold);
+    exit(-1);
+}
+
+static int cmp_int(const void *a, const void *b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+/*---< main() >---------------------------------------------------------------*/
+int main(int argc, char **argv) {
+           int     opt;
+    extern char   *optarg;
+           int     i, j, k, nthreads, verbose, isBinaryFile, is_output_timing;
+           int     is_cold, is_write, numK, maxK, prevK, tileK;
+           int     numObjs, numCoords;
+           int    *Ks, *loops, *membership;
+           char   *filename, *klist, *save, *tok, outname[1024];
+           float   threshold;
+           float **objects, **clusters, *dist;
+           double *sse, *times, *rates, timing, io_timing, total;
+           FILE   *fp;
+           char   *engine_name;
+           kmeans_config cfg;
+           kmeans_ctx   *ctx;
+
+    _debug           = 0;
+    verbose          = 1;
+    nthreads         = 0;
+    threshold        = 0.001;
+    isBinaryFile     = 0;
+    is_output_timing = 0;
+    is_cold          = 0;
+    is_write         = 0;
+    tileK            = 0;
+    filename         = NULL;
+    klist            = NULL;
+    engine_name      = NULL;
+
+    while ( (opt=getopt(argc,argv,"i:k:t:p:e:L:bCwoqdh"))!= EOF) {
+        switch (opt) {
+            case 'i': filename = optarg;
+                      break;
+            case 'b': isBinaryFile = 1;
+                      break;
+            case 'k': klist = optarg;
+                      break;
+            case 't': threshold = atof(optarg);
+                      break;
+            case 'p': nthreads = atoi(optarg);
+                      break;
+            case 'e': engine_name = optarg;
+                      break;
+            case 'L': tileK = atoi(optarg);
+                      break;
+            case 'C': is_cold = 1;
+                      break;
+            case 'w': is_write = 1;
+                      break;
+            case 'o': is_output_timing = 1;
+                      break;
+            case 'q': verbose = 0;
+                      break;
+            case 'd': _debug = 1;
+                      break;
+            case 'h':
+            default: usage(argv[0], threshold);
+                      break;
+        }
+    }
+    if (filename == NULL || klist == NULL) usage(argv[0], threshold);
+
+    /* the K values, ascending and without duplicates */
+    Ks   = (int*) malloc((strlen(klist) / 2 + 1) * sizeof(int));
+    assert(Ks != NULL);
+    numK = 0;
+    for (tok = strtok_r(klist, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save)) {
+        Ks[numK] = atoi(tok);
+        if (Ks[numK] <= 1) usage(argv[0], threshold);
+        numK++;
+    }
+    if (numK == 0) usage(argv[0], threshold);
+    qsort(Ks, numK, sizeof(int), cmp_int);
+    for (i=1, j=1; i<numK; i++)
+        if (Ks[i] != Ks[j-1]) Ks[j++] = Ks[i];
+    numK = j;
+    maxK = Ks[numK-1];
+
+    kmeans_config_init(&cfg);
+    cfg.nthreads  = nthreads;
+    cfg.threshold = threshold;
+    cfg.debug     = _debug;
+    cfg.tile_clusters = tileK;
+    if (engine_name != NULL && !kmeans_engine_parse(engine_name, &cfg.engine)) {
+        printf("Error: unknown engine \"%s\"\n", engine_name);
+        exit(1);
+    }
+    if (nthreads > 0)
+        omp_set_num_threads(nthreads);
+
+    /* read data points from file once ------------------------------------*/
+    io_timing = omp_get_wtime();
+    if (verbose) printf("reading data points from file %s\n", filename);
+    objects = file_read(isBinaryFile, filename, &numObjs, &numCoords);
+    if (objects == NULL) exit(1);
+    io_timing = omp_get_wtime() - io_timing;
+
+    if (numObjs < maxK) {
+        printf("Error: number of clusters must be smaller than the number of data points\n");
+        exit(1);
+    }
+
+    clusters    = (float**) malloc(maxK * sizeof(float*));
+    assert(clusters != NULL);
+    clusters[0] = (float*)  malloc((size_t)maxK * numCoords * sizeof(float));
+    assert(clusters[0] != NULL);
+    for (i=1; i<maxK; i++)
+        clusters[i] = clusters[i-1] + numCoords;
+
+    membership = (int*)    malloc(numObjs * sizeof(int));
+    dist       = (float*)  malloc(numObjs * sizeof(float));
+    loops      = (int*)    malloc(numK * sizeof(int));
+    sse        = (double*) malloc(numK * sizeof(double));
+    times      = (double*) malloc(numK * sizeof(double));
+    rates      = (double*) malloc(numK * sizeof(double));
+    assert(membership != NULL && dist != NULL && loops != NULL &&
+           sse != NULL && times != NULL && rates != NULL);
+
+    /* one context for all K: its scratch grows with K and is reused */
+    ctx = kmeans_ctx_create(&cfg);
+    assert(ctx != NULL);
+
+    total = omp_get_wtime();
+    prevK = 0;
+    for (k=0; k<numK; k++) {
+        timing = omp_get_wtime();
+
+        if (is_cold || prevK == 0) {
+            for (i=0; i<Ks[k]; i++)
+                for (j=0; j<numCoords; j++)
+                    clusters[i][j] = objects[i][j];
+            if (check_repeated_clusters(Ks[k], numCoords, clusters) == 0) {
+                printf("Error: some of the first %d objects are repeated\n", Ks[k]);
+                exit(1);
+            }
+        }
+        else if (!kmeans_split_centers(objects, numCoords, numObjs,
+                                       membership, prevK, Ks[k], clusters)) {
+            printf("Error: cannot split %d centers into %d\n", prevK, Ks[k]);
+            exit(1);
+        }
+
+        if (!kmeans_fit(ctx, objects, numCoords, numObjs, Ks[k], membership,
+                        clusters)) {
+            printf("Error: clustering failed for K = %d\n", Ks[k]);
+            exit(1);
+        }
+        loops[k] = kmeans_ctx_stats(ctx)->loops;
+        rates[k] = kmeans_ctx_stats(ctx)->dist_calcs /
+                   kmeans_ctx_stats(ctx)->timing / 1e6;
+
+        /* SSE and membership at the final centers, the base of the next
+           warm start */
+        kmeans_set_centers(ctx, clusters, numCoords, Ks[k]);
+        kmeans_predict(ctx, objects, numObjs, membership, dist);
+        sse[k] = 0.0;
+        for (i=0; i<numObjs; i++) sse[k] += dist[i];
+
+        times[k] = omp_get_wtime() - timing;
+        prevK    = Ks[k];
+
+        if (is_write) {
+            snprintf(outname, sizeof(outname), "%s.K%d", filename, Ks[k]);
+            file_write(outname, Ks[k], numObjs, numCoords, clusters,
+                       membership, verbose);
+        }
+    }
+    total = omp_get_wtime() - total;
+
+    /* the SSE/K table, on stdout and in filename.sweep ---------------------*/
+    snprintf(outname, sizeof(outname), "%s.sweep", filename);
+    fp = fopen(outname, "w");
+    if (fp == NULL) printf("Error: cannot write %s\n", outname);
+    printf("%8s %16s %8s %10s %10s\n", "K", "SSE", "nloops", "time (s)",
+           "Mdist/s");
+    for (k=0; k<numK; k++) {
+        printf("%8d %16.6e %8d %10.4f %10.1f\n", Ks[k], sse[k], loops[k],
+               times[k], rates[k]);
+        if (fp != NULL) fprintf(fp, "%d %e %d %f\n", Ks[k], sse[k], loops[k], times[k]);
+    }
+    if (fp != NULL) fclose(fp);
+    if (verbose) printf("Writing SSE/K table to file \"%s\"\n", outname);
+
+    if (is_output_timing) {
+        printf("\nPerforming **** K sweep (OpenMP) ---- %s starts,", is_cold ? "cold" : "warm");
+        printf(" using %s engine ******\n", kmeans_engine_name(cfg.engine));
+        printf("Number of threads = %d\n", omp_get_max_threads());
+        printf("Input file:     %s\n", filename);
+        printf("numObjs       = %d\n", numObjs);
+        printf("numCoords     = %d\n", numCoords);
+        printf("no. K values  = %d\n", numK);
+        printf("threshold     = %.4f\n", threshold);
+        printf("I/O time           = %10.4f sec\n", io_timing);
+        printf("Computation timing = %10.4f sec\n", total);
+    }
+
+    kmeans_ctx_destroy(ctx);
+    free(rates);
+    free(times);
+    free(sse);
+    free(loops);
+    free(dist);
+    free(membership);
+    free(clusters[0]);
+    free(clusters);
+    free(objects[0]);
+    free(objects);
+    free(Ks);
+    return(0);
+}
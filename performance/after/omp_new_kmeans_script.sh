@@ -1,14 +1,13 @@
 #!/bin/bash
+# -e auto picks the engine and the no. threads for this host: the first
+# run times the candidates on a sample and records the choice in
+# $HOME/.kmeans_tuning.<host>, the second one reads it back
 truncate -s 0 return.txt
-for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+for run in probed cached
 do
-    export OMP_NUM_THREADS=$i
-    printf "$i\n"
-    #for j in 1 2 3 4 5 6 7
-    #do
-        ./omp_new_main -a -o -n 5000 -i ./Image_data/colorBig.txt >> return.txt
-    #done
-    cat return.txt | grep "Computation timing"
+    printf "$run\n"
+    ./omp_new_main -e auto -o -n 5000 -i ./Image_data/colorBig.txt >> return.txt
+    cat return.txt | grep "planned\|Computation timing"
     truncate -s 0 return.txt
     printf "\n"
 done